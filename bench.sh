@@ -0,0 +1,9 @@
+#!/bin/sh
+
+# Builds the benchmarks optimized and without sanitizers, in their own build
+# directory, and runs them. Arguments go to netstack_bench, for example
+# `./bench.sh --baseline baseline.txt` fails if anything got slower.
+cmake -S . -B build-bench -DCMAKE_BUILD_TYPE=Release -DNETSTACK_SANITIZE=OFF
+cmake --build build-bench -j 8 --target netstack_bench
+
+./build-bench/netstack_bench "$@"
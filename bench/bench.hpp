@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A small microbenchmark harness for the per-packet hot path. Benchmarks
+// register themselves with BENCHMARK and do their setup before looping over
+// the State, only the loop is measured:
+//
+//     BENCHMARK("checksum/partial/1460") {
+//         std::vector<uint8_t> buf(1460);
+//         for (auto _ : state) {
+//             bench::doNotOptimize(tcp::checksum::partial(buf));
+//         }
+//     }
+//
+// Besides time, every operator new call made inside the loop is counted.
+namespace bench {
+
+// Operator new calls made so far, on any thread.
+[[nodiscard]] uint64_t allocations() noexcept;
+
+// Keeps the compiler from optimizing away the computation of `value`.
+template <typename T>
+inline void doNotOptimize(const T& value) noexcept {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Makes the compiler assume any memory may have been read or written.
+inline void clobberMemory() noexcept {
+    asm volatile("" : : : "memory");
+}
+
+class State {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit State(size_t iterations) noexcept : iterations(iterations) {
+    }
+
+    // `for (auto _ : state)` leaves it unused.
+    struct [[maybe_unused]] Iteration {};
+
+    // Starting the loop starts the clock, ending it stops the clock.
+    class Iterator {
+      public:
+        Iterator(State* state, size_t left) noexcept
+            : state(state), left(left) {
+        }
+
+        bool operator!=(const Iterator&) noexcept {
+            if (left == 0) {
+                state->stop();
+                return false;
+            }
+            return true;
+        }
+        void operator++() noexcept {
+            left--;
+        }
+        Iteration operator*() const noexcept {
+            return {};
+        }
+
+      private:
+        State* state;
+        size_t left;
+    };
+
+    Iterator begin() noexcept {
+        start();
+        return {this, iterations};
+    }
+    Iterator end() noexcept {
+        return {this, 0};
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return iterations;
+    }
+
+    [[nodiscard]] Clock::duration elapsed() const noexcept {
+        return stopTime - startTime;
+    }
+    [[nodiscard]] uint64_t allocated() const noexcept {
+        return stopAllocs - startAllocs;
+    }
+
+  private:
+    void start() noexcept {
+        startAllocs = allocations();
+        startTime   = Clock::now();
+    }
+    void stop() noexcept {
+        stopTime   = Clock::now();
+        stopAllocs = allocations();
+    }
+
+    size_t iterations;
+    Clock::time_point startTime, stopTime;
+    uint64_t startAllocs = 0;
+    uint64_t stopAllocs  = 0;
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(State&)> fn;
+};
+
+[[nodiscard]] std::vector<Benchmark>& registry();
+
+struct Registrar {
+    Registrar(const char* name, void (*fn)(State&)) {
+        registry().push_back({name, fn});
+    }
+};
+
+} // namespace bench
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b)  BENCH_CONCAT_(a, b)
+
+// Defines a benchmark body, with the State available as `state`.
+#define BENCHMARK(name)                                                        \
+    static void BENCH_CONCAT(benchFn, __LINE__)(::bench::State & state);       \
+    static ::bench::Registrar BENCH_CONCAT(benchReg, __LINE__)(                \
+        name, &BENCH_CONCAT(benchFn, __LINE__));                               \
+    static void BENCH_CONCAT(benchFn, __LINE__)(::bench::State & state)
@@ -0,0 +1,377 @@
+#include "bench.hpp"
+#include "batch.hpp"
+#include "checksum.hpp"
+#include "connection.hpp"
+#include "endpoint.hpp"
+#include "flowTable.hpp"
+#include "linkDevice.hpp"
+#include "packet.hpp"
+#include "segment.hpp"
+#include "socket.hpp"
+#include "tins/ip_address.h"
+#include "trace.hpp"
+#include <functional>
+#include <memory>
+#include <random>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+// Benchmarks of what every inbound and outbound segment goes through, each
+// piece on its own. Segments come from a peer at Peer to us at Local.
+
+using namespace tcp;
+
+namespace {
+
+const Socket Local = {Tins::IPv4Address("192.168.0.2"), 8080};
+const Socket Peer  = {Tins::IPv4Address("192.168.0.1"), 40000};
+
+constexpr size_t DataLen = 1460;
+
+// Swallows whatever is written to it.
+class NullLink : public LinkDevice {
+  public:
+    [[nodiscard]] int pollFd() const noexcept override {
+        return -1;
+    }
+    [[nodiscard]] ssize_t read(std::span<uint8_t>) noexcept override {
+        return 0;
+    }
+    bool write(std::span<const uint8_t>) noexcept override {
+        return true;
+    }
+};
+
+// A segment as the peer would send it.
+std::vector<uint8_t> peerSegment(const SegmentFields& fields,
+                                 size_t payloadLen = 0) {
+    SegmentTemplate tmpl(Peer, Local, Connection::DefaultTTL);
+    std::vector<uint8_t> payload(payloadLen, 'x');
+    std::vector<uint8_t> out(tmpl.maxOverhead() + payloadLen);
+    out.resize(tmpl.emit(out.data(), fields, {}, payload));
+    return out;
+}
+
+// RFC 1624 incremental update: HC' = ~(~HC + ~m + m'), for when a single 16
+// bit field of an already checksummed header changes from `from` to `to`.
+uint16_t updateChecksum(uint16_t csum, uint16_t from, uint16_t to) {
+    uint64_t sum = static_cast<uint16_t>(~csum);
+    sum += static_cast<uint16_t>(~from);
+    sum += to;
+    return checksum::finish(sum);
+}
+
+// Rewrites the sequence number of a segment built by peerSegment, without
+// summing its payload again.
+void patchSeq(std::span<uint8_t> segment, uint32_t seq) {
+    auto* seqField  = segment.data() + SegmentTemplate::SeqOffset;
+    auto* csumField = segment.data() + SegmentTemplate::TCPChecksumOffset;
+    auto old        = wire::load32(seqField);
+    auto csum       = updateChecksum(wire::load16(csumField), old >> 16,
+                                     static_cast<uint16_t>(seq >> 16));
+    csum = updateChecksum(csum, old & 0xffff,
+                          static_cast<uint16_t>(seq & 0xffff));
+    wire::store32(seqField, seq);
+    wire::store16(csumField, csum);
+}
+
+// A shard with one connection from the peer, established and owned by an
+// application. Shared by the benchmarks that need a connection, so the
+// handshake (and its log line) only happens once.
+struct Shard {
+    NullLink link;
+    ShardContext ctx{
+        .link    = &link,
+        .mss     = static_cast<uint16_t>(DataLen),
+        .vnetHdr = false,
+        .stack   = nullptr,
+    };
+    TxBatch tx{link};
+    TxBatch::Scope txScope{tx};
+    std::unique_ptr<Connection> conn;
+    std::shared_ptr<Endpoint> endpoint =
+        std::make_shared<Endpoint>(SocketPair{Local, Peer});
+
+    Shard() {
+        auto syn = peerSegment({
+            .seq    = 1000,
+            .ack    = 0,
+            .flags  = TCPView::SYN,
+            .window = 65535,
+        });
+        auto synPkt = *PacketView::parse(syn);
+        conn = std::make_unique<Connection>(Local, Peer, ctx, synPkt.tcp);
+        conn->endpoint = endpoint;
+        endpoint->conn = conn.get();
+        conn->onPacket(synPkt);
+
+        auto ack = peerSegment({
+            .seq    = conn->rcv.nxt,
+            .ack    = conn->snd.nxt,
+            .flags  = TCPView::ACK,
+            .window = 65535,
+        });
+        conn->onPacket(*PacketView::parse(ack));
+        tx.flush();
+    }
+
+    // An in order segment carrying `payloadLen` bytes.
+    [[nodiscard]] std::vector<uint8_t> nextSegment(size_t payloadLen) const {
+        return peerSegment(
+            {
+                .seq    = conn->rcv.nxt,
+                .ack    = conn->snd.nxt,
+                .flags  = TCPView::ACK,
+                .window = 65535,
+            },
+            payloadLen);
+    }
+};
+
+Shard& shard() {
+    static Shard s;
+    return s;
+}
+
+// Distinct flows from random peers, as a busy shard would see them.
+std::vector<SocketPair> randomFlows(size_t n, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<SocketPair> flows;
+    flows.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        flows.push_back({
+            .src = Local,
+            .dst = {Tins::IPv4Address(static_cast<uint32_t>(rng())),
+                    static_cast<uint16_t>(rng())},
+        });
+    }
+    return flows;
+}
+
+// Sums a 64KB super segment with `kernel`, where only bandwidth counts. A
+// kernel this CPU lacks times the portable one instead.
+void benchKernel(bench::State& state, checksum::Kernel kernel) {
+    std::vector<uint8_t> buf(64 * 1024, 0xab);
+    if (!checksum::supported(kernel)) {
+        kernel = checksum::Kernel::Portable;
+    }
+    for (auto _ : state) {
+        bench::doNotOptimize(checksum::partialWith(kernel, buf));
+    }
+}
+
+constexpr size_t NumFlows = 16 * 1024;
+
+} // namespace
+
+BENCHMARK("checksum/partial/40") {
+    std::vector<uint8_t> buf(SegmentTemplate::HeaderSize, 0xab);
+    for (auto _ : state) {
+        bench::doNotOptimize(checksum::finish(checksum::partial(buf)));
+    }
+}
+
+BENCHMARK("checksum/partial/1460") {
+    std::vector<uint8_t> buf(DataLen, 0xab);
+    for (auto _ : state) {
+        bench::doNotOptimize(checksum::finish(checksum::partial(buf)));
+    }
+}
+
+BENCHMARK("checksum/portable/64k") {
+    benchKernel(state, checksum::Kernel::Portable);
+}
+
+BENCHMARK("checksum/sse2/64k") {
+    benchKernel(state, checksum::Kernel::SSE2);
+}
+
+BENCHMARK("checksum/avx2/64k") {
+    benchKernel(state, checksum::Kernel::AVX2);
+}
+
+BENCHMARK("checksum/verify/data1460") {
+    auto buf = peerSegment(
+        {.seq = 1, .ack = 1, .flags = TCPView::ACK, .window = 65535}, DataLen);
+    auto pkt = *PacketView::parse(buf);
+    for (auto _ : state) {
+        bench::doNotOptimize(pkt.ipChecksumValid() && pkt.tcpChecksumValid());
+    }
+}
+
+BENCHMARK("parse/ack") {
+    auto buf = peerSegment(
+        {.seq = 1, .ack = 1, .flags = TCPView::ACK, .window = 65535});
+    for (auto _ : state) {
+        bench::doNotOptimize(PacketView::parse(buf));
+    }
+}
+
+BENCHMARK("parse/data1460") {
+    auto buf = peerSegment(
+        {.seq = 1, .ack = 1, .flags = TCPView::ACK, .window = 65535}, DataLen);
+    for (auto _ : state) {
+        bench::doNotOptimize(PacketView::parse(buf));
+    }
+}
+
+BENCHMARK("flow/hash") {
+    auto flows = randomFlows(NumFlows, 1);
+    size_t i   = 0;
+    for (auto _ : state) {
+        bench::doNotOptimize(std::hash<SocketPair>()(flows[i++ % NumFlows]));
+    }
+}
+
+BENCHMARK("flow/lookup/hit") {
+    auto flows = randomFlows(NumFlows, 1);
+    FlowTable<uint32_t> table;
+    for (size_t i = 0; i < flows.size(); i++) {
+        table.tryEmplace(FlowKey::from(flows[i]), static_cast<uint32_t>(i));
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        bench::doNotOptimize(table.find(FlowKey::from(flows[i++ % NumFlows])));
+    }
+}
+
+BENCHMARK("flow/lookup/miss") {
+    auto flows  = randomFlows(NumFlows, 1);
+    auto absent = randomFlows(NumFlows, 2);
+    FlowTable<uint32_t> table;
+    for (size_t i = 0; i < flows.size(); i++) {
+        table.tryEmplace(FlowKey::from(flows[i]), static_cast<uint32_t>(i));
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        bench::doNotOptimize(
+            table.find(FlowKey::from(absent[i++ % NumFlows])));
+    }
+}
+
+BENCHMARK("segment/emit/ack") {
+    SegmentTemplate tmpl(Local, Peer, Connection::DefaultTTL);
+    std::vector<uint8_t> out(tmpl.maxOverhead());
+    uint32_t seq = 1;
+    for (auto _ : state) {
+        tmpl.emit(out.data(),
+                  {
+                      .seq    = seq++,
+                      .ack    = 1,
+                      .flags  = TCPView::ACK,
+                      .window = 65535,
+                  },
+                  {},
+                  {});
+        bench::clobberMemory();
+    }
+}
+
+BENCHMARK("segment/emit/data1460") {
+    SegmentTemplate tmpl(Local, Peer, Connection::DefaultTTL);
+    std::vector<uint8_t> payload(DataLen, 'x');
+    std::vector<uint8_t> out(tmpl.maxOverhead() + DataLen);
+    uint32_t seq = 1;
+    for (auto _ : state) {
+        tmpl.emit(out.data(),
+                  {
+                      .seq    = seq,
+                      .ack    = 1,
+                      .flags  = TCPView::ACK,
+                      .window = 65535,
+                  },
+                  {},
+                  payload);
+        seq += DataLen;
+        bench::clobberMemory();
+    }
+}
+
+// A pure ACK through the connection, options and TxBatch included.
+BENCHMARK("segment/sendSegment/ack") {
+    auto& s = shard();
+    for (auto _ : state) {
+        s.conn->sendSegment(TCPView::ACK, s.conn->snd.nxt);
+        s.tx.flush();
+    }
+}
+
+BENCHMARK("conn/isPacketValid") {
+    auto& s  = shard();
+    auto buf = s.nextSegment(DataLen);
+    auto pkt = *PacketView::parse(buf);
+    for (auto _ : state) {
+        bench::doNotOptimize(s.conn->isPacketValid(pkt));
+    }
+}
+
+// A SYN to a listening port: a new connection, the Listen -> SynRcvd
+// transition and the SYN-ACK.
+BENCHMARK("state/listen/syn") {
+    auto& s  = shard();
+    auto buf = peerSegment({
+        .seq    = 1000,
+        .ack    = 0,
+        .flags  = TCPView::SYN,
+        .window = 65535,
+    });
+    auto pkt = *PacketView::parse(buf);
+    for (auto _ : state) {
+        Connection conn(Local, Peer, s.ctx, pkt.tcp);
+        conn.onPacket(pkt);
+        s.tx.flush();
+    }
+}
+
+// A duplicate of the last ACK, through Established.
+BENCHMARK("state/established/ack") {
+    auto& s  = shard();
+    auto buf = s.nextSegment(0);
+    auto pkt = *PacketView::parse(buf);
+    for (auto _ : state) {
+        s.conn->onPacket(pkt);
+    }
+    s.tx.flush();
+}
+
+// In order data through Established, read by the application right away.
+BENCHMARK("state/established/data1460") {
+    auto& s  = shard();
+    auto buf = s.nextSegment(DataLen);
+    auto pkt = *PacketView::parse(buf);
+    std::vector<uint8_t> out(DataLen);
+    for (auto _ : state) {
+        patchSeq(buf, s.conn->rcv.nxt);
+        s.conn->onPacket(pkt);
+        while (s.endpoint->read(out) > 0) {
+        }
+        s.conn->onRecvSpace();
+        if (s.tx.size() >= 64) {
+            s.tx.flush();
+        }
+    }
+    s.tx.flush();
+}
+
+// One trace event of a connection, with tracing off and on.
+BENCHMARK("trace/event/off") {
+    auto& s = shard();
+    trace::disable();
+    for (auto _ : state) {
+        s.conn->traceEvent(
+            trace::Kind::SegmentIn, s.conn->rcv.nxt, 0, 0, TCPView::ACK);
+    }
+}
+
+BENCHMARK("trace/event/on") {
+    auto& s = shard();
+    trace::enable();
+    for (auto _ : state) {
+        s.conn->traceEvent(
+            trace::Kind::SegmentIn, s.conn->rcv.nxt, 0, 0, TCPView::ACK);
+    }
+    trace::disable();
+}
@@ -0,0 +1,234 @@
+#include "bench.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fmt/core.h>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Every allocation goes through here, so benchmarks can report allocations
+// per operation. Only counting, the allocator itself is malloc's.
+static std::atomic<uint64_t> allocCount = 0;
+
+void* operator new(size_t size) {
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (auto* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+// GCC can't tell the replaced operator new returns malloc'd memory.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+[[nodiscard]] uint64_t bench::allocations() noexcept {
+    return allocCount.load(std::memory_order_relaxed);
+}
+
+[[nodiscard]] std::vector<bench::Benchmark>& bench::registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+#if defined(__SANITIZE_ADDRESS__) || defined(_GLIBCXX_DEBUG)
+constexpr bool Instrumented = true;
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+constexpr bool Instrumented = true;
+#else
+constexpr bool Instrumented = false;
+#endif
+#else
+constexpr bool Instrumented = false;
+#endif
+
+namespace {
+
+struct Result {
+    double nsPerOp;
+    double allocsPerOp;
+    size_t iterations;
+};
+
+struct Options {
+    std::string filter;
+    std::chrono::milliseconds minTime{200};
+    int repetitions = 5;
+    std::string baseline;
+    double tolerance = 0.10;
+};
+
+// Runs `b` for long enough to take about minTime, `repetitions` times, and
+// keeps the fastest run: noise only ever makes a run slower.
+Result measure(const bench::Benchmark& b, const Options& opts) {
+    using namespace std::chrono;
+
+    size_t iters = 1;
+    while (true) {
+        bench::State state(iters);
+        b.fn(state);
+        auto elapsed = state.elapsed();
+        if (elapsed >= opts.minTime / 10 || iters >= (size_t{1} << 40)) {
+            auto perOp = duration<double>(elapsed).count() / iters;
+            auto want  = duration<double>(opts.minTime).count() /
+                        std::max(perOp, 1e-12);
+            iters = std::max<size_t>(1, static_cast<size_t>(want));
+            break;
+        }
+        iters *= 10;
+    }
+
+    Result best{.nsPerOp = 1e300, .allocsPerOp = 0, .iterations = iters};
+    for (int i = 0; i < opts.repetitions; i++) {
+        bench::State state(iters);
+        b.fn(state);
+        auto ns = duration<double, std::nano>(state.elapsed()).count();
+        if (ns / iters < best.nsPerOp) {
+            best.nsPerOp     = ns / iters;
+            best.allocsPerOp = static_cast<double>(state.allocated()) / iters;
+        }
+    }
+    return best;
+}
+
+// Reads results in the format main prints them.
+std::unordered_map<std::string, Result> readBaseline(const std::string& path) {
+    std::unordered_map<std::string, Result> results;
+    std::ifstream in(path);
+    if (!in) {
+        fmt::println(stderr, "Couldn't open baseline {}", path);
+        exit(2);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        Result r{};
+        if (fields >> name >> r.nsPerOp >> r.allocsPerOp >> r.iterations) {
+            results[name] = r;
+        }
+    }
+    return results;
+}
+
+void usage(const char* argv0) {
+    fmt::println(stderr,
+                 "Usage: {} [--filter <substring>] [--min-time <ms>] "
+                 "[--repetitions <n>] [--baseline <file> "
+                 "[--tolerance <percent>]]",
+                 argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--filter") {
+            opts.filter = value;
+        } else if (arg == "--min-time") {
+            opts.minTime = std::chrono::milliseconds(std::atoi(value.c_str()));
+        } else if (arg == "--repetitions") {
+            opts.repetitions = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--baseline") {
+            opts.baseline = value;
+        } else if (arg == "--tolerance") {
+            opts.tolerance = std::atof(value.c_str()) / 100;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (Instrumented) {
+        fmt::println(stderr,
+                     "Warning: built with sanitizers or the debug standard "
+                     "library, configure with -DNETSTACK_SANITIZE=OFF for "
+                     "meaningful numbers.");
+    }
+
+    std::unordered_map<std::string, Result> baseline;
+    if (!opts.baseline.empty()) {
+        baseline = readBaseline(opts.baseline);
+    }
+
+    // The output doubles as a baseline for later runs.
+    fmt::println("# {:<30} {:>10} {:>10} {:>12}",
+                 "benchmark",
+                 "ns/op",
+                 "allocs/op",
+                 "iterations");
+    int regressions = 0;
+    for (const auto& b : bench::registry()) {
+        if (b.name.find(opts.filter) == std::string::npos) {
+            continue;
+        }
+        auto r = measure(b, opts);
+        fmt::println("{:<32} {:>10.2f} {:>10.2f} {:>12}",
+                     b.name,
+                     r.nsPerOp,
+                     r.allocsPerOp,
+                     r.iterations);
+        std::fflush(stdout);
+
+        auto it = baseline.find(b.name);
+        if (it == baseline.end()) {
+            continue;
+        }
+        const auto& base = it->second;
+        if (r.nsPerOp > base.nsPerOp * (1 + opts.tolerance)) {
+            fmt::println(stderr,
+                         "Regression: {} takes {:.2f} ns/op, was {:.2f}",
+                         b.name,
+                         r.nsPerOp,
+                         base.nsPerOp);
+            regressions++;
+        }
+        // Allocation counts are exact, any growth is a regression.
+        if (r.allocsPerOp > base.allocsPerOp + 0.005) {
+            fmt::println(stderr,
+                         "Regression: {} makes {:.2f} allocs/op, was {:.2f}",
+                         b.name,
+                         r.allocsPerOp,
+                         base.allocsPerOp);
+            regressions++;
+        }
+    }
+    return regressions == 0 ? 0 : 1;
+}
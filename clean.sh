@@ -1,6 +1,7 @@
 #!/bin/sh
 
 rm -rf build
+rm -rf build-bench
 cd dependencies/libtuntap
 rm -rf build
 cd ..
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "linkDevice.hpp"
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tcp {
+
+class CaptureTap;
+struct ShardStats;
+
+// RxBatch is a fixed set of packet sized slots that a whole burst of inbound
+// packets is read into before any of them is processed. Slots are allocated
+// once and reused for every burst.
+class RxBatch {
+  public:
+    RxBatch(size_t numSlots, size_t slotSize)
+        : buf(numSlots * slotSize), lens(numSlots), slotSize(slotSize) {
+    }
+
+    // Reads packets from `link` until it has nothing more to give or every
+    // slot is used. Returns the number of packets read.
+    size_t fill(LinkDevice& link) noexcept;
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    [[nodiscard]] bool full() const noexcept {
+        return count == lens.size();
+    }
+
+    [[nodiscard]] std::span<const uint8_t> packet(size_t i) const noexcept {
+        return {buf.data() + i * slotSize, lens[i]};
+    }
+
+  private:
+    std::vector<uint8_t> buf;
+    std::vector<size_t> lens;
+    size_t slotSize;
+    size_t count = 0;
+};
+
+// TxBatch collects outgoing frames produced while a burst is processed, so
+// they all go out together once the burst is done. Frames live back to back
+// in an arena that only grows, so a warmed up batch doesn't allocate.
+//
+// A batch is owned by the thread running the receive loop, which installs it
+// with TxBatch::Scope. Code running anywhere else sees no current batch and
+// writes directly.
+class TxBatch {
+  public:
+    // Frames flushed are counted in `stats`, if given.
+    explicit TxBatch(LinkDevice& link, ShardStats* stats = nullptr);
+
+    // Returns space for a frame of at most `maxLen` bytes. The frame becomes
+    // part of the batch once commit is called with its real length.
+    [[nodiscard]] uint8_t* reserve(size_t maxLen);
+    // Returns the index of the committed frame.
+    size_t commit(size_t len) noexcept;
+
+    // In place access to an already committed frame, used to replace a
+    // queued pure ACK with a newer one instead of queuing both.
+    [[nodiscard]] std::span<uint8_t> frame(size_t i) noexcept {
+        return {arena.data() + frames[i].offset, frames[i].len};
+    }
+
+    // Writes every queued frame to the link. Returns the number of frames
+    // that failed to be written.
+    size_t flush() noexcept;
+
+    // Has flush copy every frame to `tap` too, or stop doing so if null.
+    void setTap(CaptureTap* t) noexcept {
+        tap = t;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return frames.size();
+    }
+
+    // Incremented on every flush, so a frame index can be tagged with the
+    // batch it belongs to.
+    [[nodiscard]] uint64_t generation() const noexcept {
+        return gen;
+    }
+
+    [[nodiscard]] static TxBatch* current() noexcept {
+        return active;
+    }
+
+    // Scope makes `batch` the current batch for this thread until it goes out
+    // of scope.
+    class Scope {
+      public:
+        explicit Scope(TxBatch& batch) noexcept : prev(active) {
+            active = &batch;
+        }
+        ~Scope() {
+            active = prev;
+        }
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        TxBatch* prev;
+    };
+
+  private:
+    struct Frame {
+        size_t offset;
+        size_t len;
+    };
+
+    // Frames over this count force an early flush, keeping the arena bounded
+    // under a long burst.
+    constexpr static size_t MaxFrames = 256;
+    constexpr static size_t ArenaHint = 64 * 1024;
+
+    LinkDevice& link;
+    ShardStats* stats;
+    CaptureTap* tap = nullptr;
+    std::vector<uint8_t> arena;
+    std::vector<Frame> frames;
+    size_t used  = 0;
+    uint64_t gen = 0;
+
+    static thread_local TxBatch* active;
+};
+
+} // namespace tcp
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "framePipe.hpp"
+#include "socket.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tcp {
+
+// Limits a capture to some flows. A frame matches if it belongs to `flow`,
+// in either direction, or has `port` as its source or destination port.
+struct CaptureFilter {
+    std::optional<SocketPair> flow;
+    std::optional<uint16_t> port;
+
+    [[nodiscard]] bool matches(const FlowKey& key) const noexcept;
+};
+
+struct CaptureConfig {
+    enum class Format : uint8_t {
+        Pcap,
+        // Also records whether a frame was inbound or outbound.
+        PcapNg,
+    };
+
+    std::string path;
+    Format format = Format::PcapNg;
+    // Bytes kept of each frame, from its IP header: whole packets of a 1500
+    // byte MTU by default, 120 keeps any IPv4 and TCP header with options.
+    // Every ring slot takes this much memory.
+    uint32_t snaplen = 2048;
+    // Frames matching any filter are captured, all of them if there are
+    // none.
+    std::vector<CaptureFilter> filters{};
+    // Frames each shard's ring holds until the writer gets to them.
+    size_t ringSlots = 4096;
+};
+
+struct CaptureStats {
+    uint64_t captured = 0; // Frames queued for the writer.
+    uint64_t dropped  = 0; // Frames lost to a full ring.
+    uint64_t written  = 0; // Frames in the file.
+};
+
+// CaptureTap is one shard's end of a Capture. The shard copies the frames it
+// reads and writes into the tap's ring, and that's all the capture costs it:
+// no locks and no syscalls.
+class CaptureTap {
+  public:
+    enum Direction : uint8_t {
+        In,
+        Out,
+    };
+
+    // `prefix` bytes in front of every frame (a virtio-net header) are
+    // skipped.
+    CaptureTap(const CaptureConfig& config, size_t prefix);
+
+    // Called by the owning shard only.
+    void onFrame(Direction dir, std::span<const uint8_t> frame) noexcept;
+
+  private:
+    friend class Capture;
+
+    // In front of every frame in the ring.
+    struct Record {
+        int64_t timeNs; // Since the epoch.
+        uint32_t origLen;
+        Direction dir;
+    };
+
+    FramePipe ring;
+    std::vector<CaptureFilter> filters;
+    uint32_t snaplen;
+    size_t prefix;
+
+    std::atomic<uint64_t> captured = 0;
+    std::atomic<uint64_t> dropped  = 0;
+};
+
+// Capture writes what a stack reads and writes to a pcap or pcapng file. The
+// shards only queue frames on their taps, a background thread drains them to
+// the file. Frames are raw IPv4 packets, the virtio-net header is left out.
+class Capture {
+  public:
+    // Opens config.path and starts the writer, with one tap per shard.
+    // Throws std::runtime_error if the file can't be created.
+    Capture(const CaptureConfig& config, size_t numShards, size_t prefix);
+    // Writes out what's left in the rings and closes the file.
+    ~Capture();
+
+    Capture(const Capture&)            = delete;
+    Capture& operator=(const Capture&) = delete;
+
+    [[nodiscard]] CaptureTap& tap(size_t shardId) noexcept {
+        return *taps[shardId];
+    }
+
+    [[nodiscard]] CaptureStats stats() const noexcept;
+
+  private:
+    // How long the writer sleeps when every ring is empty.
+    constexpr static auto PollInterval = std::chrono::milliseconds(10);
+
+    void writeHeader();
+    void writeRecord(const CaptureTap::Record& rec,
+                     std::span<const uint8_t> data);
+    // Moves everything queued so far to the file. Returns the frame count.
+    size_t drain();
+    void run();
+
+    CaptureConfig::Format format;
+    uint32_t snaplen;
+    FILE* file;
+    std::vector<std::unique_ptr<CaptureTap>> taps;
+    // Writer thread only: a frame popped from a ring, and the bytes of the
+    // record it becomes in the file.
+    std::vector<uint8_t> slot;
+    std::vector<uint8_t> out;
+    std::atomic<uint64_t> written = 0;
+    std::atomic<bool> stopping    = false;
+    std::thread writer;
+};
+
+} // namespace tcp
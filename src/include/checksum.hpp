@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
+// Internet checksum (RFC 1071) helpers. Sums are kept unfolded in 64 bits so
+// partial sums of different pieces of a packet can simply be added together.
+namespace tcp::checksum {
+
+// Implementations of the sum over a buffer. Vector ones are used when the CPU
+// has them, picked on the first sum.
+enum class Kernel : uint8_t {
+    Portable, // 8 bytes per step in plain C++.
+    SSE2,     // 16 bytes per step.
+    AVX2,     // 32 bytes per step.
+};
+
+[[nodiscard]] const char* kernelName(Kernel kernel) noexcept;
+
+// Whether `kernel` can run on this CPU.
+[[nodiscard]] bool supported(Kernel kernel) noexcept;
+
+// The kernel partial uses: the widest supported one.
+[[nodiscard]] Kernel selected() noexcept;
+
+// Sum of `data` with a given, supported, kernel. Folds to the same checksum
+// as partial, for comparing kernels.
+[[nodiscard]] uint64_t
+partialWith(Kernel kernel, std::span<const uint8_t> data, uint64_t sum = 0)
+    noexcept;
+
+namespace detail {
+
+using SumFn = uint64_t (*)(const uint8_t* data, size_t size) noexcept;
+
+// Starts out as a function that picks the kernel and stores it here.
+extern std::atomic<SumFn> sumFn;
+
+} // namespace detail
+
+// Buffers up to this size, headers and options, are summed inline: the
+// vector kernels only pay off on payloads.
+constexpr size_t InlineMax = 64;
+
+// Adds `data` to the running sum as big endian 16 bit words. An odd trailing
+// byte is padded with zero, so only the last piece of a packet may have an
+// odd length.
+[[nodiscard]] inline uint64_t partial(std::span<const uint8_t> data,
+                                      uint64_t sum = 0) noexcept {
+    if (data.size() > InlineMax) {
+        auto fn = detail::sumFn.load(std::memory_order_relaxed);
+        return sum + fn(data.data(), data.size());
+    }
+    size_t i = 0;
+    for (; i + 1 < data.size(); i += 2) {
+        sum += static_cast<uint64_t>((data[i] << 8) | data[i + 1]);
+    }
+    if (i < data.size()) {
+        sum += static_cast<uint64_t>(data[i] << 8);
+    }
+    return sum;
+}
+
+[[nodiscard]] inline uint64_t add32(uint64_t sum, uint32_t value) noexcept {
+    return sum + (value >> 16) + (value & 0xffff);
+}
+
+// Folds a running sum into 16 bits, without complementing it.
+[[nodiscard]] inline uint16_t fold(uint64_t sum) noexcept {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(sum);
+}
+
+// Final checksum value to be stored (big endian) in a header.
+[[nodiscard]] inline uint16_t finish(uint64_t sum) noexcept {
+    return static_cast<uint16_t>(~fold(sum));
+}
+
+// Whether a sum over a whole header or segment, its checksum field included,
+// checks out.
+[[nodiscard]] inline bool valid(uint64_t sum) noexcept {
+    return fold(sum) == 0xffff;
+}
+
+} // namespace tcp::checksum
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+
+namespace tcp {
+
+// CongestionControl decides how much data a connection may have in flight
+// (cwnd). The connection detects loss and drives the hooks: onAck for new
+// data acked outside of recovery, onEnterRecovery after three duplicate ACKs
+// (fast retransmit), onDupAck and onPartialAck while recovering, and onRTO
+// when the retransmission timer fires. All sizes are in bytes.
+//
+// Recovery follows RFC 5681 (and RFC 6582 for partial ACKs). Algorithms only
+// differ in how they grow the window and how far they back off.
+class CongestionControl {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Algorithm : uint8_t {
+        Reno,
+        NewReno,
+        Cubic,
+    };
+
+    explicit CongestionControl(uint32_t mss) noexcept;
+    virtual ~CongestionControl() = default;
+
+    [[nodiscard]] uint32_t cwnd() const noexcept {
+        return congWnd;
+    }
+
+    [[nodiscard]] uint32_t ssthresh() const noexcept {
+        return slowStartThresh;
+    }
+
+    // The MSS is only known once the handshake is done, this resets the
+    // window to the initial window for it.
+    void setMSS(uint32_t mss) noexcept;
+
+    // `acked` bytes of new data were acknowledged outside of recovery.
+    virtual void onAck(uint32_t acked, Clock::time_point now) noexcept;
+
+    // Third duplicate ACK, with `inFlight` bytes outstanding.
+    virtual void onEnterRecovery(uint32_t inFlight) noexcept;
+
+    // Another duplicate ACK during recovery, a segment left the network.
+    void onDupAck() noexcept;
+
+    // An ACK during recovery that acks `acked` new bytes but not everything
+    // that was outstanding when recovery started (RFC 6582).
+    void onPartialAck(uint32_t acked) noexcept;
+
+    void onExitRecovery() noexcept;
+
+    // Retransmission timeout, with `inFlight` bytes outstanding.
+    virtual void onRTO(uint32_t inFlight) noexcept;
+
+    // Whether a partial ACK keeps the connection in recovery and retransmits
+    // the next hole (NewReno), or ends recovery (Reno).
+    [[nodiscard]] virtual bool partialAckRecovery() const noexcept {
+        return true;
+    }
+
+    [[nodiscard]] virtual const char* name() const noexcept = 0;
+
+  protected:
+    // RFC 5681 3.1 initial window.
+    [[nodiscard]] uint32_t initialWindow() const noexcept;
+
+    [[nodiscard]] bool inSlowStart() const noexcept {
+        return congWnd < slowStartThresh;
+    }
+
+    uint32_t smss;
+    uint32_t congWnd;
+    uint32_t slowStartThresh;
+    // Bytes acked since cwnd last grew in congestion avoidance.
+    uint32_t ackedInCA = 0;
+};
+
+class RenoCongestionControl : public CongestionControl {
+  public:
+    using CongestionControl::CongestionControl;
+
+    [[nodiscard]] bool partialAckRecovery() const noexcept override {
+        return false;
+    }
+
+    [[nodiscard]] const char* name() const noexcept override {
+        return "reno";
+    }
+};
+
+class NewRenoCongestionControl : public CongestionControl {
+  public:
+    using CongestionControl::CongestionControl;
+
+    [[nodiscard]] const char* name() const noexcept override {
+        return "newreno";
+    }
+};
+
+// CUBIC (RFC 9438): after a loss the window follows a cubic function of the
+// time since the loss, centered on the window the loss happened at, so it
+// climbs back quickly and then probes carefully around the old maximum.
+class CubicCongestionControl : public CongestionControl {
+  public:
+    using CongestionControl::CongestionControl;
+
+    void onAck(uint32_t acked, Clock::time_point now) noexcept override;
+    void onEnterRecovery(uint32_t inFlight) noexcept override;
+    void onRTO(uint32_t inFlight) noexcept override;
+
+    [[nodiscard]] const char* name() const noexcept override {
+        return "cubic";
+    }
+
+  private:
+    constexpr static double C    = 0.4;
+    constexpr static double Beta = 0.7;
+
+    // Remembers the window at a loss and backs off to Beta of it.
+    void onCongestion(uint32_t inFlight) noexcept;
+
+    double wMax = 0; // In segments.
+    double k    = 0; // Seconds to get back to wMax.
+    // Window of the Reno-friendly estimate, in segments.
+    double wEst = 0;
+    Clock::time_point epochStart{};
+};
+
+[[nodiscard]] std::unique_ptr<CongestionControl>
+makeCongestionControl(CongestionControl::Algorithm algorithm, uint32_t mss);
+
+} // namespace tcp
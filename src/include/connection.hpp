@@ -1,46 +1,136 @@
 #pragma once
 
+#include "capture.hpp"
+#include "congestion.hpp"
+#include "endpoint.hpp"
+#include "flowTable.hpp"
 #include "fmt/core.h"
+#include "histogram.hpp"
+#include "inbox.hpp"
+#include "iss.hpp"
+#include "linkDevice.hpp"
+#include "packet.hpp"
+#include "reassembly.hpp"
+#include "ringBuffer.hpp"
+#include "scheduler.hpp"
+#include "segment.hpp"
+#include "seqRanges.hpp"
 #include "socket.hpp"
+#include "stats.hpp"
+#include "synCookies.hpp"
 #include "tcp.hpp"
 #include "tcpStates.hpp"
-#include "threadPool.hpp"
-#include "tins/ip.h"
+#include "timeWait.hpp"
+#include "timerWheel.hpp"
 #include "tins/ip_address.h"
-#include "tins/tcp.h"
-#include "tuntap++.hh"
+#include "trace.hpp"
+#include "tsc.hpp"
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <span>
 #include <stdint.h>
 #include <string>
+#include <vector>
 using namespace std::chrono_literals;
 
 namespace tcp {
 
 struct SendSeqSpace {
-    uint32_t una; // unacknowledged.
-    uint32_t nxt; // next to send.
-    uint16_t wnd; // window.
-    bool up;      // urgent pointer.
-    size_t wl1;   // segment sequence number used for last window update.
-    size_t wl2;   // segment acknowledgment number used for last window update.
-    uint32_t iss; // initial send sequence number.
+    uint32_t una;     // unacknowledged.
+    uint32_t nxt;     // next to send.
+    uint32_t max;     // highest sent, nxt goes back to una on retransmission.
+    uint32_t wnd;     // window, as advertised by the peer (scaled).
+    bool up;          // urgent pointer.
+    uint32_t wl1;     // segment sequence number used for last window update.
+    uint32_t wl2;     // segment ack number used for last window update.
+    uint32_t iss;     // initial send sequence number.
+    uint8_t wndShift; // peer's window scale (RFC 7323).
+};
 
-    [[nodiscard]] static uint32_t genISS() noexcept {
-        return 0;
+struct RcvSeqSpace {
+    uint32_t nxt;     // next.
+    uint32_t wnd;     // window, as advertised by us.
+    bool up;          // urgent pointer.
+    uint32_t irs;     // initial receive sequence number.
+    uint8_t wndShift; // our window scale (RFC 7323).
+
+    [[nodiscard]] static uint32_t genWND() noexcept {
+        return 4 * 1024 * 1024;
     }
 
-    [[nodiscard]] static uint16_t genWND() noexcept {
-        return 10240;
+    // Smallest window scale that fits `wnd` in the 16 bit window field.
+    [[nodiscard]] static uint8_t wndShiftFor(uint32_t wnd) noexcept {
+        uint8_t shift = 0;
+        while (shift < MaxWndShift && (wnd >> shift) > 65535) {
+            shift++;
+        }
+        return shift;
     }
+
+    constexpr static uint8_t MaxWndShift = 14;
 };
 
-struct RcvSeqSpace {
-    uint32_t nxt; // next.
-    uint16_t wnd; // window.
-    bool up;      // urgent pointer.
-    uint32_t irs; // initial receive sequence number.
+class Stack;
+
+// ShardContext is what a connection uses from the shard (ConnectionManager)
+// it lives on. It's only ever touched from that shard's loop thread.
+struct ShardContext {
+    // Device the shard's segments are written to.
+    LinkDevice* link{};
+    // MSS we advertise on our SYNs, from the MTU of the device.
+    uint16_t mss{};
+    // Frames carry a virtio-net header, see TunDevice.
+    bool vnetHdr{};
+    // Stack the shard belongs to, for its listeners. Null when standalone.
+    Stack* stack{};
+    // Copies the shard's frames to a capture while one is running.
+    CaptureTap* capture = nullptr;
+    ShardStats stats{};
+    StageLatency latency{};
+    // Bounds the connections SYNs can create.
+    SynQueueConfig synQueue{};
+    size_t halfOpen = 0;
+    // Connections that reached CLOSED or TIME-WAIT, erased by the shard
+    // once the event that closed them has been handled.
+    std::vector<FlowKey> closed{};
+    TimeWaitTable timeWait{};
+    // Picks the ISNs of the shard's connections.
+    IssGenerator issGenerator{};
+    // Connections that received nothing for this long are reset, 0 keeps
+    // them forever. Orphaned ones, closed by the application but still
+    // waiting on the peer, get Connection::OrphanTimeout.
+    std::chrono::seconds idleTimeout = std::chrono::hours(2);
+    // Congestion control new connections start with.
+    CongestionControl::Algorithm congestion =
+        CongestionControl::Algorithm::NewReno;
+    TimerWheel timers{};
+    // Coroutines running on the shard.
+    Scheduler scheduler{timers};
+};
+
+// Delayed ACK settings of a connection (RFC 1122 4.2.3.2, RFC 5681 4.2).
+struct DelayedAckConfig {
+    bool enabled = true;
+    // Longest an ACK is held back, RFC 1122 allows up to 500ms.
+    std::chrono::milliseconds timeout = 40ms;
+    // An ACK goes out right away once this many full sized segments worth
+    // of data is unacked.
+    uint32_t maxSegments = 2;
+};
+
+// Per connection counters.
+struct ConnectionStats {
+    uint64_t dataSegsIn      = 0; // Segments with payload received.
+    uint64_t pureAcksOut     = 0; // ACKs sent without data.
+    uint64_t acksDelayed     = 0; // Data segments whose ACK was held back.
+    uint64_t acksPiggybacked = 0; // Held back ACKs that went out on data.
+    uint64_t fastRetransmits = 0; // Recoveries started by duplicate ACKs.
+    uint64_t timeouts        = 0; // Retransmission timeouts.
 };
 
 // Connection represents state of a tcp connection.
@@ -55,130 +145,555 @@ class Connection {
     constexpr static auto TCPRetransmissionTime = 1s;
     Connection()                                = default;
 
-    Connection(Socket src, Socket dst, tuntap::tun& tun)
-        : state(std::make_unique<InitState>()), tun(&tun), src(src), dst(dst) {
-        auto iss = SendSeqSpace::genISS();
-        auto wnd = SendSeqSpace::genWND();
-
+    Connection(Socket src, Socket dst, ShardContext& shard)
+        : shard(&shard), src(src), dst(dst),
+          txTemplate(src, dst, DefaultTTL, shard.vnetHdr),
+          rtxTimer([this] {
+              onRetransmitTimeout();
+          }),
+          ackTimer([this] {
+              ackNow();
+          }) {
+        auto iss = shard.issGenerator.make(FlowKey::from({src, dst}),
+                                           IssGenerator::Clock::now());
+
+        // The peer's window is unknown until its SYN arrives.
         snd = {
-            .una = iss,
-            .nxt = iss,
-            .wnd = wnd,
-            .up  = false,
-            .wl1 = 0,
-            .wl2 = 0,
-            .iss = iss,
+            .una      = iss,
+            .nxt      = iss,
+            .max      = iss,
+            .wnd      = 0,
+            .up       = false,
+            .wl1      = 0,
+            .wl2      = 0,
+            .iss      = iss,
+            .wndShift = 0,
         };
+        // Offered on our SYN, dropped if the peer doesn't do scaling.
+        rcv = {
+            .nxt      = 0,
+            .wnd      = RcvSeqSpace::genWND(),
+            .up       = false,
+            .irs      = 0,
+            .wndShift = RcvSeqSpace::wndShiftFor(RcvSeqSpace::genWND()),
+        };
+        cc      = makeCongestionControl(shard.congestion, sndMSS);
+        recover = iss;
     }
 
     Connection(Socket src,
                Socket dst,
-               tuntap::tun& tun,
-               const Tins::TCP& tcp) noexcept
-        : Connection(src, dst, tun) {
+               ShardContext& shard,
+               const TCPView& tcp) noexcept
+        : Connection(src, dst, shard) {
         auto irs = tcp.seq();
 
-        rcv = {
-            .nxt = irs + 1,
-            .wnd = tcp.window(),
-            .up  = false,
-            .irs = irs,
-        };
+        rcv.nxt = irs + 1;
+        rcv.irs = irs;
+
+        snd.wnd = peerWindow(tcp);
+        snd.wl1 = irs;
+        onSynOptions(tcp);
     }
 
     void open() noexcept {
-        switchState(state->onOpen(*this));
+        moveTo(visitState(state, [&](auto s) { return s.onOpen(*this); }));
     }
 
-    void onPacket(const Tins::IP& ip, const Tins::TCP& tcp) noexcept {
-        switchState(state->onPacket(*this, ip, tcp));
+    void onPacket(const PacketView& pkt) noexcept {
+        idleSweeps = 0;
+        traceEvent(trace::Kind::SegmentIn,
+                   pkt.tcp.seq(),
+                   pkt.tcp.ack_seq(),
+                   pkt.payload.size(),
+                   pkt.tcp.flags());
+        auto prev = state;
+        moveTo(visitState(state,
+                          [&](auto s) { return s.onPacket(*this, pkt); }));
+        if (prev == State::Value::SynRcvd &&
+            state == State::Value::Established) {
+            moveTo(EstablishedState::onHandshakeAck(*this, pkt));
+        }
     }
 
-    void send(const std::string& data, ThreadPool& threadPool) noexcept {
-        switchState(state->onSend(*this, data, threadPool));
+    void send(const std::string& data) noexcept {
+        moveTo(visitState(state,
+                          [&](auto s) { return s.onSend(*this, data); }));
     }
 
-    [[nodiscard]] bool isPacketValid(const Tins::TCP& tcp) const noexcept;
+    [[nodiscard]] bool isPacketValid(const PacketView& pkt) const noexcept;
 
-  private:
-    std::unique_ptr<State> state;
+    // The application is done sending: a FIN follows what it queued, and
+    // the connection goes through the closing states.
+    void close() noexcept {
+        moveTo(visitState(state, [&](auto s) { return s.onClose(*this); }));
+    }
 
-  public:
-    // TODO: What should be appropriate container, considering I need default
-    // constructor.
-    tuntap::tun* tun;
-    Socket src, dst;
+    // Resets the connection (RFC 793 ABORT): sends a RST if the connection
+    // is synchronized, fails the application's socket and enters CLOSED.
+    void abort() noexcept;
 
-    SendSeqSpace snd;
-    RcvSeqSpace rcv;
-    std::mutex connDataMutex;
+    // Done with, in CLOSED or TIME-WAIT: the shard can erase it.
+    [[nodiscard]] bool finished() const noexcept {
+        return state == State::Value::Closed ||
+               state == State::Value::TimeWait;
+    }
 
-    constexpr static uint8_t DefaultTTL = 64;
+    // Counts a sweep of the shard's reaper that found the connection idle.
+    // Returns true once it has been idle for long enough to be reset.
+    [[nodiscard]] bool onIdleSweep(std::chrono::seconds interval) noexcept;
+
+    // Sets up a passive open from the final ACK of a handshake whose SYN-ACK
+    // carried a SYN cookie: our ISN was `iss` and the peer's MSS `mss`, and
+    // neither side scales its window or does SACK. Enters ESTABLISHED.
+    void onCookieAck(const TCPView& ack, uint32_t iss, uint16_t mss) noexcept;
+
+    // Moves our ISN past `sndNxt`, where the connection of the same flow
+    // that was in TIME-WAIT stopped, so the new one's sequence space starts
+    // above anything the old one sent (RFC 1122 4.2.2.13). Only before our
+    // SYN or SYN-ACK went out.
+    void startAfter(uint32_t sndNxt) noexcept;
+
+    [[nodiscard]] ConnectionInfo info() const noexcept;
+
+    // Records a trace event of this connection, if tracing is on.
+    void traceEvent(trace::Kind kind,
+                    uint32_t seq  = 0,
+                    uint32_t ack  = 0,
+                    size_t len    = 0,
+                    uint8_t flags = 0) const noexcept {
+        if (trace::enabled()) [[unlikely]] {
+            trace::record({
+                .time  = tsc::now(),
+                .flow  = FlowKey::from({src, dst}),
+                .seq   = seq,
+                .ack   = ack,
+                .len   = static_cast<uint16_t>(len),
+                .flags = flags,
+                .kind  = kind,
+            });
+        }
+    }
 
-  private:
-    void switchState(State::Value newState) noexcept {
-        if (newState == state->currentState()) {
-            return;
+    // Emits a control segment (no payload) built from the connection's
+    // header template. The ack number is rcv.nxt when ACK is set, the
+    // window is rcv.wnd, SYNs carry our MSS, window scale and SACK-Permitted
+    // options, and ACKs carry SACK blocks for out of order data. On the
+    // receive thread the segment is queued on the current TxBatch,
+    // elsewhere it is written right away. Returns false if the tun write
+    // failed.
+    bool sendSegment(uint8_t flags, uint32_t seq) noexcept;
+
+    // Appends application data to the send buffer and sends what the peer's
+    // window allows. Whatever doesn't fit in the buffer waits in
+    // pendingWrites until ACKs make room for it.
+    void write(std::span<const uint8_t> data);
+
+    // Sends unsent buffered data in MSS sized segments, for as long as it
+    // fits in [snd.una, snd.una + snd.wnd).
+    void transmitPending() noexcept;
+
+    // Processes the ACK of an acceptable segment: trims acknowledged bytes
+    // from the send buffer, feeds congestion control, counts duplicate ACKs
+    // towards fast retransmit, updates the send window (RFC 793) and sends
+    // whatever the new window allows.
+    void onAck(const PacketView& pkt) noexcept;
+
+    // Takes the options of the peer's SYN: its MSS, window scale and
+    // SACK-Permitted. Scaling and SACK are only used when both SYNs carry
+    // them.
+    void onSynOptions(const TCPView& tcp) noexcept;
+
+    // The peer's window from a segment, scaled unless it is a SYN.
+    [[nodiscard]] uint32_t peerWindow(const TCPView& tcp) const noexcept {
+        if (tcp.get_flag(TCPView::SYN)) {
+            return tcp.window();
         }
+        return static_cast<uint32_t>(tcp.window()) << snd.wndShift;
+    }
+
+    // Switches this connection to another congestion control algorithm,
+    // starting over from the initial window.
+    void setCongestionControl(CongestionControl::Algorithm algorithm);
+
+    // Takes the payload of an acceptable segment. In order data is handed
+    // to the application right away, together with whatever it makes
+    // contiguous in the reassembly queue. Data ahead of rcv.nxt waits in the
+    // queue. Advances rcv.nxt over everything delivered.
+    void onData(uint32_t seq, std::span<const uint8_t> data);
+
+    // Acks rcv.nxt right away, including anything being held back.
+    bool ackNow() noexcept;
+
+    // Acks `len` bytes of in order data, possibly later: the ACK is held
+    // back until enough data arrives, the delay runs out, or it can ride on
+    // outgoing data.
+    void ackLater(size_t len) noexcept;
+
+    // Called once the application read from the receive buffer, or let go
+    // of the connection: opens the receive window again, announcing it with
+    // an ACK once it grew by at least an MSS or half the buffer (RFC 1122
+    // 4.2.3.3).
+    void onRecvSpace() noexcept;
+
+    // Sends a FIN once everything written so far was sent.
+    void queueFin() noexcept {
+        finQueued = true;
+        transmitPending();
+    }
 
-        switch (newState) {
-        case State::Value::Closed:
-            state.reset(new ClosedState());
-            break;
-        case State::Value::Listen:
-            state.reset(new ListenState());
-            break;
-        case State::Value::SynSent:
-            state.reset(new SynSentState());
-            break;
-        case State::Value::SynRcvd:
-            state.reset(new SynRcvdState());
-            break;
-        case State::Value::Established:
-            state.reset(new EstablishedState());
-            break;
-        default:
-            state.reset(new ClosedState());
-            break;
+    // Our FIN was sent and everything up to it is acked.
+    [[nodiscard]] bool finAcked() const noexcept {
+        return finSent && snd.una == snd.max;
+    }
+
+    // Takes the peer's FIN, once everything before it arrived: acks it and
+    // tells the application nothing more is coming.
+    void onFin() noexcept;
+
+    // A RST from the peer was accepted: fails the application's socket.
+    // The state handler then enters CLOSED.
+    void onReset() noexcept;
+
+    // Answers a segment that doesn't belong to the connection with a RST
+    // (RFC 793 3.4).
+    void replyReset(const PacketView& pkt) noexcept;
+
+  private:
+    State::Value state = InitState::value;
+
+    void moveTo(State::Value next) noexcept {
+        if (next != state) {
+            traceEvent(trace::Kind::StateChange,
+                       0,
+                       0,
+                       static_cast<size_t>(next),
+                       static_cast<uint8_t>(state));
+            auto prev = state;
+            state     = next;
+            onStateChange(prev);
         }
     }
+
+    // Hands newly established connections to the application: the one
+    // that connected, or one listening on the port.
+    void onStateChange(State::Value prev);
+
+    // Builds a segment and queues it on the current TxBatch, or writes it
+    // right away when there is none.
+    bool emit(const SegmentFields& fields,
+              std::span<const uint8_t> options     = {},
+              std::span<const uint8_t> payload     = {},
+              std::span<const uint8_t> payloadTail = {}) noexcept;
+
+    // Moves pending writes into the send buffer as far as it has room.
+    void refillSendBuffer();
+
+    void onRetransmitTimeout() noexcept;
+
+    // Sends the SYN, or the SYN-ACK, again with exponential backoff, and
+    // gives up on the handshake after MaxSynRetries, or MaxSynAckRetries.
+    void onHandshakeTimeout() noexcept;
+
+    void onDupAck() noexcept;
+
+    // Adds the SACK blocks of an ACK to the scoreboard.
+    void onSackBlocks(const TCPView& tcp) noexcept;
+
+    // Resends one segment of the first hole at or after rtxHigh, for fast
+    // retransmit and recovery. Only what lies below the highest SACKed byte
+    // is known to be missing, so without SACK blocks that is the segment at
+    // snd.una. snd.nxt stays where it is.
+    void retransmitHole() noexcept;
+
+    // Options for a control segment with these flags, written to `out`
+    // (MaxOptionsSize bytes). Returns their length.
+    size_t buildOptions(uint8_t flags, uint8_t* out) const noexcept;
+
+    // Our window as it goes in the header of a segment with these flags.
+    [[nodiscard]] uint16_t windowField(uint8_t flags) const noexcept;
+
+    // Free receive buffer space at which onRecvSpace would announce a
+    // larger window, SIZE_MAX if the window can't grow.
+    [[nodiscard]] size_t windowUpdateAt() const noexcept;
+
+    // Hands received stream bytes to the application, `tail` follows `data`.
+    void deliver(std::span<const uint8_t> data,
+                 std::span<const uint8_t> tail = {});
+
+    // Called whenever a segment carrying the current rcv.nxt goes out, so
+    // a held back ACK isn't sent on its own anymore.
+    void onAckSent() noexcept;
+
+  public:
+    ShardContext* shard = nullptr;
+    Socket src, dst;
+
+    SendSeqSpace snd;
+    RcvSeqSpace rcv;
+    SegmentTemplate txTemplate;
+
+    // Pure ACK of this connection still queued in a TxBatch, identified by
+    // the batch generation and frame index, and what it acknowledged.
+    struct {
+        uint64_t gen    = UINT64_MAX;
+        size_t frame    = 0;
+        uint32_t ack    = 0;
+        uint16_t window = 0;
+    } queuedAck;
+
+    // Stream bytes from snd.una on: [una, nxt) is in flight, the rest waits
+    // for window.
+    ByteRing sndBuf{SendBufSize};
+    std::deque<std::string> pendingWrites;
+    // Our side of the close, see queueFin. The FIN takes the sequence
+    // number after the last byte of the send buffer.
+    bool finQueued = false;
+    bool finSent   = false;
+    // Retransmissions of snd.una since it last moved.
+    int rtxCount = 0;
+    Timer rtxTimer;
+    // Largest segment we send, the peer's MSS capped by our own.
+    uint16_t sndMSS = DefaultMSS;
+
+    // Congestion control and loss recovery (RFC 5681, RFC 6582).
+    std::unique_ptr<CongestionControl> cc;
+    uint32_t dupAcks = 0;
+    bool inRecovery  = false;
+    // snd.max when recovery started, it ends once that is acked.
+    uint32_t recover = 0;
+    // Everything before it was retransmitted during this recovery.
+    uint32_t rtxHigh = 0;
+
+    // Negotiated on the SYNs.
+    bool wsOk   = false;
+    bool sackOk = false;
+    // Ranges beyond snd.una the peer has SACKed.
+    SeqRangeList sacked{MaxSackRanges};
+
+    // Data received ahead of rcv.nxt, bounded by our window.
+    ReassemblyQueue reasm{RcvSeqSpace::genWND()};
+
+    DelayedAckConfig delayedAck;
+    // In order bytes received since we last sent an ACK.
+    size_t unackedBytes = 0;
+    Timer ackTimer;
+
+    ConnectionStats stats;
+    // Sweeps of the shard's reaper since a segment last arrived.
+    uint32_t idleSweeps = 0;
+
+    // Round trip time, from one segment timed at a time and never from one
+    // that was sent again (Karn's algorithm).
+    RttEstimator rtt;
+    bool rttTiming  = false;
+    uint32_t rttSeq = 0; // Timing ends once this is acked.
+    TimerWheel::Clock::time_point rttStart;
+
+    // Application side of the connection, if an application owns it.
+    // Without one received data is printed, for the shell.
+    std::shared_ptr<Endpoint> endpoint;
+
+    constexpr static uint8_t DefaultTTL       = 64;
+    constexpr static int MaxRetransmissions   = 7;
+    // SYN-ACKs resent before a passive open is dropped, 1, 2, 4, 8 and 16
+    // seconds apart, the last one given 32 seconds.
+    constexpr static int MaxSynAckRetries     = 5;
+    // SYNs resent before an active open fails, as Linux's tcp_syn_retries.
+    constexpr static int MaxSynRetries        = 6;
+    constexpr static uint32_t DupAckThreshold = 3;
+    constexpr static size_t MaxSackRanges     = 32;
+    // 4 blocks fill 36 of the 40 bytes of option space.
+    constexpr static size_t MaxSackBlocks     = 4;
+    // MSS assumed when the peer's SYN doesn't carry one (RFC 1122).
+    constexpr static uint16_t DefaultMSS      = 536;
+    constexpr static size_t SendBufSize       = Endpoint::SndBufSize;
+    // Longest an orphaned connection waits on the peer to finish closing,
+    // as Linux's tcp_fin_timeout.
+    constexpr static auto OrphanTimeout = std::chrono::seconds(60);
+
 };
 
-// ConnectionManager manages TCP connections. For now it'll only support active
-// connections via open, and all ports are passively listening for any
-// connection.
+
+// ConnectionManager manages TCP connections seen on one link. For now
+// it'll only support active connections via open, and all ports are
+// passively listening for any connection.
+//
+// Everything that touches connections runs on the thread inside run(), calls
+// from other threads are posted to it through an Inbox.
 class ConnectionManager {
   public:
-    // ConnectionManager takes reference to tun and expects the reference to
-    // stay alive as long as ConnectionManager is in scope.
-    ConnectionManager(tuntap::tun& tun, const Tins::IPv4Address& tunIP) noexcept
-        : connections(), tun(tun), tunIP(tunIP), threadPool(ThreadPoolSize) {
+    // ConnectionManager takes the link device it reads and writes, a tun
+    // queue or otherwise, and expects it to stay alive as long as
+    // ConnectionManager is in scope. When it is one shard of a Stack,
+    // packets of flows owned by another shard are handed to that one.
+    // `mtu` is the device's, it sizes receive buffers and our MSS.
+    // `vnetHdr` says whether frames carry a virtio-net header.
+    ConnectionManager(LinkDevice& link,
+                      const Tins::IPv4Address& tunIP,
+                      Stack* stack   = nullptr,
+                      size_t shardId = 0,
+                      size_t mtu     = DefaultMTU,
+                      bool vnetHdr   = false) noexcept
+        : connections(),
+          ctx{
+              .link    = &link,
+              .mss     = static_cast<uint16_t>(mssFor(mtu)),
+              .vnetHdr = vnetHdr,
+              .stack   = stack,
+          },
+          tunIP(tunIP), stack(stack), shardId(shardId), mtu(mtu) {
     }
 
     void run() noexcept;
 
+    // Makes run() return. Can be called from any thread.
+    void stop() noexcept;
+
+    // send and open can be called from any thread.
     void send(const SocketPair& connSockets, const std::string& data) noexcept;
 
-    void open(const SocketPair& connSockets) noexcept;
+    // With an endpoint, the connection belongs to the application that
+    // owns it, which is told when the connection is established or failed.
+    void open(const SocketPair& connSockets,
+              std::shared_ptr<Endpoint> endpoint = nullptr) noexcept;
 
-    [[nodiscard]] SocketPair getLastRecv() const noexcept {
+    // Starts `task` on the shard's thread.
+    void spawn(Task task) noexcept;
+
+    // Resumes `h` on the shard's thread, for coroutines moving to it.
+    void resume(std::coroutine_handle<> h) noexcept;
+
+    // Whether the caller runs on the shard's thread.
+    [[nodiscard]] bool isCurrent() const noexcept {
+        return Scheduler::current() == &ctx.scheduler;
+    }
+
+    // Counters of the shard, readable from any thread.
+    [[nodiscard]] const ShardStats& stats() const noexcept {
+        return ctx.stats;
+    }
+
+    // Latency histograms of the shard, readable from any thread.
+    [[nodiscard]] const StageLatency& latency() const noexcept {
+        return ctx.latency;
+    }
+
+    // Tasks posted to the shard and not run yet.
+    [[nodiscard]] size_t inboxDepth() noexcept {
+        return inbox.size();
+    }
+
+    // Calls `done` on the shard's thread with the state of every connection.
+    void connectionInfo(
+        std::function<void(std::vector<ConnectionInfo>)> done) noexcept;
+
+    // Changes how SYNs of new flows are answered.
+    void setSynQueue(const SynQueueConfig& config) noexcept;
+
+    // Changes how long connections may idle, see ShardContext::idleTimeout.
+    void setIdleTimeout(std::chrono::seconds timeout) noexcept;
+
+    // Starts copying the frames the shard reads and writes to its tap of
+    // `capture`, or stops if null. The shard holds on to the capture until
+    // it stops, or another one starts.
+    void setCapture(std::shared_ptr<Capture> capture) noexcept;
+
+    // Runs fn on the connection for connSockets, on the shard's thread, if
+    // there is one.
+    void withConnection(const SocketPair& connSockets,
+                        std::function<void(Connection&)> fn) noexcept;
+
+    [[nodiscard]] SocketPair getLastRecv() noexcept {
+        std::scoped_lock lock(lastRcvdMutex);
         return lastRvcd;
     }
 
   private:
-    std::unordered_map<SocketPair, Connection> connections;
-    // Ideally should have a wrapper over this that just supports read/write
-    // and also allows utun. Not needed rn since not supporting macos right
-    // now (since I can't get ifconfig to set up tun properly).
-    std::reference_wrapper<tuntap::tun> tun;
+    // Handles one inbound frame read from the link at tsc tick `readAt`, 0
+    // if it came from another shard. Returns the tick its handler finished,
+    // 0 if the frame went to no handler of this shard.
+    uint64_t onPacket(std::span<const uint8_t> frame,
+                      uint64_t readAt = 0) noexcept;
+
+    void setLastRecv(const SocketPair& socketPair) noexcept;
+
+    // The connection a segment of a flow without one goes to. A flow in
+    // TIME-WAIT gets its FIN acked again, unless a new SYN reopens it. A SYN
+    // gets a new connection while the SYN queue has room, and a SYN cookie
+    // or nothing once it's full (always nothing when it reopens a flow, a
+    // cookie's ISN can't be moved past the old connection's). An ACK gets
+    // one if it returns a valid cookie. Anything else is answered with a
+    // RST.
+    [[nodiscard]] Connection* onNewFlow(const SocketPair& socketPair,
+                                        const PacketView& pkt) noexcept;
+
+    // Handles a segment of a flow in TIME-WAIT. Returns true if it was
+    // taken, false if it opens the flow anew.
+    bool onTimeWait(const SocketPair& socketPair,
+                    TimeWaitTable::Entry& entry,
+                    const PacketView& pkt) noexcept;
+
+    // Hands the flow of `conn`, a new connection, over from TIME-WAIT if it
+    // was there.
+    void endTimeWait(const FlowKey& key, Connection& conn) noexcept;
+
+    // Answers a SYN with a SYN-ACK carrying a SYN cookie, keeping no state.
+    void sendSynCookie(const SocketPair& socketPair,
+                       const TCPView& syn) noexcept;
+
+    // Writes a segment of a flow that has no connection.
+    void sendStateless(const SocketPair& socketPair,
+                       const SegmentFields& fields,
+                       std::span<const uint8_t> options = {}) noexcept;
+
+    // Erases the connections that closed.
+    void reap() noexcept;
+
+    // Runs every ReapInterval: resets connections idle for too long and
+    // ends the waits of flows in TIME-WAIT that are over.
+    void sweep() noexcept;
+
+    // Largest TCP payload that fits in a packet of `mtu` bytes, with no IP
+    // or TCP options.
+    [[nodiscard]] static size_t mssFor(size_t mtu) noexcept {
+        constexpr size_t headers = SegmentTemplate::HeaderSize;
+        return std::clamp<size_t>(mtu, headers + 1, 65535) - headers;
+    }
+
+    FlowTable<Connection> connections;
+    ShardContext ctx;
     Tins::IPv4Address tunIP;
+    Stack* stack;
+    size_t shardId;
+    size_t mtu;
+    Inbox inbox;
+    SynCookies cookies;
+    // Loop thread only.
+    std::shared_ptr<Capture> capture;
+    Timer sweepTimer{[this] {
+        sweep();
+    }};
+    // Set by stop(), on the loop's thread.
+    bool stopping = false;
+
+    // Written by the loop and read by the CLI, only locked when the last
+    // flow changes. lastSeen is the loop's own unlocked copy.
+    std::mutex lastRcvdMutex;
+    SocketPair lastRvcd{};
+    SocketPair lastSeen{};
+
+  public:
+    constexpr static size_t DefaultMTU = 1500;
 
-    SocketPair lastRvcd;
+    // How often idle connections and TIME-WAIT entries are looked for.
+    constexpr static auto ReapInterval = std::chrono::seconds(15);
 
   private:
-    constexpr static size_t TunBufSize     = 1055;
-    constexpr static size_t ThreadPoolSize = 10;
-    ThreadPool threadPool;
+    constexpr static size_t RxBatchSize = 64;
+    // Largest frame with a virtio-net header, GRO packets can be up to the
+    // max IPv4 total length.
+    constexpr static size_t MaxVnetFrame = SegmentTemplate::VnetHdrSize + 65535;
 };
 
 } // namespace tcp
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "endpoint.hpp"
+#include "scheduler.hpp"
+#include "socket.hpp"
+#include "socketApi.hpp"
+#include "stack.hpp"
+#include "timerWheel.hpp"
+#include "tins/ip_address.h"
+#include <coroutine>
+#include <memory>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <tl/expected.hpp>
+
+namespace tcp {
+
+// Coroutine interface to the stack, for servers written as straight line
+// code:
+//
+//     Task echo(AsyncSocket sock) {
+//         uint8_t buf[4096];
+//         while (auto n = co_await sock.recv(buf)) {
+//             co_await sock.send(std::span(buf, *n));
+//         }
+//         sock.close();
+//     }
+//
+// Coroutines run on a shard's loop thread and are resumed by its Scheduler
+// right after the event they wait on was processed, in the same loop
+// iteration. Calls on a connection go straight to it, without the inbox.
+//
+// A connection belongs to one shard, so a coroutine moves to that shard when
+// connect or accept resume it. It must only use sockets of the shard it's
+// on, one coroutine waiting per socket and direction.
+
+class AsyncSocket {
+  public:
+    explicit AsyncSocket(std::shared_ptr<Endpoint> endpoint) noexcept
+        : endpoint(std::move(endpoint)) {
+    }
+
+    class RecvAwaiter {
+      public:
+        RecvAwaiter(Endpoint& endpoint, std::span<uint8_t> buf) noexcept
+            : endpoint(endpoint), buf(buf) {
+        }
+
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> h) {
+            return endpoint.awaitReady(h, Readable | Failed);
+        }
+        // The number of bytes read, never 0. SocketError::Closed once the
+        // peer closed and everything was read.
+        tl::expected<size_t, SocketError> await_resume();
+
+      private:
+        Endpoint& endpoint;
+        std::span<uint8_t> buf;
+        size_t n = 0;
+    };
+
+    class SendAwaiter {
+      public:
+        SendAwaiter(Endpoint& endpoint, std::span<const uint8_t> data) noexcept
+            : endpoint(endpoint), data(data) {
+        }
+
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> h) {
+            return endpoint.awaitSendSpace(h);
+        }
+        tl::expected<size_t, SocketError> await_resume();
+
+      private:
+        Endpoint& endpoint;
+        std::span<const uint8_t> data;
+        bool queued = false;
+    };
+
+    // Waits for received data, and reads up to buf.size() bytes of it.
+    [[nodiscard]] RecvAwaiter recv(std::span<uint8_t> buf) noexcept {
+        return {*endpoint, buf};
+    }
+
+    // Queues `data` on the send buffer, then waits for ACKs to make room
+    // if that filled it.
+    [[nodiscard]] SendAwaiter send(std::span<const uint8_t> data) noexcept {
+        return {*endpoint, data};
+    }
+
+    [[nodiscard]] const SocketPair& pair() const noexcept {
+        return endpoint->pair;
+    }
+
+    // Closes the connection: the FIN follows what was sent, and the socket
+    // can't be used anymore.
+    void close() noexcept;
+
+  private:
+    std::shared_ptr<Endpoint> endpoint;
+};
+
+class AsyncListener {
+  public:
+    // Takes the connections peers open to `port` on `stack`. Fails if the
+    // port already has a listener.
+    [[nodiscard]] static tl::expected<AsyncListener, SocketError>
+    listen(Stack& stack, const Tins::IPv4Address& localIP, uint16_t port);
+
+    AsyncListener(AsyncListener&&) noexcept = default;
+    AsyncListener(const AsyncListener&)     = delete;
+    ~AsyncListener();
+
+    // Connections of every shard are queued on the listener, so taking one
+    // always suspends, and the coroutine resumes on the shard owning it.
+    class AcceptAwaiter {
+      public:
+        AcceptAwaiter(Stack& stack, Endpoint& listener) noexcept
+            : stack(stack), listener(listener) {
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+        bool await_suspend(std::coroutine_handle<> h);
+        AsyncSocket await_resume();
+
+      private:
+        Stack& stack;
+        Endpoint& listener;
+        std::shared_ptr<Endpoint> conn;
+    };
+
+    // Waits for an established connection.
+    [[nodiscard]] AcceptAwaiter accept() noexcept {
+        return AcceptAwaiter(*stack, *endpoint);
+    }
+
+  private:
+    AsyncListener(Stack& stack, std::shared_ptr<Endpoint> endpoint) noexcept
+        : stack(&stack), endpoint(std::move(endpoint)) {
+    }
+
+    Stack* stack;
+    std::shared_ptr<Endpoint> endpoint;
+};
+
+class ConnectAwaiter {
+  public:
+    ConnectAwaiter(Stack& stack, const SocketPair& pair)
+        : stack(stack), endpoint(std::make_shared<Endpoint>(pair)) {
+    }
+
+    bool await_ready() noexcept {
+        return false;
+    }
+    // Waits before opening, as the owning shard may be another thread.
+    void await_suspend(std::coroutine_handle<> h) {
+        [[maybe_unused]] auto waiting =
+            endpoint->awaitReady(h, Writable | Failed);
+        stack.open(endpoint->pair, endpoint);
+    }
+    tl::expected<AsyncSocket, SocketError> await_resume() {
+        if (endpoint->failed()) {
+            return tl::make_unexpected(SocketError::Failed);
+        }
+        return AsyncSocket(std::move(endpoint));
+    }
+
+  private:
+    Stack& stack;
+    std::shared_ptr<Endpoint> endpoint;
+};
+
+// Opens a connection from `pair.src` to `pair.dst`, and resumes once it is
+// established, on the shard owning it.
+[[nodiscard]] inline ConnectAwaiter connect(Stack& stack,
+                                            const SocketPair& pair) {
+    return {stack, pair};
+}
+
+class SleepAwaiter {
+  public:
+    explicit SleepAwaiter(TimerWheel::Clock::duration after) noexcept
+        : after(after) {
+    }
+
+    bool await_ready() const noexcept {
+        return after <= TimerWheel::Clock::duration::zero();
+    }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept {
+    }
+
+  private:
+    TimerWheel::Clock::duration after;
+    // Lives in the coroutine frame while it sleeps.
+    Timer timer;
+};
+
+// Resumes after `after`, on the shard's timer wheel.
+[[nodiscard]] inline SleepAwaiter sleep(TimerWheel::Clock::duration after) {
+    return SleepAwaiter(after);
+}
+
+} // namespace tcp
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "ringBuffer.hpp"
+#include "socket.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace tcp {
+
+// Handle of an application socket, see SocketApi.
+using SocketHandle = int32_t;
+
+constexpr inline SocketHandle InvalidSocket = -1;
+
+// Readiness of a socket, as reported by a Poller. Like epoll, readiness is
+// level triggered: a socket keeps being reported while it stays ready.
+enum Readiness : uint32_t {
+    // Data to recv, a connection to accept, the end of the stream or an
+    // error to pick up.
+    Readable = 1 << 0,
+    // Connected with room in the send buffer.
+    Writable = 1 << 1,
+    // The connection failed.
+    Failed = 1 << 2,
+};
+
+class Connection;
+class Poller;
+
+// Endpoint is the application side of a connection, or of a listening port:
+// what's shared between the shard owning the connection and the thread
+// using the socket. The shard fills it and the application drains it, so
+// it's guarded by a mutex, unlike the rest of the connection.
+//
+// Received bytes wait in a buffer of up to RcvBufSize bytes, allocated as
+// they arrive. The connection advertises what's free in it as its receive
+// window, so it never gets more than fits. Sends are held to SndBufSize
+// bytes not yet acknowledged by the peer, claimed by the application and
+// given back by the shard as ACKs come in.
+class Endpoint {
+  public:
+    constexpr static size_t RcvBufSize = 4 * 1024 * 1024;
+    constexpr static size_t SndBufSize = 4 * 1024 * 1024;
+
+    explicit Endpoint(const SocketPair& pair) : pair(pair), rcvBuf(RcvBufSize) {
+    }
+
+    Endpoint(const Endpoint&)            = delete;
+    Endpoint& operator=(const Endpoint&) = delete;
+
+    // The connection's sockets, local first. Only the local port is set for
+    // listeners.
+    const SocketPair pair;
+
+    // Called by the owning shard.
+
+    // Appends received bytes, which must fit in rcvSpace(). `updateAt` is
+    // as for setWindowUpdateAt, with the bytes taken out of the window.
+    void deliver(std::span<const uint8_t> data,
+                 std::span<const uint8_t> tail,
+                 size_t updateAt);
+    // The free space at which the connection would announce a larger
+    // window, SIZE_MAX if it can't.
+    void setWindowUpdateAt(size_t updateAt);
+    // `n` claimed bytes were acknowledged.
+    void onSendAcked(size_t n);
+    void setConnected();
+    void setFailed();
+    // The peer's FIN arrived: what's in the buffer is all there will be.
+    void setPeerClosed();
+    // Queues an established connection on a listener.
+    void pushAccepted(std::shared_ptr<Endpoint> endpoint);
+
+    // Called by the application.
+
+    // Reads up to out.size() received bytes. Returns 0 if there are none.
+    [[nodiscard]] size_t read(std::span<uint8_t> out);
+    // Whether reads made enough room for the connection to announce a
+    // larger window, see Connection::onRecvSpace. True once until the
+    // connection took note, so the shard is told once.
+    [[nodiscard]] bool takeWindowUpdate();
+    // Claims up to `n` bytes of send buffer space, returns how many.
+    [[nodiscard]] size_t claimSendSpace(size_t n);
+    // Claims `n` bytes even beyond SndBufSize, for a sender that then waits
+    // with awaitSendSpace.
+    void claimSendSpaceOver(size_t n);
+    [[nodiscard]] std::shared_ptr<Endpoint> popAccepted();
+    [[nodiscard]] bool connected() const;
+    [[nodiscard]] bool failed() const;
+    [[nodiscard]] bool peerClosed() const;
+
+    // Free space in the receive buffer.
+    [[nodiscard]] size_t rcvSpace() const;
+
+    [[nodiscard]] uint32_t readiness() const;
+
+    // Reports readiness changes to `poller` under `handle`, or to nobody if
+    // poller is null.
+    void watch(Poller* poller, SocketHandle handle);
+
+    // Coroutine support, see coro.hpp. A waiting coroutine is scheduled on
+    // the Scheduler of the thread that made the endpoint ready, which is
+    // the shard owning the connection.
+
+    // Has `h` wait until the endpoint is ready for something in `events`.
+    // Returns false, not waiting, if it already is.
+    [[nodiscard]] bool awaitReady(std::coroutine_handle<> h, uint32_t events);
+    // Has `h` wait until the send buffer has room again, or the connection
+    // failed. Returns false, not waiting, if it already has.
+    [[nodiscard]] bool awaitSendSpace(std::coroutine_handle<> h);
+
+    // The connection, while it's attached. Only for the owning shard's
+    // thread.
+    Connection* conn = nullptr;
+
+  private:
+    [[nodiscard]] uint32_t readinessLocked() const noexcept;
+    void notifyLocked();
+    // Schedules `h` on this thread's Scheduler.
+    static void resumeLater(std::coroutine_handle<> h);
+
+    mutable std::mutex mutex;
+    ByteRing rcvBuf;
+    size_t wndUpdateAt    = 0;
+    bool wndUpdatePending = false;
+    // Bytes claimed by sends and not acknowledged yet.
+    size_t sndClaimed = 0;
+    std::deque<std::shared_ptr<Endpoint>> accepted;
+    bool isConnected    = false;
+    bool isFailed       = false;
+    bool isPeerClosed   = false;
+    Poller* poller      = nullptr;
+    SocketHandle handle = InvalidSocket;
+
+    std::coroutine_handle<> readWaiter;
+    uint32_t readWaiterEvents = 0;
+    std::coroutine_handle<> sendWaiter;
+};
+
+// Poller waits on the readiness of many sockets at once, in the manner of
+// epoll: endpoints push themselves onto a ready list as their state changes,
+// so a wait only looks at sockets that may be ready, however many are
+// registered. A socket can be registered with one poller at a time.
+//
+// Thread safe. A poller must outlive the sockets registered with it.
+class Poller {
+  public:
+    struct Event {
+        SocketHandle handle;
+        uint32_t events; // Readiness bits.
+    };
+
+    Poller()                         = default;
+    Poller(const Poller&)            = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    // Waits until a registered socket is ready for something in its
+    // interest, or `timeout` passes, and fills `out` with as many ready
+    // sockets as fit. Returns how many. Waits forever without a timeout.
+    size_t wait(std::span<Event> out,
+                std::optional<std::chrono::milliseconds> timeout = {});
+
+  private:
+    friend class SocketApi;
+    friend class Endpoint;
+
+    struct Watch {
+        std::shared_ptr<Endpoint> endpoint;
+        uint32_t interest;
+    };
+
+    void add(SocketHandle handle,
+             std::shared_ptr<Endpoint> endpoint,
+             uint32_t interest);
+    void remove(SocketHandle handle);
+    // Puts handle on the ready list, unless it's already there.
+    void markReady(SocketHandle handle);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::unordered_map<SocketHandle, Watch> watches;
+    std::deque<SocketHandle> ready;
+    std::unordered_set<SocketHandle> queued;
+};
+
+} // namespace tcp
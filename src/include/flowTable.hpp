@@ -0,0 +1,261 @@
+#pragma once
+
+#include "socket.hpp"
+#include <bit>
+#include <deque>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace tcp {
+
+// FlowTable maps FlowKeys to values with open addressing, in the manner of
+// a Swiss table: one control byte per slot holds 7 bits of the key's hash,
+// or marks the slot empty or deleted, and probing goes one 16 slot group at
+// a time, matching all control bytes of a group at once (with SSE2 where
+// available). A lookup mostly touches one group of control bytes and one
+// slot, and never allocates.
+//
+// Values live apart from the slots, in a deque that never moves them, so
+// pointers to them stay valid while the table grows. Connections rely on
+// that since their timers point back at them.
+//
+// Not thread safe, each shard has its own.
+template <typename T>
+class FlowTable {
+  public:
+    FlowTable() {
+        resize(MinGroups);
+    }
+
+    FlowTable(const FlowTable&)            = delete;
+    FlowTable& operator=(const FlowTable&) = delete;
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return count == 0;
+    }
+
+    [[nodiscard]] T* find(const FlowKey& key) noexcept {
+        uint64_t h = key.hash();
+        for (Probe p(h, groupMask);; p.next()) {
+            const int8_t* g = &ctrl[p.group * GroupSize];
+            for (uint32_t m = match(g, tag(h)); m != 0; m &= m - 1) {
+                const Slot& s = slots[p.group * GroupSize +
+                                      std::countr_zero(m)];
+                if (s.key == key) {
+                    return &*values[s.value];
+                }
+            }
+            if (match(g, Empty) != 0) {
+                return nullptr;
+            }
+        }
+    }
+
+    // Returns the value for `key` and false if there is one, or constructs
+    // one from `args` and returns it and true, with a single probe.
+    template <typename... Args>
+    std::pair<T*, bool> tryEmplace(const FlowKey& key, Args&&... args) {
+        if ((count + tombstones + 1) * 8 > capacity() * 7) {
+            // Mostly tombstones: rehashing in place is enough.
+            resize(count * 2 >= capacity() ? groupCount() * 2 : groupCount());
+        }
+
+        uint64_t h     = key.hash();
+        size_t freeIdx = SIZE_MAX;
+        for (Probe p(h, groupMask);; p.next()) {
+            const int8_t* g = &ctrl[p.group * GroupSize];
+            for (uint32_t m = match(g, tag(h)); m != 0; m &= m - 1) {
+                const Slot& s = slots[p.group * GroupSize +
+                                      std::countr_zero(m)];
+                if (s.key == key) {
+                    return {&*values[s.value], false};
+                }
+            }
+            if (freeIdx == SIZE_MAX) {
+                uint32_t avail = match(g, Deleted) | match(g, Empty);
+                if (avail != 0) {
+                    freeIdx = p.group * GroupSize + std::countr_zero(avail);
+                }
+            }
+            if (match(g, Empty) != 0) {
+                break;
+            }
+        }
+
+        // The value is constructed before the slot is published, so a
+        // throwing constructor leaves the table as it was.
+        uint32_t vi = allocValue();
+        auto& v     = values[vi];
+        try {
+            v.emplace(std::forward<Args>(args)...);
+        } catch (...) {
+            freeValues.push_back(vi);
+            throw;
+        }
+
+        if (ctrl[freeIdx] == Deleted) {
+            tombstones--;
+        }
+        ctrl[freeIdx]  = tag(h);
+        slots[freeIdx] = {key, vi};
+        count++;
+        return {&*v, true};
+    }
+
+    // Removes `key` and destroys its value. Returns false if it wasn't
+    // there.
+    bool erase(const FlowKey& key) {
+        uint64_t h = key.hash();
+        for (Probe p(h, groupMask);; p.next()) {
+            const int8_t* g = &ctrl[p.group * GroupSize];
+            for (uint32_t m = match(g, tag(h)); m != 0; m &= m - 1) {
+                size_t i = p.group * GroupSize + std::countr_zero(m);
+                if (slots[i].key == key) {
+                    values[slots[i].value].reset();
+                    freeValues.push_back(slots[i].value);
+                    // A group that still has an empty slot never made a
+                    // probe go on past it, so the slot can be empty again.
+                    bool hasEmpty = match(g, Empty) != 0;
+                    ctrl[i]       = hasEmpty ? Empty : Deleted;
+                    tombstones += hasEmpty ? 0 : 1;
+                    count--;
+                    return true;
+                }
+            }
+            if (match(g, Empty) != 0) {
+                return false;
+            }
+        }
+    }
+
+    // Calls fn(key, value) for every entry, in no particular order. fn must
+    // not insert or erase.
+    template <typename F>
+    void forEach(F&& fn) {
+        for (size_t i = 0; i < ctrl.size(); i++) {
+            if (ctrl[i] >= 0) {
+                fn(slots[i].key, *values[slots[i].value]);
+            }
+        }
+    }
+
+  private:
+    constexpr static size_t GroupSize = 16;
+    constexpr static size_t MinGroups = 4;
+
+    // Control bytes: a full slot holds the low 7 bits of its hash, so it is
+    // never negative.
+    constexpr static int8_t Empty   = -128;
+    constexpr static int8_t Deleted = -2;
+
+    // 16 bytes, four slots per cache line.
+    struct Slot {
+        FlowKey key;
+        uint32_t value; // Index into values.
+    };
+    static_assert(sizeof(Slot) == 16);
+
+    // Triangular probing over the groups, which visits each of them once
+    // when the number of groups is a power of two.
+    struct Probe {
+        size_t group, mask, step = 0;
+
+        Probe(uint64_t h, size_t mask) noexcept
+            : group((h >> 7) & mask), mask(mask) {
+        }
+
+        void next() noexcept {
+            step++;
+            group = (group + step) & mask;
+        }
+    };
+
+    [[nodiscard]] static int8_t tag(uint64_t h) noexcept {
+        return static_cast<int8_t>(h & 0x7f);
+    }
+
+    // Bit i set if control byte i of the group equals `c`.
+    [[nodiscard]] static uint32_t match(const int8_t* group,
+                                        int8_t c) noexcept {
+#ifdef __SSE2__
+        __m128i g;
+        memcpy(&g, group, sizeof(g));
+        return static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c))));
+#else
+        uint32_t m = 0;
+        for (size_t i = 0; i < GroupSize; i++) {
+            m |= static_cast<uint32_t>(group[i] == c) << i;
+        }
+        return m;
+#endif
+    }
+
+    [[nodiscard]] size_t capacity() const noexcept {
+        return ctrl.size();
+    }
+
+    [[nodiscard]] size_t groupCount() const noexcept {
+        return groupMask + 1;
+    }
+
+    [[nodiscard]] uint32_t allocValue() {
+        if (!freeValues.empty()) {
+            uint32_t i = freeValues.back();
+            freeValues.pop_back();
+            return i;
+        }
+        values.emplace_back();
+        return static_cast<uint32_t>(values.size() - 1);
+    }
+
+    // Rehashes every entry into `groups` groups. Only slots move, values
+    // stay where they are.
+    void resize(size_t groups) {
+        auto oldCtrl  = std::move(ctrl);
+        auto oldSlots = std::move(slots);
+
+        ctrl.assign(groups * GroupSize, Empty);
+        slots.assign(groups * GroupSize, Slot{});
+        groupMask  = groups - 1;
+        tombstones = 0;
+
+        for (size_t i = 0; i < oldCtrl.size(); i++) {
+            if (oldCtrl[i] < 0) {
+                continue;
+            }
+            uint64_t h = oldSlots[i].key.hash();
+            for (Probe p(h, groupMask);; p.next()) {
+                uint32_t m = match(&ctrl[p.group * GroupSize], Empty);
+                if (m != 0) {
+                    size_t j = p.group * GroupSize + std::countr_zero(m);
+                    ctrl[j]  = tag(h);
+                    slots[j] = oldSlots[i];
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<int8_t> ctrl;
+    std::vector<Slot> slots;
+    std::deque<std::optional<T>> values;
+    std::vector<uint32_t> freeValues;
+    size_t groupMask  = 0;
+    size_t count      = 0;
+    size_t tombstones = 0;
+};
+
+} // namespace tcp
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tcp {
+
+// FramePipe is a lock free single producer, single consumer queue of frames,
+// such as one direction of a MemoryLink. Frames are copied into fixed size
+// slots allocated up front. The consumer can be woken through an eventfd,
+// signalled once per burst rather than once per frame.
+class FramePipe {
+  public:
+    FramePipe(size_t numSlots, size_t slotSize);
+    ~FramePipe();
+
+    FramePipe(const FramePipe&)            = delete;
+    FramePipe& operator=(const FramePipe&) = delete;
+
+    // Producer side. Returns false, dropping the frame, if the pipe is full
+    // or the frame doesn't fit in a slot. The frame may come in two pieces,
+    // `rest` follows `frame`.
+    bool push(std::span<const uint8_t> frame,
+              std::span<const uint8_t> rest = {}) noexcept;
+    // Wakes the consumer.
+    void signal() noexcept;
+
+    // Consumer side. Copies the oldest frame into `out`, truncating it if
+    // need be. Returns its length, or 0 if the pipe is empty.
+    [[nodiscard]] size_t pop(std::span<uint8_t> out) noexcept;
+    // Clears the wakeup, before looking at the pipe a last time.
+    void clearSignal() noexcept;
+
+    [[nodiscard]] int fd() const noexcept {
+        return efd;
+    }
+
+  private:
+    std::vector<uint8_t> buf;
+    std::vector<uint32_t> lens;
+    size_t slotSize;
+    size_t mask;
+    int efd;
+    // Free running, on their own cache lines as each side writes one.
+    alignas(64) std::atomic<size_t> head = 0; // Consumer.
+    alignas(64) std::atomic<size_t> tail = 0; // Producer.
+};
+
+} // namespace tcp
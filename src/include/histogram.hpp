@@ -0,0 +1,127 @@
+#pragma once
+
+#include "stats.hpp"
+#include <array>
+#include <bit>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tcp {
+
+// LatencyHistogram counts values in log-linear buckets, as HDR histograms
+// do: every power of two is cut into SubBuckets equal parts, so a value is
+// known to within 1/SubBuckets of itself (about 3%) from 0 to 2^64. Recording
+// is an index computation and a Counter add, with a single writer; any thread
+// can take a HistogramSnapshot.
+class LatencyHistogram {
+  public:
+    constexpr static unsigned SubBits    = 5;
+    constexpr static uint64_t SubBuckets = uint64_t{1} << SubBits;
+    constexpr static size_t NumBuckets   = (65 - SubBits) * SubBuckets;
+
+    void record(uint64_t value) noexcept {
+        counts[index(value)].add();
+    }
+
+    [[nodiscard]] uint64_t count(size_t bucket) const noexcept {
+        return counts[bucket].get();
+    }
+
+    // Values below SubBuckets get a bucket each. Above, the top SubBits + 1
+    // bits pick the bucket within the value's power of two.
+    [[nodiscard]] constexpr static size_t index(uint64_t value) noexcept {
+        if (value < SubBuckets) {
+            return value;
+        }
+        auto shift = static_cast<unsigned>(std::bit_width(value)) - SubBits - 1;
+        return SubBuckets + shift * SubBuckets +
+               ((value >> shift) - SubBuckets);
+    }
+
+    // Largest value that falls in `bucket`.
+    [[nodiscard]] constexpr static uint64_t upperBound(size_t bucket) noexcept {
+        if (bucket < SubBuckets) {
+            return bucket;
+        }
+        auto shift = static_cast<unsigned>(bucket / SubBuckets - 1);
+        auto lower = (SubBuckets + bucket % SubBuckets) << shift;
+        return lower + ((uint64_t{1} << shift) - 1);
+    }
+
+  private:
+    std::array<Counter, NumBuckets> counts{};
+};
+
+// The counts of one or more LatencyHistograms at one point in time.
+// Snapshots of histograms of the same thing on different shards merge into
+// one of the whole stack.
+class HistogramSnapshot {
+  public:
+    HistogramSnapshot() : counts(LatencyHistogram::NumBuckets) {
+    }
+
+    void merge(const LatencyHistogram& h) noexcept {
+        for (size_t i = 0; i < counts.size(); i++) {
+            auto n = h.count(i);
+            counts[i] += n;
+            total += n;
+        }
+    }
+
+    [[nodiscard]] uint64_t count() const noexcept {
+        return total;
+    }
+
+    // Smallest recorded value that `q` of all values are at or below, to
+    // within a bucket. 0 when empty.
+    [[nodiscard]] uint64_t percentile(double q) const noexcept;
+
+    [[nodiscard]] uint64_t max() const noexcept {
+        return percentile(1.0);
+    }
+
+  private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+};
+
+// Stages of the packet path whose latency every shard measures.
+enum class Stage : uint8_t {
+    ReadToParse,    // Link read to parsed headers, the wait behind the
+                    // frames before it in the burst included.
+    ParseToLookup,  // Parsed to the connection found or created.
+    Handler,        // The state's handler of the segment.
+    HandlerToWrite, // Handler done to what it sent written to the link.
+    InboxWait,      // A send posted to the shard until it runs.
+    Send,           // The state's handler of a send.
+};
+
+constexpr size_t NumStages = 6;
+
+[[nodiscard]] const char* stageName(Stage stage) noexcept;
+
+// A shard's latency histograms, in tsc::now() ticks.
+struct StageLatency {
+    std::array<LatencyHistogram, NumStages> stages;
+
+    void record(Stage stage, uint64_t ticks) noexcept {
+        stages[static_cast<size_t>(stage)].record(ticks);
+    }
+
+    [[nodiscard]] const LatencyHistogram& operator[](Stage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+};
+
+// Percentiles of one stage over every shard, in nanoseconds.
+struct LatencySummary {
+    Stage stage;
+    uint64_t count;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+} // namespace tcp
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace tcp {
+
+// Inbox hands work from other threads to a thread running an event loop. The
+// loop polls fd() next to its other fds and calls drain() when it is
+// readable, so posted tasks run on the loop thread and can touch its state
+// without locks.
+class Inbox {
+  public:
+    using Task = std::function<void()>;
+
+    Inbox() : efd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    }
+
+    ~Inbox() {
+        if (efd != -1) {
+            close(efd);
+        }
+    }
+
+    Inbox(const Inbox&)            = delete;
+    Inbox& operator=(const Inbox&) = delete;
+
+    void post(Task task) {
+        bool wake;
+        {
+            std::scoped_lock lock(mutex);
+            wake = tasks.empty();
+            tasks.push_back(std::move(task));
+        }
+        // Only the first task of a batch needs to wake the loop.
+        if (wake) {
+            uint64_t one = 1;
+            [[maybe_unused]] auto n = write(efd, &one, sizeof(one));
+        }
+    }
+
+    // Runs every task posted so far. Must be called from the loop thread.
+    void drain() {
+        uint64_t count;
+        [[maybe_unused]] auto n = read(efd, &count, sizeof(count));
+
+        {
+            std::scoped_lock lock(mutex);
+            std::swap(tasks, running);
+        }
+        for (auto& task : running) {
+            task();
+        }
+        running.clear();
+    }
+
+    [[nodiscard]] int fd() const noexcept {
+        return efd;
+    }
+
+    // Tasks posted and not taken by drain yet.
+    [[nodiscard]] size_t size() {
+        std::scoped_lock lock(mutex);
+        return tasks.size();
+    }
+
+  private:
+    int efd;
+    std::mutex mutex;
+    std::vector<Task> tasks;
+    // Swapped with tasks on drain, so both keep their capacity.
+    std::vector<Task> running;
+};
+
+} // namespace tcp
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "sipHash.hpp"
+#include "socket.hpp"
+#include <chrono>
+#include <stdint.h>
+
+namespace tcp {
+
+// IssGenerator picks the initial send sequence numbers of a shard's
+// connections as RFC 6528 does:
+//
+//     ISN = M + F(localip, localport, remoteip, remoteport, secretkey)
+//
+// where M is a clock ticking every Tick and F is SipHash-2-4, keyed with a
+// random secret, of the flow. The connections of one flow get ISNs that go
+// up with time, so segments of an old one aren't taken for a new one's,
+// while no one without the secret can guess the ISN of any flow.
+class IssGenerator {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Draws a random secret.
+    IssGenerator();
+
+    // The ISN of a connection on `flow`, oriented from us to the peer,
+    // opened at `now`.
+    [[nodiscard]] uint32_t make(const FlowKey& flow,
+                                Clock::time_point now) const noexcept;
+
+    constexpr static auto Tick = std::chrono::microseconds(4);
+
+  private:
+    sipHash::Key secret;
+};
+
+} // namespace tcp
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "framePipe.hpp"
+#include <memory>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <utility>
+
+#ifdef __APPLE__
+#include "utun.hpp"
+#endif
+
+namespace tcp {
+
+// LinkDevice is where a shard's IP packets come from and go to: a tun queue,
+// a utun socket, or an in-memory pipe to another stack in the same process.
+// Reads never block, pollFd() tells when there may be something to read.
+//
+// A device belongs to one shard, which is the only thread using it.
+class LinkDevice {
+  public:
+    virtual ~LinkDevice() = default;
+
+    // Becomes readable (POLLIN) when a frame may be waiting.
+    [[nodiscard]] virtual int pollFd() const noexcept = 0;
+
+    // Reads one frame into `buf`. Returns its length, 0 if none is waiting,
+    // or -1 on error.
+    [[nodiscard]] virtual ssize_t read(std::span<uint8_t> buf) noexcept = 0;
+
+    // Writes one frame. Returns false if it was dropped.
+    virtual bool write(std::span<const uint8_t> frame) noexcept = 0;
+
+    // Called after a burst of writes. Devices that have to wake the other
+    // end do it once here rather than once per frame.
+    virtual void flush() noexcept {
+    }
+};
+
+// TunLink is one queue of a TunDevice, or any fd that takes one packet per
+// read and write. The fd is made non blocking, and stays owned by whoever
+// opened it.
+class TunLink : public LinkDevice {
+  public:
+    // Throws std::runtime_error if the fd can't be made non blocking.
+    explicit TunLink(int fd);
+
+    [[nodiscard]] int pollFd() const noexcept override {
+        return fd;
+    }
+    [[nodiscard]] ssize_t read(std::span<uint8_t> buf) noexcept override;
+    bool write(std::span<const uint8_t> frame) noexcept override;
+
+  private:
+    int fd;
+};
+
+#ifdef __APPLE__
+// UTunLink is a macOS utun interface. utun puts the protocol family in front
+// of every packet, which is added and stripped here.
+class UTunLink : public LinkDevice {
+  public:
+    [[nodiscard]] int pollFd() const noexcept override {
+        return utun.Fd();
+    }
+    [[nodiscard]] ssize_t read(std::span<uint8_t> buf) noexcept override;
+    bool write(std::span<const uint8_t> frame) noexcept override;
+
+  private:
+    UTun utun;
+};
+#endif
+
+// MemoryLink is one end of an in-memory link between two stacks in the same
+// process: what one end writes the other reads. It needs no tun device and
+// no privileges, and the kernel is only involved to wake the other end, so
+// it measures the stack itself.
+class MemoryLink : public LinkDevice {
+  public:
+    MemoryLink(std::shared_ptr<FramePipe> rx,
+               std::shared_ptr<FramePipe> tx) noexcept
+        : rx(std::move(rx)), tx(std::move(tx)) {
+    }
+
+    // Two connected ends, each direction holding up to `numSlots` frames of
+    // up to `slotSize` bytes.
+    [[nodiscard]] static std::pair<std::unique_ptr<MemoryLink>,
+                                   std::unique_ptr<MemoryLink>>
+    pair(size_t slotSize, size_t numSlots = DefaultSlots);
+
+    [[nodiscard]] int pollFd() const noexcept override {
+        return rx->fd();
+    }
+    [[nodiscard]] ssize_t read(std::span<uint8_t> buf) noexcept override;
+    bool write(std::span<const uint8_t> frame) noexcept override;
+    void flush() noexcept override;
+
+    constexpr static size_t DefaultSlots = 1024;
+
+  private:
+    std::shared_ptr<FramePipe> rx;
+    std::shared_ptr<FramePipe> tx;
+    // Frames were written since the last flush.
+    bool pending = false;
+};
+
+} // namespace tcp
@@ -0,0 +1,360 @@
+#pragma once
+
+#include "tins/ip_address.h"
+#include <iterator>
+#include <optional>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <tl/expected.hpp>
+
+namespace tcp {
+
+// Helpers to read and write big endian (network order) fields of a raw
+// buffer.
+namespace wire {
+
+[[nodiscard]] inline uint16_t load16(const uint8_t* p) noexcept {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+[[nodiscard]] inline uint32_t load32(const uint8_t* p) noexcept {
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline void store16(uint8_t* p, uint16_t v) noexcept {
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+inline void store32(uint8_t* p, uint32_t v) noexcept {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+} // namespace wire
+
+// IPv4View is a non owning view over an IPv4 header. It does no validation
+// itself, PacketView::parse makes sure the header is sane before handing one
+// out.
+class IPv4View {
+  public:
+    constexpr static size_t MinHeaderSize = 20;
+
+    IPv4View() = default;
+    explicit IPv4View(const uint8_t* data) noexcept : data(data) {
+    }
+
+    [[nodiscard]] uint8_t version() const noexcept {
+        return data[0] >> 4;
+    }
+
+    [[nodiscard]] size_t header_size() const noexcept {
+        return static_cast<size_t>(data[0] & 0x0f) * 4;
+    }
+
+    [[nodiscard]] uint8_t tos() const noexcept {
+        return data[1];
+    }
+
+    [[nodiscard]] uint16_t tot_len() const noexcept {
+        return wire::load16(data + 2);
+    }
+
+    [[nodiscard]] uint16_t id() const noexcept {
+        return wire::load16(data + 4);
+    }
+
+    // More fragments flag and fragment offset (in 8 byte units).
+    [[nodiscard]] bool more_fragments() const noexcept {
+        return data[6] & 0x20;
+    }
+
+    [[nodiscard]] uint16_t fragment_offset() const noexcept {
+        return wire::load16(data + 6) & 0x1fff;
+    }
+
+    [[nodiscard]] uint8_t ttl() const noexcept {
+        return data[8];
+    }
+
+    [[nodiscard]] uint8_t protocol() const noexcept {
+        return data[9];
+    }
+
+    [[nodiscard]] uint16_t checksum() const noexcept {
+        return wire::load16(data + 10);
+    }
+
+    // Addresses are handed to IPv4Address in network order, same as libtins
+    // does when it parses a header.
+    [[nodiscard]] Tins::IPv4Address src_addr() const noexcept {
+        uint32_t raw;
+        memcpy(&raw, data + 12, sizeof(raw));
+        return Tins::IPv4Address(raw);
+    }
+
+    [[nodiscard]] Tins::IPv4Address dst_addr() const noexcept {
+        uint32_t raw;
+        memcpy(&raw, data + 16, sizeof(raw));
+        return Tins::IPv4Address(raw);
+    }
+
+    [[nodiscard]] std::span<const uint8_t> bytes() const noexcept {
+        return {data, header_size()};
+    }
+
+  private:
+    const uint8_t* data = nullptr;
+};
+
+// TCPOption is a single option from the TCP header. `data` excludes the kind
+// and length bytes.
+struct TCPOption {
+    enum Kind : uint8_t {
+        EOL           = 0,
+        NOP           = 1,
+        MSS           = 2,
+        WindowScale   = 3,
+        SACKPermitted = 4,
+        SACK          = 5,
+        Timestamp     = 8,
+    };
+
+    uint8_t kind;
+    std::span<const uint8_t> data;
+};
+
+// TCPOptionIterator walks the options area of a TCP header. Walking stops at
+// End of Option List or at the first malformed option, so a bad length can
+// never make it read past the header.
+class TCPOptionIterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = TCPOption;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const TCPOption*;
+    using reference         = const TCPOption&;
+
+    TCPOptionIterator() = default;
+    TCPOptionIterator(const uint8_t* cur, const uint8_t* end) noexcept
+        : cur(cur), end(end) {
+        decode();
+    }
+
+    [[nodiscard]] reference operator*() const noexcept {
+        return option;
+    }
+
+    [[nodiscard]] pointer operator->() const noexcept {
+        return &option;
+    }
+
+    TCPOptionIterator& operator++() noexcept {
+        cur += optionSize;
+        decode();
+        return *this;
+    }
+
+    TCPOptionIterator operator++(int) noexcept {
+        auto copy = *this;
+        ++*this;
+        return copy;
+    }
+
+    [[nodiscard]] bool
+    operator==(const TCPOptionIterator& rhs) const noexcept {
+        return cur == rhs.cur;
+    }
+
+  private:
+    void decode() noexcept {
+        // Skip NOP padding.
+        while (cur != end && *cur == TCPOption::NOP) {
+            cur++;
+        }
+        if (cur == end || *cur == TCPOption::EOL || end - cur < 2) {
+            cur = end;
+            return;
+        }
+
+        uint8_t len = cur[1];
+        if (len < 2 || len > end - cur) {
+            cur = end;
+            return;
+        }
+
+        option     = {cur[0], {cur + 2, static_cast<size_t>(len - 2)}};
+        optionSize = len;
+    }
+
+    const uint8_t* cur = nullptr;
+    const uint8_t* end = nullptr;
+    TCPOption option{};
+    size_t optionSize = 0;
+};
+
+struct TCPOptionRange {
+    const uint8_t* first;
+    const uint8_t* last;
+
+    [[nodiscard]] TCPOptionIterator begin() const noexcept {
+        return {first, last};
+    }
+
+    [[nodiscard]] TCPOptionIterator end() const noexcept {
+        return {last, last};
+    }
+};
+
+// TCPView is a non owning view over a TCP header. Accessors are named after
+// the libtins ones so call sites read the same.
+class TCPView {
+  public:
+    constexpr static size_t MinHeaderSize = 20;
+
+    enum Flags : uint8_t {
+        FIN = 1,
+        SYN = 2,
+        RST = 4,
+        PSH = 8,
+        ACK = 16,
+        URG = 32,
+        ECE = 64,
+        CWR = 128,
+    };
+
+    TCPView() = default;
+    explicit TCPView(const uint8_t* data) noexcept : data(data) {
+    }
+
+    [[nodiscard]] uint16_t sport() const noexcept {
+        return wire::load16(data);
+    }
+
+    [[nodiscard]] uint16_t dport() const noexcept {
+        return wire::load16(data + 2);
+    }
+
+    [[nodiscard]] uint32_t seq() const noexcept {
+        return wire::load32(data + 4);
+    }
+
+    [[nodiscard]] uint32_t ack_seq() const noexcept {
+        return wire::load32(data + 8);
+    }
+
+    [[nodiscard]] size_t header_size() const noexcept {
+        return static_cast<size_t>(data[12] >> 4) * 4;
+    }
+
+    [[nodiscard]] uint8_t flags() const noexcept {
+        return data[13];
+    }
+
+    [[nodiscard]] bool get_flag(Flags flag) const noexcept {
+        return flags() & flag;
+    }
+
+    // True if all of the given flags are set.
+    [[nodiscard]] bool has_flags(uint8_t check) const noexcept {
+        return (flags() & check) == check;
+    }
+
+    [[nodiscard]] uint16_t window() const noexcept {
+        return wire::load16(data + 14);
+    }
+
+    [[nodiscard]] uint16_t checksum() const noexcept {
+        return wire::load16(data + 16);
+    }
+
+    [[nodiscard]] uint16_t urg_ptr() const noexcept {
+        return wire::load16(data + 18);
+    }
+
+    [[nodiscard]] TCPOptionRange options() const noexcept {
+        return {data + MinHeaderSize, data + header_size()};
+    }
+
+    // The Maximum Segment Size option, if present and well formed.
+    [[nodiscard]] std::optional<uint16_t> mss() const noexcept {
+        for (const auto& option : options()) {
+            if (option.kind == TCPOption::MSS && option.data.size() == 2) {
+                return wire::load16(option.data.data());
+            }
+        }
+        return std::nullopt;
+    }
+
+    // The Window Scale option's shift count, if present (RFC 7323).
+    [[nodiscard]] std::optional<uint8_t> winscale() const noexcept {
+        for (const auto& option : options()) {
+            if (option.kind == TCPOption::WindowScale &&
+                option.data.size() == 1) {
+                return option.data[0];
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Whether the SACK-Permitted option is present (RFC 2018).
+    [[nodiscard]] bool sack_permitted() const noexcept {
+        for (const auto& option : options()) {
+            if (option.kind == TCPOption::SACKPermitted) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[nodiscard]] std::span<const uint8_t> bytes() const noexcept {
+        return {data, header_size()};
+    }
+
+  private:
+    const uint8_t* data = nullptr;
+};
+
+// PacketView is the parsed form of an inbound IPv4 + TCP packet. It points
+// into the buffer it was parsed from, so it must not outlive that buffer.
+struct PacketView {
+    enum class ParseError : uint8_t {
+        Truncated,
+        NotIPv4,
+        BadIPHeader,
+        Fragmented,
+        NotTCP,
+        BadTCPHeader,
+    };
+
+    IPv4View ip;
+    TCPView tcp;
+    std::span<const uint8_t> payload;
+
+    // Segment length as defined by RFC 793, SYN and FIN occupy one sequence
+    // number each.
+    [[nodiscard]] uint32_t segLen() const noexcept {
+        return static_cast<uint32_t>(payload.size()) +
+               tcp.get_flag(TCPView::SYN) + tcp.get_flag(TCPView::FIN);
+    }
+
+    // Whether the IP header checksum holds.
+    [[nodiscard]] bool ipChecksumValid() const noexcept;
+
+    // Whether the TCP checksum over the pseudo header, the TCP header and the
+    // payload holds.
+    [[nodiscard]] bool tcpChecksumValid() const noexcept;
+
+    [[nodiscard]] static tl::expected<PacketView, ParseError>
+    parse(std::span<const uint8_t> buf) noexcept;
+};
+
+[[nodiscard]] const char* toString(PacketView::ParseError err) noexcept;
+
+} // namespace tcp
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "seqRanges.hpp"
+#include <memory>
+#include <optional>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+namespace tcp {
+
+// ReassemblyQueue holds in-window segments that arrived ahead of rcv.nxt
+// until the gap before them is filled.
+//
+// Bytes live in a ring indexed by sequence number, so a byte has exactly one
+// place to go and overlapping segments simply overwrite each other. Which
+// ranges are present is tracked by a SeqRangeList. The ring grows to reach
+// the furthest byte held past rcv.nxt, bounded by the window, and isn't
+// allocated until a segment arrives out of order.
+//
+// Not thread safe, it belongs to the connection's shard.
+class ReassemblyQueue {
+  public:
+    // Max number of disjoint holes we keep track of, beyond that new
+    // segments that would open another one are dropped.
+    constexpr static size_t MaxBlocks = 16;
+
+    ReassemblyQueue() noexcept : blocks(MaxBlocks) {
+    }
+    explicit ReassemblyQueue(size_t window) noexcept;
+
+    [[nodiscard]] bool empty() const noexcept {
+        return blocks.empty();
+    }
+
+    // Bytes held out of order.
+    [[nodiscard]] size_t size() const noexcept {
+        return blocks.bytes();
+    }
+
+    // The blocks held, in sequence order.
+    [[nodiscard]] std::span<const SeqRangeList::Range> ranges() const noexcept {
+        return blocks.ranges();
+    }
+
+    // The block that the last inserted segment went into, if it is still
+    // held. SACK reports it first (RFC 2018).
+    [[nodiscard]] std::optional<SeqRangeList::Range> latest() const noexcept {
+        return blocks.find(lastInsert);
+    }
+
+    // Stores whatever part of `data` (starting at sequence `seq`) lies in
+    // [nxt, nxt + window). Returns false if the segment had to be dropped.
+    bool insert(uint32_t nxt, uint32_t seq, std::span<const uint8_t> data);
+
+    // The contiguous run of bytes starting at `nxt`, in up to two pieces
+    // because of wrapping. Empty while the gap at `nxt` is still open.
+    [[nodiscard]] std::pair<std::span<const uint8_t>, std::span<const uint8_t>>
+    front(uint32_t nxt) const noexcept;
+
+    // Forgets everything before `nxt`, once it was delivered or rcv.nxt
+    // moved past it with in order data.
+    void advance(uint32_t nxt) noexcept;
+
+  private:
+    // Grows the ring to hold `need` bytes from rcv.nxt on, moving the blocks
+    // held over.
+    void reserve(size_t need);
+
+    SeqRangeList blocks;
+    std::unique_ptr<uint8_t[]> buf;
+    size_t cap          = 0;
+    size_t alloc        = 0;
+    uint32_t lastInsert = 0;
+};
+
+} // namespace tcp
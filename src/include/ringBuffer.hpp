@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+
+namespace tcp {
+
+// Helpers for rings of bytes whose size is a power of two, indexed by free
+// running positions.
+namespace ring {
+
+// Rings are allocated as data arrives, starting this small and doubling.
+constexpr size_t MinAlloc = 16 * 1024;
+
+// Copies `data` into the ring `buf` of `size` bytes from position `pos` on.
+inline void copyIn(uint8_t* buf,
+                   size_t size,
+                   size_t pos,
+                   std::span<const uint8_t> data) noexcept {
+    if (data.empty()) {
+        return;
+    }
+    pos        = pos & (size - 1);
+    auto first = std::min(data.size(), size - pos);
+    memcpy(buf + pos, data.data(), first);
+    memcpy(buf, data.data() + first, data.size() - first);
+}
+
+// The `len` bytes of the ring `buf` of `size` bytes from position `pos` on,
+// in up to two pieces because of wrapping.
+[[nodiscard]] inline std::pair<std::span<const uint8_t>,
+                               std::span<const uint8_t>>
+pieces(const uint8_t* buf, size_t size, size_t pos, size_t len) noexcept {
+    pos        = pos & (size - 1);
+    auto first = std::min(len, size - pos);
+    return {{buf + pos, first}, {buf, len - first}};
+}
+
+// Storage size for a ring of capacity `cap` that has to hold `need` bytes.
+[[nodiscard]] inline size_t allocFor(size_t need, size_t cap) noexcept {
+    return std::min(cap, std::max(MinAlloc, std::bit_ceil(need)));
+}
+
+} // namespace ring
+
+// ByteRing is a bounded byte FIFO used for a connection's stream buffers.
+// Storage grows with the bytes held, from ring::MinAlloc doubling up to the
+// capacity, and is never touched before it's written: a buffer costs what
+// it held at its fullest, nothing until the first write. Sizes are powers
+// of two so positions wrap with a mask.
+//
+// Not thread safe, it belongs to the connection's shard.
+class ByteRing {
+  public:
+    ByteRing() = default;
+    explicit ByteRing(size_t capacity) noexcept
+        : cap(std::bit_ceil(capacity)) {
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return tail - head;
+    }
+
+    [[nodiscard]] size_t capacity() const noexcept {
+        return cap;
+    }
+
+    // Bytes of storage allocated so far.
+    [[nodiscard]] size_t allocated() const noexcept {
+        return alloc;
+    }
+
+    [[nodiscard]] size_t free() const noexcept {
+        return cap - size();
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return head == tail;
+    }
+
+    // Appends as much of `data` as fits, returns how much was appended.
+    size_t write(std::span<const uint8_t> data) {
+        auto n = std::min(data.size(), free());
+        if (n == 0) {
+            return 0;
+        }
+        reserve(size() + n);
+        ring::copyIn(buf.get(), alloc, tail, data.first(n));
+        tail += n;
+        return n;
+    }
+
+    // Returns the (up to two, because of wrapping) contiguous pieces of
+    // `len` bytes starting `offset` bytes from the front, without consuming.
+    [[nodiscard]] std::pair<std::span<const uint8_t>, std::span<const uint8_t>>
+    peek(size_t offset, size_t len) const noexcept {
+        offset = std::min(offset, size());
+        len    = std::min(len, size() - offset);
+        if (len == 0) {
+            return {};
+        }
+        return ring::pieces(buf.get(), alloc, head + offset, len);
+    }
+
+    // Copies up to `out.size()` bytes from the front, then consumes them.
+    size_t read(std::span<uint8_t> out) noexcept {
+        auto [first, second] = peek(0, out.size());
+        if (first.empty()) {
+            return 0;
+        }
+        memcpy(out.data(), first.data(), first.size());
+        memcpy(out.data() + first.size(), second.data(), second.size());
+        auto n = first.size() + second.size();
+        consume(n);
+        return n;
+    }
+
+    // Drops `n` bytes from the front.
+    void consume(size_t n) noexcept {
+        head += std::min(n, size());
+    }
+
+  private:
+    // Grows the storage to hold `need` bytes, moving what's held over.
+    void reserve(size_t need) {
+        if (need <= alloc) {
+            return;
+        }
+        auto newAlloc = ring::allocFor(need, cap);
+        auto newBuf   = std::make_unique_for_overwrite<uint8_t[]>(newAlloc);
+        auto [first, second] = peek(0, size());
+        ring::copyIn(newBuf.get(), newAlloc, head, first);
+        ring::copyIn(newBuf.get(), newAlloc, head + first.size(), second);
+        buf   = std::move(newBuf);
+        alloc = newAlloc;
+    }
+
+    std::unique_ptr<uint8_t[]> buf;
+    size_t cap   = 0;
+    size_t alloc = 0;
+    // Free running positions, only masked when indexing.
+    size_t head = 0;
+    size_t tail = 0;
+};
+
+} // namespace tcp
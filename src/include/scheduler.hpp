@@ -0,0 +1,125 @@
+#pragma once
+
+#include "timerWheel.hpp"
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+namespace tcp {
+
+// Task is a fire and forget coroutine. It starts suspended, runs once it is
+// spawned on a shard (see ConnectionManager::spawn) and frees itself when it
+// returns. Awaitables for it are in coro.hpp.
+class Task {
+  public:
+    struct promise_type {
+        Task get_return_object() noexcept {
+            return Task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() noexcept {
+        }
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {
+    }
+    Task(const Task&)            = delete;
+    Task& operator=(const Task&) = delete;
+    Task& operator=(Task&&)      = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // Hands the coroutine over to whoever is going to resume it.
+    [[nodiscard]] std::coroutine_handle<> release() noexcept {
+        return std::exchange(handle, {});
+    }
+
+  private:
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+        : handle(handle) {
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Scheduler resumes the coroutines of one shard on its loop thread. Events
+// (data, ACKs, timers) schedule the coroutines waiting on them while the
+// shard processes them, and the loop resumes them once it's done, before
+// flushing, so whatever they send goes out in the same batch.
+//
+// Like TxBatch, the scheduler of the loop running on a thread is installed
+// with Scheduler::Scope. Not thread safe.
+class Scheduler {
+  public:
+    explicit Scheduler(TimerWheel& timers) noexcept : wheel(&timers) {
+    }
+
+    Scheduler(const Scheduler&)            = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    void schedule(std::coroutine_handle<> h) {
+        ready.push_back(h);
+    }
+
+    // Resumes every scheduled coroutine, including the ones scheduled
+    // meanwhile.
+    void runReady() {
+        while (!ready.empty()) {
+            std::swap(ready, running);
+            for (auto h : running) {
+                h.resume();
+            }
+            running.clear();
+        }
+    }
+
+    // The shard's timers, for sleeping.
+    [[nodiscard]] TimerWheel& timers() noexcept {
+        return *wheel;
+    }
+
+    [[nodiscard]] static Scheduler* current() noexcept {
+        return active;
+    }
+
+    // Scope makes `scheduler` the current scheduler for this thread until it
+    // goes out of scope.
+    class Scope {
+      public:
+        explicit Scope(Scheduler& scheduler) noexcept : prev(active) {
+            active = &scheduler;
+        }
+        ~Scope() {
+            active = prev;
+        }
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        Scheduler* prev;
+    };
+
+  private:
+    TimerWheel* wheel;
+    std::vector<std::coroutine_handle<>> ready;
+    // Swapped with ready, so both keep their capacity.
+    std::vector<std::coroutine_handle<>> running;
+
+    static thread_local Scheduler* active;
+};
+
+} // namespace tcp
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "socket.hpp"
+#include "virtioNet.hpp"
+#include <array>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tcp {
+
+// Per segment fields of an outgoing TCP segment, everything else comes from
+// the connection's SegmentTemplate.
+struct SegmentFields {
+    uint32_t seq;
+    uint32_t ack;
+    uint8_t flags;
+    uint16_t window;
+    // With virtio-net offload, a payload larger than this is handed to the
+    // kernel as one super segment that it cuts into segments of this size.
+    // 0 when the payload is a single segment anyway.
+    uint16_t mss = 0;
+};
+
+// SegmentTemplate is a prebuilt IPv4 + TCP header for one connection. The
+// addresses, ports, ttl and protocol never change for a connection, so they
+// are written (and their checksum contribution summed) once. Emitting a
+// segment then only patches the per segment fields and adds them to the
+// cached partial sums.
+//
+// With virtio-net offload every frame starts with a virtio_net_hdr, the TCP
+// checksum is left for the kernel to finish, and a payload may be up to
+// MaxSuperSegment bytes, for the kernel to segment (GSO).
+class SegmentTemplate {
+  public:
+    constexpr static size_t IPHeaderSize  = 20;
+    constexpr static size_t TCPHeaderSize = 20;
+    constexpr static size_t HeaderSize    = IPHeaderSize + TCPHeaderSize;
+    // TCP data offset is 4 bits of 32 bit words, so 60 - 20 bytes of options.
+    constexpr static size_t MaxOptionsSize = 40;
+    constexpr static size_t MaxHeaderSize  = HeaderSize + MaxOptionsSize;
+    // In front of every frame with offload.
+    constexpr static size_t VnetHdrSize = sizeof(VirtioNetHdr);
+    // Largest payload of a super segment, IPv4 total length is 16 bits.
+    constexpr static size_t MaxSuperSegment = 65535 - MaxHeaderSize;
+
+    // Offsets of fields from the start of the IP header.
+    constexpr static size_t IPChecksumOffset  = 10;
+    constexpr static size_t SeqOffset         = IPHeaderSize + 4;
+    constexpr static size_t TCPChecksumOffset = IPHeaderSize + 16;
+
+    SegmentTemplate() = default;
+
+    // local is the source of emitted segments and remote the destination.
+    // `vnetHdr` turns on virtio-net offload.
+    SegmentTemplate(const Socket& local,
+                    const Socket& remote,
+                    uint8_t ttl,
+                    bool vnetHdr = false);
+
+    // Most bytes a frame takes on top of its payload.
+    [[nodiscard]] size_t maxOverhead() const noexcept {
+        return prefix + MaxHeaderSize;
+    }
+
+    // Size of the frame emit produces for these options and payload.
+    [[nodiscard]] size_t frameSize(size_t optionsLen,
+                                   size_t payloadLen) const noexcept {
+        return prefix + HeaderSize + optionsLen + payloadLen;
+    }
+
+    // Writes a full frame (virtio-net header if any, headers, options and
+    // payload) to `out`, which must have room for maxOverhead() + payload
+    // bytes. `options` must be padded to a multiple of 4 bytes. The payload
+    // may come in two pieces (as it does from a wrapped ring buffer),
+    // `payloadTail` follows `payload`. Returns the number of bytes written.
+    size_t emit(uint8_t* out,
+                const SegmentFields& fields,
+                std::span<const uint8_t> options,
+                std::span<const uint8_t> payload,
+                std::span<const uint8_t> payloadTail = {}) const noexcept;
+
+  private:
+    std::array<uint8_t, HeaderSize> header{};
+    // Unfolded sums of the constant fields: the IP header without tot_len,
+    // the TCP pseudo header without the length, and that plus the ports.
+    uint64_t ipSum     = 0;
+    uint64_t pseudoSum = 0;
+    uint64_t tcpSum    = 0;
+    // Bytes in front of the IP header, the virtio-net header if enabled.
+    size_t prefix = 0;
+};
+
+} // namespace tcp
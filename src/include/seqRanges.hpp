@@ -0,0 +1,62 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tcp {
+
+// SeqRangeList is a short sorted list of disjoint [start, end) sequence
+// number ranges, merged as they are added. It backs the receive side's
+// reassembly queue and the send side's SACK scoreboard.
+//
+// Comparisons are wrap aware, so all ranges must lie within 2^31 of each
+// other, which a TCP window guarantees.
+class SeqRangeList {
+  public:
+    struct Range {
+        uint32_t start; // First sequence number.
+        uint32_t end;   // One past the last.
+    };
+
+    explicit SeqRangeList(size_t maxRanges) noexcept : maxRanges(maxRanges) {
+    }
+
+    // Adds [start, end), merging it with every range it overlaps or
+    // touches. Returns false, changing nothing, if it would take a new range
+    // beyond maxRanges.
+    bool add(uint32_t start, uint32_t end);
+
+    // Forgets everything before `seq`.
+    void trim(uint32_t seq) noexcept;
+
+    void clear() noexcept {
+        list.clear();
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return list.empty();
+    }
+
+    [[nodiscard]] std::span<const Range> ranges() const noexcept {
+        return list;
+    }
+
+    // Bytes covered by all ranges.
+    [[nodiscard]] size_t bytes() const noexcept;
+
+    // The range containing `seq`, if any.
+    [[nodiscard]] std::optional<Range> find(uint32_t seq) const noexcept;
+
+    // The first part of [from, to) that no range covers, if any.
+    [[nodiscard]] std::optional<Range> firstGap(uint32_t from,
+                                                uint32_t to) const noexcept;
+
+  private:
+    std::vector<Range> list;
+    size_t maxRanges;
+};
+
+} // namespace tcp
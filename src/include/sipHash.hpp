@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <random>
+#include <stddef.h>
+#include <stdint.h>
+
+// SipHash-2-4, the keyed hash behind SYN cookies and initial sequence
+// numbers: short inputs, and an output an attacker can't predict without the
+// key.
+namespace tcp::sipHash {
+
+using Key = std::array<uint64_t, 2>;
+
+struct State {
+    uint64_t v0, v1, v2, v3;
+
+    void round() noexcept {
+        v0 += v1;
+        v1 = std::rotl(v1, 13) ^ v0;
+        v0 = std::rotl(v0, 32);
+        v2 += v3;
+        v3 = std::rotl(v3, 16) ^ v2;
+        v0 += v3;
+        v3 = std::rotl(v3, 21) ^ v0;
+        v2 += v1;
+        v1 = std::rotl(v1, 17) ^ v2;
+        v2 = std::rotl(v2, 32);
+    }
+
+    void compress(uint64_t m) noexcept {
+        v3 ^= m;
+        round();
+        round();
+        v0 ^= m;
+    }
+};
+
+// SipHash-2-4 of `words` as little endian bytes.
+template <size_t N>
+[[nodiscard]] uint64_t hash(const Key& key,
+                            const std::array<uint64_t, N>& words) noexcept {
+    State s{
+        .v0 = key[0] ^ 0x736f6d6570736575,
+        .v1 = key[1] ^ 0x646f72616e646f6d,
+        .v2 = key[0] ^ 0x6c7967656e657261,
+        .v3 = key[1] ^ 0x7465646279746573,
+    };
+    for (auto m : words) {
+        s.compress(m);
+    }
+    s.compress(static_cast<uint64_t>(N * 8) << 56);
+    s.v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) {
+        s.round();
+    }
+    return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+[[nodiscard]] inline Key randomKey() {
+    std::random_device rd;
+    Key key;
+    for (auto& word : key) {
+        word = static_cast<uint64_t>(rd()) << 32 | rd();
+    }
+    return key;
+}
+
+} // namespace tcp::sipHash
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "tins/ip_address.h"
+#include <functional>
+#include <stddef.h>
 #include <stdint.h>
+
 namespace tcp {
 
 // Socket is an endpoint for a connection.
@@ -21,21 +24,47 @@ struct SocketPair {
     }
 };
 
+// FlowKey is a SocketPair packed into 96 bits, for hashing and comparing
+// without going through Tins::IPv4Address.
+struct FlowKey {
+    uint32_t srcAddr; // Network order, as IPv4Address converts.
+    uint32_t dstAddr;
+    uint32_t ports; // src port << 16 | dst port.
+
+    [[nodiscard]] static FlowKey from(const SocketPair& pair) noexcept {
+        return {
+            .srcAddr = static_cast<uint32_t>(pair.src.addr),
+            .dstAddr = static_cast<uint32_t>(pair.dst.addr),
+            .ports   = static_cast<uint32_t>(pair.src.port) << 16 |
+                     pair.dst.port,
+        };
+    }
+
+    [[nodiscard]] bool operator==(const FlowKey&) const noexcept = default;
+
+    // Multiply-xorshift mix of the key, good in both the low and the high
+    // bits.
+    [[nodiscard]] uint64_t hash() const noexcept {
+        uint64_t h = (static_cast<uint64_t>(srcAddr) << 32 | dstAddr) *
+                     0x9e3779b97f4a7c15;
+        h ^= (h >> 32) ^ (static_cast<uint64_t>(ports) * 0xc2b2ae3d27d4eb4f);
+        h *= 0xd6e8feb86659fd93;
+        return h ^ (h >> 32);
+    }
+};
+
 } // namespace tcp
 
 template <>
 struct std::hash<tcp::Socket> {
-    std::size_t operator()(const tcp::Socket& k) const {
-        using std::hash;
-        return hash<std::string>()(k.addr.to_string()) ^
-               (hash<uint16_t>()(k.port) << 1);
+    std::size_t operator()(const tcp::Socket& k) const noexcept {
+        return tcp::FlowKey{static_cast<uint32_t>(k.addr), 0, k.port}.hash();
     }
 };
 
 template <>
 struct std::hash<tcp::SocketPair> {
-    std::size_t operator()(const tcp::SocketPair& k) const {
-        using std::hash;
-        return hash<tcp::Socket>()(k.src) ^ (hash<tcp::Socket>()(k.dst) << 1);
+    std::size_t operator()(const tcp::SocketPair& k) const noexcept {
+        return tcp::FlowKey::from(k).hash();
     }
 };
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "endpoint.hpp"
+#include "socket.hpp"
+#include "stack.hpp"
+#include "tins/ip_address.h"
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <tl/expected.hpp>
+#include <vector>
+
+namespace tcp {
+
+enum class SocketError {
+    BadHandle,    // Not an open socket, or not the right kind.
+    WouldBlock,   // Nothing to recv or accept yet, or no room to send.
+    NotConnected, // Not established yet.
+    AddressInUse, // The port already has a listener.
+    Failed,       // The connection couldn't be opened, or was reset.
+    Closed,       // The peer closed, and everything it sent was read.
+};
+
+// SocketApi is the interface for applications embedding the stack: sockets
+// are plain handles, like file descriptors, and every call is non blocking.
+// A Poller tells when a socket is worth calling again.
+//
+// Calls can be made from any thread. They only touch the socket's Endpoint
+// and post to the shard owning the connection, so applications never run
+// on, or wait for, a shard's loop.
+class SocketApi {
+  public:
+    // `localIP` is the stack's address, the source of every connection.
+    // The stack has to outlive SocketApi.
+    SocketApi(Stack& stack, const Tins::IPv4Address& localIP) noexcept
+        : stack(stack), localIP(localIP) {
+    }
+
+    // Takes the connections peers open to `port` from now on. They queue
+    // on the returned socket until accepted.
+    [[nodiscard]] tl::expected<SocketHandle, SocketError>
+    listen(uint16_t port);
+
+    // An established connection from a listening socket's queue.
+    [[nodiscard]] tl::expected<SocketHandle, SocketError>
+    accept(SocketHandle listener);
+
+    // Opens a connection from `localPort` to `remote`. The socket becomes
+    // writable once it is established.
+    [[nodiscard]] tl::expected<SocketHandle, SocketError>
+    connect(const Socket& remote, uint16_t localPort);
+
+    // Reads up to out.size() received bytes.
+    [[nodiscard]] tl::expected<size_t, SocketError>
+    recv(SocketHandle handle, std::span<uint8_t> out);
+
+    // Queues as much of `data` as the send buffer has room for, and returns
+    // how much. While it's full, WouldBlock: the socket becomes Writable
+    // again once ACKs made room.
+    tl::expected<size_t, SocketError> send(SocketHandle handle,
+                                           std::span<const uint8_t> data);
+
+    // Gives the socket up, closing its connection: the FIN follows whatever
+    // was sent before. Connections that a listener hadn't handed out yet go
+    // back to the shell.
+    tl::expected<void, SocketError> close(SocketHandle handle);
+
+    // Has `poller` report the socket when it's ready for something in
+    // `interest` (Readiness bits). Failed is always reported.
+    tl::expected<void, SocketError>
+    watch(Poller& poller, SocketHandle handle, uint32_t interest);
+
+    tl::expected<void, SocketError> unwatch(SocketHandle handle);
+
+  private:
+    struct Entry {
+        std::shared_ptr<Endpoint> endpoint;
+        bool listener   = false;
+        Poller* watcher = nullptr;
+    };
+
+    [[nodiscard]] SocketHandle add(std::shared_ptr<Endpoint> endpoint,
+                                   bool listener);
+    // The open socket behind `handle`, or null.
+    [[nodiscard]] Entry* find(SocketHandle handle);
+
+    Stack& stack;
+    Tins::IPv4Address localIP;
+
+    std::mutex mutex;
+    // Indexed by handle.
+    std::vector<Entry> sockets;
+    std::vector<SocketHandle> freeHandles;
+};
+
+} // namespace tcp
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "capture.hpp"
+#include "connection.hpp"
+#include "endpoint.hpp"
+#include "histogram.hpp"
+#include "linkDevice.hpp"
+#include "scheduler.hpp"
+#include "socket.hpp"
+#include "stats.hpp"
+#include "tins/ip_address.h"
+#include "tunDevice.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tcp {
+
+// Stack runs one ConnectionManager shard per link, usually a tun queue, each
+// on its own thread pinned to its own core. A flow is owned by exactly one
+// shard, picked by hashing its SocketPair, so connection state is never
+// shared between threads.
+class Stack {
+  public:
+    // Stack expects the device to stay alive as long as Stack is in scope.
+    Stack(TunDevice& tun, const Tins::IPv4Address& tunIP);
+
+    // A shard per link, e.g. one end of a MemoryLink pair. `vnetHdr` says
+    // whether frames carry a virtio-net header.
+    Stack(std::vector<std::unique_ptr<LinkDevice>> links,
+          const Tins::IPv4Address& ip,
+          size_t mtu   = ConnectionManager::DefaultMTU,
+          bool vnetHdr = false);
+
+    // Runs every shard and blocks for as long as they run.
+    void run() noexcept;
+
+    // Makes run() return. Can be called from any thread.
+    void stop() noexcept {
+        for (auto& shard : shards) {
+            shard->stop();
+        }
+    }
+
+    void send(const SocketPair& connSockets, const std::string& data) noexcept {
+        shardFor(connSockets).send(connSockets, data);
+    }
+
+    void open(const SocketPair& connSockets,
+              std::shared_ptr<Endpoint> endpoint = nullptr) noexcept {
+        shardFor(connSockets).open(connSockets, std::move(endpoint));
+    }
+
+    // Starts `task` on shard `shardId`'s thread.
+    void spawn(Task task, size_t shardId = 0) noexcept {
+        shards[shardId % shards.size()]->spawn(std::move(task));
+    }
+
+    void withConnection(const SocketPair& connSockets,
+                        std::function<void(Connection&)> fn) noexcept {
+        shardFor(connSockets).withConnection(connSockets, std::move(fn));
+    }
+
+    // Connections established on `port` from now on are queued on
+    // `listener` for an application to accept, instead of going to the
+    // shell. Returns false if the port already has a listener.
+    bool listen(uint16_t port, std::shared_ptr<Endpoint> listener);
+
+    void unlisten(uint16_t port);
+
+    // Bounds the half-open connections of every shard, see SynQueueConfig.
+    void setSynQueue(const SynQueueConfig& config) noexcept {
+        for (auto& shard : shards) {
+            shard->setSynQueue(config);
+        }
+    }
+
+    // Resets connections that received nothing for `timeout`, 0 never does.
+    void setIdleTimeout(std::chrono::seconds timeout) noexcept {
+        for (auto& shard : shards) {
+            shard->setIdleTimeout(timeout);
+        }
+    }
+
+    // Starts capturing what every shard reads and writes, replacing any
+    // capture already running. Throws std::runtime_error if the file can't
+    // be created.
+    void startCapture(const CaptureConfig& config);
+
+    // Stops capturing. The file is complete once every shard let go of the
+    // capture, shortly after.
+    void stopCapture() noexcept;
+
+    // Counters of the running capture, if any.
+    [[nodiscard]] std::optional<CaptureStats> captureStats();
+
+    // The state of every connection, from the shards that answered within
+    // `timeout`. A shard busy for longer is left out.
+    [[nodiscard]] std::vector<ConnectionInfo>
+    connections(std::chrono::milliseconds timeout);
+
+    // Percentiles of every stage of the packet path, over all shards and
+    // since they started.
+    [[nodiscard]] std::vector<LatencySummary> latency() const;
+
+    // Every shard's counters, its inbox depth, stage latencies and the state
+    // of every connection in the Prometheus text format.
+    [[nodiscard]] std::string prometheus(std::chrono::milliseconds timeout);
+
+    // Writes prometheus() to `path` every `interval`, replacing any export
+    // already running.
+    void startStatsExport(const std::string& path,
+                          std::chrono::milliseconds interval);
+
+    void stopStatsExport() noexcept;
+
+    // Hands a connection an application let go of back to the shell.
+    void detach(std::shared_ptr<Endpoint> endpoint) noexcept;
+
+    // Detaches a connection an application closed, and closes it.
+    void close(std::shared_ptr<Endpoint> endpoint) noexcept;
+
+    // The listener on `port`, if any. Called by shards.
+    [[nodiscard]] std::shared_ptr<Endpoint> listener(uint16_t port);
+
+    [[nodiscard]] SocketPair getLastRecv() noexcept {
+        return shards[lastShard.load(std::memory_order_relaxed)]
+            ->getLastRecv();
+    }
+
+    [[nodiscard]] ConnectionManager&
+    shardFor(const SocketPair& connSockets) noexcept {
+        return *shards[std::hash<SocketPair>()(connSockets) % shards.size()];
+    }
+
+    [[nodiscard]] ConnectionManager& shard(size_t shardId) noexcept {
+        return *shards[shardId];
+    }
+
+    [[nodiscard]] size_t numShards() const noexcept {
+        return shards.size();
+    }
+
+    // Called by a shard when the flow it last received on changes.
+    void setLastShard(size_t shardId) noexcept {
+        lastShard.store(shardId, std::memory_order_relaxed);
+    }
+
+  private:
+    // Declared before the shards, which use them.
+    std::vector<std::unique_ptr<LinkDevice>> links;
+    std::vector<std::unique_ptr<ConnectionManager>> shards;
+    std::atomic<size_t> lastShard = 0;
+
+    std::mutex listenersMutex;
+    std::unordered_map<uint16_t, std::shared_ptr<Endpoint>> listeners;
+
+    // Frames start with a virtio-net header.
+    bool vnetHdr = false;
+    std::mutex captureMutex;
+    std::shared_ptr<Capture> capture;
+
+    // Last, so it stops before the shards it reads go away.
+    std::mutex exporterMutex;
+    std::unique_ptr<StatsExporter> exporter;
+};
+
+} // namespace tcp
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "socket.hpp"
+#include "tcp.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+namespace tcp {
+
+// Counter is a statistic with a single writer, the shard it belongs to, and
+// any number of readers. The writer adds with a relaxed load and store rather
+// than an atomic increment, so counting costs as much as a plain add and
+// never bounces a cache line between cores.
+class Counter {
+  public:
+    void add(uint64_t n = 1) noexcept {
+        value.store(value.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+
+    void set(uint64_t v) noexcept {
+        value.store(v, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t get() const noexcept {
+        return value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<uint64_t> value = 0;
+};
+
+// A metric as exported, see ShardStats::visit.
+struct MetricInfo {
+    enum class Type : uint8_t {
+        Counter, // Only ever goes up.
+        Gauge,
+    };
+
+    const char* name; // Without the netstack_ prefix.
+    const char* help;
+    Type type;
+};
+
+// Counters of one shard, written by its loop thread only. Aligned so shards
+// next to each other don't share a cache line.
+struct alignas(64) ShardStats {
+    Counter packetsIn;         // Frames read from the link.
+    Counter bytesIn;           // Bytes of those frames.
+    Counter packetsOut;        // Segments sent, retransmissions included.
+    Counter bytesOut;          // Bytes of those segments.
+    Counter retransmits;       // Segments sent again.
+    Counter rtoTimeouts;       // Retransmission timer expiries.
+    Counter outOfOrder;        // Segments queued ahead of rcv.nxt.
+    Counter parseDrops;        // Frames that aren't valid IPv4 + TCP.
+    Counter checksumDrops;     // Packets with a bad IP or TCP checksum.
+    Counter invalidDrops;      // Segments outside the window or unacceptable.
+    Counter activeOpens;       // SYNs sent by open.
+    Counter passiveOpens;      // SYNs answered with a SYN-ACK.
+    Counter established;       // Handshakes completed.
+    Counter handshakeFails;    // Opens that failed to start.
+    Counter handshakeTimeouts; // Handshakes never completed.
+    Counter synCookiesSent;    // SYNs answered statelessly.
+    Counter synCookiesValid;   // Connections set up from a cookie.
+    Counter synDrops;          // SYNs dropped, the SYN queue being full.
+    Counter resetsIn;          // Connections reset by the peer.
+    Counter resetsOut;         // RSTs sent.
+    Counter idleTimeouts;      // Connections reset for idling.
+    Counter connections;       // Connections in the shard's table.
+    Counter halfOpen;          // Connections in SYN-RECEIVED.
+    Counter timeWait;          // Flows in TIME-WAIT.
+
+    // Calls fn(const MetricInfo&, uint64_t) for every counter.
+    template <typename F>
+    void visit(F&& fn) const {
+        using T = MetricInfo::Type;
+        fn({"packets_in_total", "Frames read.", T::Counter}, packetsIn.get());
+        fn({"bytes_in_total", "Bytes read.", T::Counter}, bytesIn.get());
+        fn({"packets_out_total", "Segments sent.", T::Counter},
+           packetsOut.get());
+        fn({"bytes_out_total", "Bytes sent.", T::Counter}, bytesOut.get());
+        fn({"retransmits_total", "Segments sent again.", T::Counter},
+           retransmits.get());
+        fn({"rto_timeouts_total", "Retransmission timeouts.", T::Counter},
+           rtoTimeouts.get());
+        fn({"out_of_order_total", "Segments received early.", T::Counter},
+           outOfOrder.get());
+        fn({"parse_drops_total", "Frames not IPv4 and TCP.", T::Counter},
+           parseDrops.get());
+        fn({"checksum_drops_total", "Packets with a bad checksum.",
+            T::Counter},
+           checksumDrops.get());
+        fn({"invalid_drops_total", "Unacceptable segments.", T::Counter},
+           invalidDrops.get());
+        fn({"active_opens_total", "Connections opened.", T::Counter},
+           activeOpens.get());
+        fn({"passive_opens_total", "SYNs answered.", T::Counter},
+           passiveOpens.get());
+        fn({"established_total", "Handshakes completed.", T::Counter},
+           established.get());
+        fn({"handshake_failures_total", "Failed opens.", T::Counter},
+           handshakeFails.get());
+        fn({"handshake_timeouts_total", "Handshakes timed out.", T::Counter},
+           handshakeTimeouts.get());
+        fn({"syn_cookies_sent_total", "SYNs answered with a cookie.",
+            T::Counter},
+           synCookiesSent.get());
+        fn({"syn_cookies_valid_total", "Opens completed by a cookie.",
+            T::Counter},
+           synCookiesValid.get());
+        fn({"syn_drops_total", "SYNs dropped by a full queue.", T::Counter},
+           synDrops.get());
+        fn({"resets_in_total", "Connections reset by the peer.", T::Counter},
+           resetsIn.get());
+        fn({"resets_out_total", "RSTs sent.", T::Counter}, resetsOut.get());
+        fn({"idle_timeouts_total", "Connections reset for idling.", T::Counter},
+           idleTimeouts.get());
+        fn({"connections", "Connections in the table.", T::Gauge},
+           connections.get());
+        fn({"half_open", "Connections in SYN-RECEIVED.", T::Gauge},
+           halfOpen.get());
+        fn({"time_wait", "Flows in TIME-WAIT.", T::Gauge}, timeWait.get());
+    }
+};
+
+// Smoothed round trip time of a connection (RFC 6298 2).
+struct RttEstimator {
+    using Duration = std::chrono::steady_clock::duration;
+
+    std::optional<Duration> srtt;
+    Duration rttvar{};
+
+    void sample(Duration r) noexcept {
+        if (!srtt) {
+            srtt   = r;
+            rttvar = r / 2;
+            return;
+        }
+        auto delta = *srtt > r ? *srtt - r : r - *srtt;
+        rttvar     = (3 * rttvar + delta) / 4;
+        srtt       = (7 * *srtt + r) / 8;
+    }
+};
+
+// The state of one connection at one point in time, for reporting.
+struct ConnectionInfo {
+    SocketPair pair;
+    State::Value state;
+    uint32_t sndUna;
+    uint32_t sndNxt;
+    uint32_t sndWnd;
+    uint32_t rcvNxt;
+    uint32_t rcvWnd;
+    uint32_t cwnd;
+    std::optional<RttEstimator::Duration> srtt;
+    uint64_t fastRetransmits;
+    uint64_t timeouts;
+};
+
+// StatsExporter writes `render()` to `path` every `interval` from its own
+// thread, through a temporary file renamed over the old one, so a reader
+// never sees half a snapshot.
+class StatsExporter {
+  public:
+    StatsExporter(std::string path,
+                  std::chrono::milliseconds interval,
+                  std::function<std::string()> render);
+    ~StatsExporter();
+
+    StatsExporter(const StatsExporter&)            = delete;
+    StatsExporter& operator=(const StatsExporter&) = delete;
+
+  private:
+    void run();
+    void write();
+
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::function<std::string()> render;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread thread;
+};
+
+} // namespace tcp
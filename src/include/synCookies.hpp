@@ -0,0 +1,68 @@
+#pragma once
+
+#include "sipHash.hpp"
+#include "socket.hpp"
+#include <array>
+#include <chrono>
+#include <optional>
+#include <stdint.h>
+
+namespace tcp {
+
+// How a shard answers SYNs of flows it has no connection for.
+struct SynQueueConfig {
+    // Half-open connections (SYN-RECEIVED) the shard keeps state for. SYNs
+    // beyond it are answered with a SYN cookie, or dropped if cookies are
+    // off, so a SYN flood can't grow the flow table.
+    size_t maxHalfOpen = 1024;
+    bool cookies       = true;
+};
+
+// SynCookies keeps what a listener must remember about a SYN in the ISN of
+// its SYN-ACK instead (RFC 4987 3.6), so no state exists until the final ACK
+// proves the peer received the SYN-ACK. A cookie is
+//
+//     | time (5 bits) | MSS index (3 bits) | MAC (24 bits) |
+//
+// where time counts Periods and the MAC is SipHash-2-4, keyed with a random
+// secret, of the flow, the peer's ISN and the time. The peer's MSS is kept
+// to within MssTable, its window scale and SACK-Permitted are lost: the
+// SYN-ACK doesn't offer them.
+class SynCookies {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Draws a random secret.
+    SynCookies();
+
+    // The cookie for a SYN with `peerIss` and the peer's MSS on `flow`,
+    // oriented from us to the peer.
+    [[nodiscard]] uint32_t make(const FlowKey& flow,
+                                uint32_t peerIss,
+                                uint16_t mss,
+                                Clock::time_point now) const noexcept;
+
+    // The MSS `cookie` encodes if it was made for `flow` and `peerIss` less
+    // than two Periods ago.
+    [[nodiscard]] std::optional<uint16_t>
+    check(const FlowKey& flow,
+          uint32_t peerIss,
+          uint32_t cookie,
+          Clock::time_point now) const noexcept;
+
+    constexpr static auto Period = std::chrono::seconds(64);
+
+    // MSS values a cookie can carry, common ones from IPv4 over tunnels to
+    // jumbo frames.
+    constexpr static std::array<uint16_t, 8> MssTable = {
+        536, 1220, 1360, 1400, 1440, 1460, 4312, 8960};
+
+  private:
+    [[nodiscard]] uint32_t mac(const FlowKey& flow,
+                               uint32_t peerIss,
+                               uint32_t time) const noexcept;
+
+    sipHash::Key secret;
+};
+
+} // namespace tcp
@@ -1,12 +1,10 @@
 #pragma once
 
-#include "threadPool.hpp"
-#include "tins/ip.h"
-#include "tins/tcp.h"
 #include <map>
 #include <memory>
 #include <stddef.h>
 #include <stdint.h>
+#include <string>
 #include <type_traits>
 #include <unordered_map>
 
@@ -14,43 +12,95 @@ namespace tcp {
 
 constexpr inline int ProtocolNumInIP = 6;
 
-class Connection;
+// Sequence number comparisons, modulo 2^32 as sequence numbers wrap.
+[[nodiscard]] constexpr bool seqLT(uint32_t a, uint32_t b) noexcept {
+    return static_cast<int32_t>(a - b) < 0;
+}
 
-// State is an abstract class for possible states in TCP FSM.
-class State {
-  public:
-    enum class Value : uint8_t;
+[[nodiscard]] constexpr bool seqLEQ(uint32_t a, uint32_t b) noexcept {
+    return static_cast<int32_t>(a - b) <= 0;
+}
 
-    [[nodiscard]] virtual Value onOpen(Connection&) const noexcept {
-        return stateValue;
-    }
-    [[nodiscard]] virtual Value
-    onPacket(Connection&, const Tins::IP&, const Tins::TCP&) const noexcept {
-        return stateValue;
-    }
-    [[nodiscard]] virtual Value onSend(Connection& conn,
-                                       const std::string& data,
-                                       ThreadPool& threadPool) const noexcept {
-        return stateValue;
-    }
+[[nodiscard]] constexpr bool seqGT(uint32_t a, uint32_t b) noexcept {
+    return seqLT(b, a);
+}
 
-    [[nodiscard]] Value currentState() const noexcept {
-        return stateValue;
-    }
+[[nodiscard]] constexpr bool seqGEQ(uint32_t a, uint32_t b) noexcept {
+    return seqLEQ(b, a);
+}
 
-    virtual ~State() {
-    }
+class Connection;
+struct PacketView;
 
-  public:
+// State names the states of the TCP FSM (RFC 793 3.2). A connection keeps
+// just this byte, the behaviour of each state lives in the stateless types
+// of tcpStates.hpp.
+struct State {
     enum class Value : uint8_t {
         Closed,
         Listen,
         SynRcvd,
         SynSent,
         Established,
+        FinWait1,
+        FinWait2,
+        CloseWait,
+        Closing,
+        LastAck,
+        TimeWait,
     };
 
-  protected:
-    Value stateValue;
+    // The state's name as RFC 793 spells it.
+    [[nodiscard]] constexpr static const char* name(Value v) noexcept {
+        switch (v) {
+        case Value::Closed:
+            return "CLOSED";
+        case Value::Listen:
+            return "LISTEN";
+        case Value::SynRcvd:
+            return "SYN-RECEIVED";
+        case Value::SynSent:
+            return "SYN-SENT";
+        case Value::Established:
+            return "ESTABLISHED";
+        case Value::FinWait1:
+            return "FIN-WAIT-1";
+        case Value::FinWait2:
+            return "FIN-WAIT-2";
+        case Value::CloseWait:
+            return "CLOSE-WAIT";
+        case Value::Closing:
+            return "CLOSING";
+        case Value::LastAck:
+            return "LAST-ACK";
+        case Value::TimeWait:
+            return "TIME-WAIT";
+        }
+        return "?";
+    }
+};
+
+// StateBase gives state V default handlers, which ignore the event and stay
+// in V. A state hides the ones it handles with its own static functions.
+template <State::Value V>
+struct StateBase {
+    using Value = State::Value;
+
+    constexpr static Value value = V;
+
+    [[nodiscard]] static Value onOpen(Connection&) noexcept {
+        return V;
+    }
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept {
+        return V;
+    }
+    [[nodiscard]] static Value onSend(Connection&,
+                                      const std::string&) noexcept {
+        return V;
+    }
+    [[nodiscard]] static Value onClose(Connection&) noexcept {
+        return V;
+    }
 };
 } // namespace tcp
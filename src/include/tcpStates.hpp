@@ -1,69 +1,120 @@
 #pragma once
 
+#include "packet.hpp"
 #include "tcp.hpp"
-#include "threadPool.hpp"
-#include "tins/ip.h"
-#include "tins/tcp.h"
+#include <string>
 namespace tcp {
 
-// Note: When adding new state impls, make sure to add check in connection.hpp
-// in switchState.
+// Each state is a stateless type with static handlers, dispatched on the
+// connection's State::Value by visitState, so transitions don't allocate
+// and events cost a switch rather than a virtual call.
+//
+// Note: When adding new state impls, make sure to add them to visitState.
 
-class ClosedState : public State {
-  public:
-    ClosedState() {
-        stateValue = State::Value::Closed;
-    }
-};
+struct ClosedState : StateBase<State::Value::Closed> {};
 
-class SynSentState : public State {
+struct SynSentState : StateBase<State::Value::SynSent> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
+    [[nodiscard]] static Value onClose(Connection&) noexcept;
+};
 
-  public:
-    SynSentState() {
-        stateValue = State::Value::SynSent;
-    }
+struct ListenState : StateBase<State::Value::Listen> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
+    [[nodiscard]] static Value onOpen(Connection&) noexcept;
+    [[nodiscard]] static Value onClose(Connection&) noexcept;
+};
 
-    [[nodiscard]] Value onPacket(Connection&,
-                                 const Tins::IP&,
-                                 const Tins::TCP&) const noexcept override;
+struct SynRcvdState : StateBase<State::Value::SynRcvd> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
+    [[nodiscard]] static Value onClose(Connection&) noexcept;
 };
 
-class ListenState : public State {
-  public:
-    ListenState() {
-        stateValue = State::Value::Listen;
-    }
+struct EstablishedState : StateBase<State::Value::Established> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
+
+    // Takes the data and FIN of the ACK that completed a passive open, once
+    // the connection entered ESTABLISHED and met its application.
+    [[nodiscard]] static Value onHandshakeAck(Connection&,
+                                              const PacketView&) noexcept;
 
-    [[nodiscard]] Value onPacket(Connection&,
-                                 const Tins::IP&,
-                                 const Tins::TCP&) const noexcept override;
-    [[nodiscard]] Value onOpen(Connection&) const noexcept override;
+    [[nodiscard]] static Value onSend(Connection&,
+                                      const std::string&) noexcept;
+
+    [[nodiscard]] static Value onClose(Connection&) noexcept;
 };
 
-class SynRcvdState : public State {
-  public:
-    SynRcvdState() {
-        stateValue = State::Value::SynRcvd;
-    }
+// Our FIN is queued or sent, the peer may still send.
+struct FinWait1State : StateBase<State::Value::FinWait1> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
+};
 
-    [[nodiscard]] Value onPacket(Connection&,
-                                 const Tins::IP&,
-                                 const Tins::TCP&) const noexcept override;
+// Our FIN was acked, waiting for the peer's.
+struct FinWait2State : StateBase<State::Value::FinWait2> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
 };
 
-class EstablishedState : public State {
-  public:
-    EstablishedState() {
-        stateValue = State::Value::Established;
-    }
+// The peer closed, we may still send.
+struct CloseWaitState : StateBase<State::Value::CloseWait> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
 
-    [[nodiscard]] Value onPacket(Connection&,
-                                 const Tins::IP&,
-                                 const Tins::TCP&) const noexcept override;
+    [[nodiscard]] static Value onSend(Connection&,
+                                      const std::string&) noexcept;
 
-    [[nodiscard]] Value onSend(Connection&,
-                               const std::string&,
-                               ThreadPool&) const noexcept override;
+    [[nodiscard]] static Value onClose(Connection&) noexcept;
 };
 
+// Both sides sent a FIN at once, waiting for ours to be acked.
+struct ClosingState : StateBase<State::Value::Closing> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
+};
+
+// The peer closed first, waiting for our FIN to be acked.
+struct LastAckState : StateBase<State::Value::LastAck> {
+    [[nodiscard]] static Value onPacket(Connection&,
+                                        const PacketView&) noexcept;
+};
+
+// Connections leave the flow table on entering TIME-WAIT, an entry of the
+// shard's TimeWaitTable stands in for them.
+struct TimeWaitState : StateBase<State::Value::TimeWait> {};
+
+// Calls fn with an instance of the type implementing `state`, and returns
+// what it returns, the state to move to.
+template <typename F>
+[[nodiscard]] State::Value visitState(State::Value state, F&& fn) noexcept {
+    switch (state) {
+    case State::Value::Listen:
+        return fn(ListenState{});
+    case State::Value::SynRcvd:
+        return fn(SynRcvdState{});
+    case State::Value::SynSent:
+        return fn(SynSentState{});
+    case State::Value::Established:
+        return fn(EstablishedState{});
+    case State::Value::FinWait1:
+        return fn(FinWait1State{});
+    case State::Value::FinWait2:
+        return fn(FinWait2State{});
+    case State::Value::CloseWait:
+        return fn(CloseWaitState{});
+    case State::Value::Closing:
+        return fn(ClosingState{});
+    case State::Value::LastAck:
+        return fn(LastAckState{});
+    case State::Value::TimeWait:
+        return fn(TimeWaitState{});
+    case State::Value::Closed:
+    default:
+        return fn(ClosedState{});
+    }
+}
+
 } // namespace tcp
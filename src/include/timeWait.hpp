@@ -0,0 +1,59 @@
+#pragma once
+
+#include "flowTable.hpp"
+#include "socket.hpp"
+#include <chrono>
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tcp {
+
+// TimeWaitTable keeps what a shard must remember of a connection in
+// TIME-WAIT for 2 MSL after it closed: the sequence numbers to ACK a
+// retransmitted FIN with, and to tell a new SYN of the flow from an old
+// duplicate. That's a few bytes a flow rather than a whole Connection, which
+// is erased as soon as it gets here.
+class TimeWaitTable {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        uint32_t sndNxt; // Past our FIN.
+        uint32_t rcvNxt; // Past the peer's FIN.
+        Clock::time_point expires;
+    };
+
+    // 2 MSL, with an MSL of 30 seconds as Linux has.
+    constexpr static auto Duration = std::chrono::seconds(60);
+
+    // Enters `flow` into TIME-WAIT, or restarts its wait if it's there.
+    void add(const FlowKey& flow,
+             uint32_t sndNxt,
+             uint32_t rcvNxt,
+             Clock::time_point now);
+
+    [[nodiscard]] Entry* find(const FlowKey& flow) noexcept {
+        return entries.find(flow);
+    }
+
+    void erase(const FlowKey& flow) {
+        entries.erase(flow);
+    }
+
+    // Drops the entries whose wait is over by `now`.
+    void expire(Clock::time_point now);
+
+    [[nodiscard]] size_t size() const noexcept {
+        return entries.size();
+    }
+
+  private:
+    FlowTable<Entry> entries;
+    // Flows in the order they entered, which is the order they expire in
+    // since they all wait as long. A flow that entered again, or left early,
+    // has an entry here that doesn't match the table's.
+    std::deque<std::pair<FlowKey, Clock::time_point>> order;
+};
+
+} // namespace tcp
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+namespace tcp {
+
+class TimerWheel;
+
+// Timer is an intrusive timer node, owned by whoever needs the timeout (a
+// connection for its retransmission timer, etc). The callback is set once and
+// the timer can then be armed and cancelled any number of times without
+// allocating. Destroying an armed timer cancels it.
+class Timer {
+  public:
+    using Callback = std::function<void()>;
+
+    Timer() = default;
+    explicit Timer(Callback cb) : callback(std::move(cb)) {
+    }
+    ~Timer();
+
+    Timer(const Timer&)            = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    void setCallback(Callback cb) {
+        callback = std::move(cb);
+    }
+
+    [[nodiscard]] bool armed() const noexcept {
+        return wheel != nullptr;
+    }
+
+  private:
+    friend class TimerWheel;
+
+    Callback callback;
+    Timer* prev        = nullptr;
+    Timer* next        = nullptr;
+    TimerWheel* wheel  = nullptr;
+    uint64_t expiresAt = 0; // In ticks.
+    uint8_t level      = 0;
+    uint8_t slot       = 0;
+};
+
+// TimerWheel is a hierarchical timing wheel (Varghese & Lauck) driven by the
+// loop that owns it. Arm and cancel are O(1) list operations, and expiring
+// costs O(1) per tick plus an occasional cascade of a higher level slot down
+// into the lower levels.
+//
+// Not thread safe, it belongs to one event loop.
+class TimerWheel {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    constexpr static auto Tick = std::chrono::milliseconds(1);
+
+    TimerWheel() noexcept : TimerWheel(Clock::now()) {
+    }
+    explicit TimerWheel(Clock::time_point now) noexcept;
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&)            = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Arms (or re-arms) the timer to fire `after` from now. Times are rounded
+    // up to a whole tick.
+    void arm(Timer& timer, Clock::duration after) noexcept;
+    void cancel(Timer& timer) noexcept;
+
+    // Runs the callbacks of every timer that expired up to `now`.
+    void advance(Clock::time_point now = Clock::now());
+
+    // How long the loop can sleep before the wheel needs to be advanced, or
+    // nothing if no timer is armed. Timers on the upper levels are not
+    // looked at, so this may wake the loop early to cascade them.
+    [[nodiscard]] std::optional<Clock::duration>
+    nextTimeout(Clock::time_point now = Clock::now()) const noexcept;
+
+    [[nodiscard]] size_t size() const noexcept {
+        return count;
+    }
+
+  private:
+    constexpr static size_t LevelBits = 6;
+    constexpr static size_t Slots     = 1 << LevelBits;
+    constexpr static size_t Levels    = 4;
+    // Furthest a timer can be armed ahead, about 4.6 hours with 1ms ticks.
+    constexpr static uint64_t MaxTicks = (uint64_t(1) << (LevelBits * Levels));
+
+    struct Level {
+        std::array<Timer*, Slots> slots{};
+        uint64_t occupied = 0; // Bit per non empty slot.
+    };
+
+    [[nodiscard]] uint64_t toTicks(Clock::time_point t) const noexcept;
+    void insert(Timer& timer) noexcept;
+    void unlink(Timer& timer) noexcept;
+    void cascade(size_t level) noexcept;
+
+    std::array<Level, Levels> levels{};
+    Clock::time_point start;
+    uint64_t current = 0; // Last tick processed.
+    size_t count     = 0;
+};
+
+} // namespace tcp
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "socket.hpp"
+#include "tsc.hpp"
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Event tracing that can stay on in production. Every thread records fixed
+// size binary events into a ring of its own, nothing is formatted until the
+// rings are dumped. While tracing is off an event costs a relaxed load and a
+// branch, while it's on a timestamp counter read and a few stores.
+namespace tcp::trace {
+
+enum class Kind : uint8_t {
+    StateChange, // flags is the old state and len the new one.
+    SegmentIn,
+    SegmentOut,
+    Invalid,    // An unacceptable segment was dropped.
+    Retransmit, // Data from seq on was sent again, len bytes of it.
+    Timeout,    // The retransmission timer fired, len is the retry count.
+};
+
+struct Event {
+    uint64_t time; // tsc::now() ticks.
+    FlowKey flow;  // Ours first: src is the local end.
+    uint32_t seq;
+    uint32_t ack;
+    uint16_t len; // Payload bytes.
+    uint8_t flags;
+    Kind kind;
+};
+static_assert(sizeof(Event) == 32);
+
+// TraceRing keeps the last `capacity` events recorded by its thread, older
+// ones are overwritten. It has a single writer and can be read from any
+// thread while the writer goes on.
+class TraceRing {
+  public:
+    // `capacity` is rounded up to a power of two.
+    explicit TraceRing(size_t capacity);
+
+    // Called by the owning thread only.
+    void push(const Event& event) noexcept;
+
+    // The events in the ring, oldest first. Events being overwritten while
+    // they're copied are left out.
+    [[nodiscard]] std::vector<Event> snapshot() const;
+
+  private:
+    constexpr static size_t Words = sizeof(Event) / sizeof(uint64_t);
+
+    // Stored as words rather than an Event so a concurrent reader isn't a
+    // data race, relaxed stores compile to plain ones.
+    struct Slot {
+        std::atomic<uint64_t> words[Words];
+    };
+
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    // Events started and finished, the slot of event i is i & mask. They
+    // differ only while push runs.
+    std::atomic<uint64_t> claimed   = 0;
+    std::atomic<uint64_t> committed = 0;
+};
+
+// Set by enable and disable, read on every event.
+inline std::atomic<bool> active = false;
+
+[[nodiscard]] inline bool enabled() noexcept {
+    return active.load(std::memory_order_relaxed);
+}
+
+// Starts recording on every thread. A thread's ring is created on its first
+// event with room for `eventsPerThread` events and kept from then on, so
+// events recorded before disable can still be dumped.
+void enable(size_t eventsPerThread = 64 * 1024);
+
+void disable() noexcept;
+
+// Adds an event to the calling thread's ring. Callers check enabled()
+// first, so building the event costs nothing while tracing is off.
+void record(const Event& event) noexcept;
+
+// Writes every thread's events to `out` as text, merged in time order, one
+// per line. Can be called while tracing is on. Returns the event count.
+size_t dump(FILE* out);
+
+} // namespace tcp::trace
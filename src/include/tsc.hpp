@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cheap timestamps for measuring the packet path.
+namespace tcp::tsc {
+
+// Timestamp counter ticks: the TSC on x86, steady clock nanoseconds
+// elsewhere. Only differences mean anything, turned into time with
+// ticksPerNs.
+[[nodiscard]] inline uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+// Ticks of now() per nanosecond. Measured against the steady clock on the
+// first call, which takes CalibrationTime.
+[[nodiscard]] double ticksPerNs() noexcept;
+
+constexpr auto CalibrationTime = std::chrono::milliseconds(10);
+
+} // namespace tcp::tsc
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "tins/ip_address.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace tcp {
+
+// TunDevice is a linux tun interface opened with one or more queues. With
+// more than one queue the device is created with IFF_MULTI_QUEUE, every queue
+// gets its own fd, and the kernel spreads flows over them. libtuntap can only
+// open a single queue, which is why this talks to /dev/net/tun directly.
+//
+// With `vnetHdr` every frame read or written carries a virtio_net_hdr in
+// front of the IP packet (IFF_VNET_HDR). That lets us hand the kernel
+// segments with a partial checksum and super segments to cut up (GSO), and
+// the kernel is asked (TUNSETOFFLOAD) to hand us the same: skipping the
+// checksum and coalescing segments (GRO) before we see them.
+//
+// Like tuntap::tun, failures while setting up the device throw
+// std::runtime_error.
+class TunDevice {
+  public:
+    TunDevice(const std::string& name, size_t numQueues, bool vnetHdr = false);
+    ~TunDevice();
+
+    TunDevice(const TunDevice&)            = delete;
+    TunDevice& operator=(const TunDevice&) = delete;
+
+    void ip(const Tins::IPv4Address& addr, int prefixLen);
+    void up();
+    [[nodiscard]] int mtu() const;
+
+    [[nodiscard]] int queueFd(size_t i) const noexcept {
+        return fds[i];
+    }
+
+    [[nodiscard]] size_t numQueues() const noexcept {
+        return fds.size();
+    }
+
+    [[nodiscard]] const std::string& name() const noexcept {
+        return ifName;
+    }
+
+    [[nodiscard]] bool vnetHdr() const noexcept {
+        return hasVnetHdr;
+    }
+
+    // True if the kernel agreed to send us checksum offloaded and GRO
+    // coalesced frames. Transmit offloads work regardless.
+    [[nodiscard]] bool rxOffload() const noexcept {
+        return hasRxOffload;
+    }
+
+  private:
+    void closeQueues() noexcept;
+
+    std::string ifName;
+    std::vector<int> fds;
+    bool hasVnetHdr   = false;
+    bool hasRxOffload = false;
+};
+
+} // namespace tcp
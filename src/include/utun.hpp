@@ -72,6 +72,10 @@ class UTun {
         return n;
     }
 
+    int Fd() const noexcept {
+        return fd;
+    }
+
   private:
     sockaddr_ctl sc;
     ctl_info ctlInfo;
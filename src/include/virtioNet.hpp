@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace tcp {
+
+// VirtioNetHdr is the virtio_net_hdr that prefixes every frame of a tun opened
+// with IFF_VNET_HDR. <linux/virtio_net.h> can't be included from C++ (it has
+// a member named `class`), hence the copy. Fields are in host byte order, as
+// tun uses the legacy native endian header unless told otherwise.
+struct VirtioNetHdr {
+    // flags
+    constexpr static uint8_t NeedsCsum = 1; // Checksum from csumStart on.
+    constexpr static uint8_t DataValid = 2; // Checksum already verified.
+
+    // gsoType
+    constexpr static uint8_t GSONone  = 0;
+    constexpr static uint8_t GSOTCPv4 = 1;
+
+    uint8_t flags;
+    uint8_t gsoType;
+    uint16_t hdrLen;     // Bytes of headers to copy into every segment.
+    uint16_t gsoSize;    // Payload bytes per segment.
+    uint16_t csumStart;  // Where checksumming starts.
+    uint16_t csumOffset; // Where, after csumStart, the checksum goes.
+};
+
+static_assert(sizeof(VirtioNetHdr) == 10);
+
+} // namespace tcp
@@ -0,0 +1,69 @@
+#include "batch.hpp"
+#include "capture.hpp"
+#include "linkDevice.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace tcp;
+
+thread_local TxBatch* TxBatch::active = nullptr;
+
+size_t RxBatch::fill(LinkDevice& link) noexcept {
+    count = 0;
+    while (count < lens.size()) {
+        auto n = link.read({buf.data() + count * slotSize, slotSize});
+        if (n <= 0) {
+            break;
+        }
+        lens[count++] = static_cast<size_t>(n);
+    }
+    return count;
+}
+
+TxBatch::TxBatch(LinkDevice& link, ShardStats* stats)
+    : link(link), stats(stats), arena(ArenaHint) {
+    frames.reserve(MaxFrames);
+}
+
+[[nodiscard]] uint8_t* TxBatch::reserve(size_t maxLen) {
+    if (frames.size() >= MaxFrames) {
+        flush();
+    }
+    if (used + maxLen > arena.size()) {
+        arena.resize(std::max(arena.size() * 2, used + maxLen));
+    }
+    return arena.data() + used;
+}
+
+size_t TxBatch::commit(size_t len) noexcept {
+    frames.push_back({used, len});
+    used += len;
+    return frames.size() - 1;
+}
+
+size_t TxBatch::flush() noexcept {
+    size_t failed = 0;
+    // A tun fd takes exactly one packet per write, there's no multi packet
+    // write for it, so this is one write per frame but all at one point.
+    for (const auto& f : frames) {
+        std::span<const uint8_t> frame{arena.data() + f.offset, f.len};
+        if (tap) {
+            tap->onFrame(CaptureTap::Out, frame);
+        }
+        if (!link.write(frame)) {
+            failed++;
+        }
+    }
+    link.flush();
+    if (stats) {
+        stats->packetsOut.add(frames.size());
+        stats->bytesOut.add(used);
+    }
+    frames.clear();
+    used = 0;
+    gen++;
+    return failed;
+}
@@ -0,0 +1,251 @@
+#include "capture.hpp"
+#include "packet.hpp"
+#include "socket.hpp"
+#include "tcp.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace tcp;
+
+namespace {
+
+// LINKTYPE_RAW, packets start at the IP header.
+constexpr uint32_t LinkTypeRaw = 101;
+
+// pcapng block types, options and flags.
+constexpr uint32_t SectionHeaderBlock  = 0x0a0d0d0a;
+constexpr uint32_t InterfaceDescBlock  = 1;
+constexpr uint32_t EnhancedPacketBlock = 6;
+constexpr uint32_t ByteOrderMagic      = 0x1a2b3c4d;
+constexpr uint16_t OptEnd              = 0;
+constexpr uint16_t OptEpbFlags         = 2;
+constexpr uint16_t OptIfTsresol        = 9;
+constexpr uint32_t EpbFlagInbound      = 1;
+constexpr uint32_t EpbFlagOutbound     = 2;
+// Classic pcap with nanosecond timestamps.
+constexpr uint32_t PcapNanosecondMagic = 0xa1b23c4d;
+
+// The flow of a raw IPv4 packet, if it's TCP.
+std::optional<FlowKey> flowOf(std::span<const uint8_t> pkt) noexcept {
+    if (pkt.size() < IPv4View::MinHeaderSize) {
+        return std::nullopt;
+    }
+    IPv4View ip(pkt.data());
+    auto ipHeaderSize = ip.header_size();
+    if (ip.version() != 4 || ip.protocol() != ProtocolNumInIP ||
+        pkt.size() < ipHeaderSize + 4) {
+        return std::nullopt;
+    }
+    TCPView tcp(pkt.data() + ipHeaderSize);
+    return FlowKey::from({
+        .src = {ip.src_addr(), tcp.sport()},
+        .dst = {ip.dst_addr(), tcp.dport()},
+    });
+}
+
+void put16(std::vector<uint8_t>& out, uint16_t v) {
+    auto* p = reinterpret_cast<const uint8_t*>(&v);
+    out.insert(out.end(), p, p + sizeof(v));
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t v) {
+    auto* p = reinterpret_cast<const uint8_t*>(&v);
+    out.insert(out.end(), p, p + sizeof(v));
+}
+
+} // namespace
+
+[[nodiscard]] bool CaptureFilter::matches(const FlowKey& key) const noexcept {
+    if (flow) {
+        auto reversed = SocketPair{.src = flow->dst, .dst = flow->src};
+        if (key == FlowKey::from(*flow) || key == FlowKey::from(reversed)) {
+            return true;
+        }
+    }
+    if (port) {
+        if (key.ports >> 16 == *port || (key.ports & 0xffff) == *port) {
+            return true;
+        }
+    }
+    return false;
+}
+
+CaptureTap::CaptureTap(const CaptureConfig& config, size_t prefix)
+    : ring(config.ringSlots, sizeof(Record) + config.snaplen),
+      filters(config.filters), snaplen(config.snaplen), prefix(prefix) {
+}
+
+void CaptureTap::onFrame(Direction dir,
+                         std::span<const uint8_t> frame) noexcept {
+    if (frame.size() <= prefix) {
+        return;
+    }
+    auto pkt = frame.subspan(prefix);
+
+    if (!filters.empty()) {
+        auto key = flowOf(pkt);
+        if (!key || std::none_of(filters.begin(),
+                                 filters.end(),
+                                 [&](const CaptureFilter& f) {
+                                     return f.matches(*key);
+                                 })) {
+            return;
+        }
+    }
+
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    Record rec{
+        .timeNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+        .origLen = static_cast<uint32_t>(pkt.size()),
+        .dir     = dir,
+    };
+    auto header = std::span(reinterpret_cast<const uint8_t*>(&rec),
+                            sizeof(rec));
+    if (ring.push(header, pkt.first(std::min<size_t>(pkt.size(), snaplen)))) {
+        captured.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Capture::Capture(const CaptureConfig& config, size_t numShards, size_t prefix)
+    : format(config.format), snaplen(config.snaplen),
+      file(fopen(config.path.c_str(), "wb")),
+      slot(sizeof(CaptureTap::Record) + config.snaplen) {
+    if (!file) {
+        throw std::runtime_error("Couldn't create capture file " +
+                                 config.path);
+    }
+    for (size_t i = 0; i < numShards; i++) {
+        taps.push_back(std::make_unique<CaptureTap>(config, prefix));
+    }
+    writeHeader();
+    writer = std::thread(&Capture::run, this);
+}
+
+Capture::~Capture() {
+    stopping.store(true, std::memory_order_relaxed);
+    writer.join();
+    drain();
+    fclose(file);
+}
+
+[[nodiscard]] CaptureStats Capture::stats() const noexcept {
+    CaptureStats s;
+    for (const auto& tap : taps) {
+        s.captured += tap->captured.load(std::memory_order_relaxed);
+        s.dropped += tap->dropped.load(std::memory_order_relaxed);
+    }
+    s.written = written.load(std::memory_order_relaxed);
+    return s;
+}
+
+void Capture::run() {
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (drain() == 0) {
+            fflush(file);
+            std::this_thread::sleep_for(PollInterval);
+        }
+    }
+}
+
+size_t Capture::drain() {
+    size_t count = 0;
+    for (auto& tap : taps) {
+        while (auto n = tap->ring.pop(slot)) {
+            CaptureTap::Record rec;
+            memcpy(&rec, slot.data(), sizeof(rec));
+            writeRecord(rec,
+                        std::span(slot).subspan(sizeof(rec), n - sizeof(rec)));
+            count++;
+        }
+    }
+    written.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+// Both formats are written in host byte order, readers tell it from the
+// magic numbers.
+void Capture::writeHeader() {
+    out.clear();
+    if (format == CaptureConfig::Format::Pcap) {
+        put32(out, PcapNanosecondMagic);
+        put16(out, 2); // Version 2.4.
+        put16(out, 4);
+        put32(out, 0); // Timezone offset.
+        put32(out, 0); // Timestamp accuracy.
+        put32(out, snaplen);
+        put32(out, LinkTypeRaw);
+    } else {
+        put32(out, SectionHeaderBlock);
+        put32(out, 28);
+        put32(out, ByteOrderMagic);
+        put16(out, 1); // Version 1.0.
+        put16(out, 0);
+        put32(out, UINT32_MAX); // Section length unknown, 64 bits of -1.
+        put32(out, UINT32_MAX);
+        put32(out, 28);
+
+        put32(out, InterfaceDescBlock);
+        put32(out, 32);
+        put16(out, static_cast<uint16_t>(LinkTypeRaw));
+        put16(out, 0);
+        put32(out, snaplen);
+        // Timestamps in nanoseconds, 10^-9, one byte padded to four.
+        put16(out, OptIfTsresol);
+        put16(out, 1);
+        out.insert(out.end(), {9, 0, 0, 0});
+        put16(out, OptEnd);
+        put16(out, 0);
+        put32(out, 32);
+    }
+    fwrite(out.data(), 1, out.size(), file);
+}
+
+void Capture::writeRecord(const CaptureTap::Record& rec,
+                          std::span<const uint8_t> data) {
+    auto ns  = static_cast<uint64_t>(rec.timeNs);
+    auto len = static_cast<uint32_t>(data.size());
+
+    out.clear();
+    if (format == CaptureConfig::Format::Pcap) {
+        put32(out, static_cast<uint32_t>(ns / 1000000000));
+        put32(out, static_cast<uint32_t>(ns % 1000000000));
+        put32(out, len);
+        put32(out, rec.origLen);
+        out.insert(out.end(), data.begin(), data.end());
+    } else {
+        // Enhanced packet block: 28 bytes of header, the data padded to 4
+        // bytes, the flags option, the end of options and the trailing
+        // length.
+        uint32_t padded   = (len + 3) & ~3u;
+        uint32_t blockLen = 28 + padded + 8 + 4 + 4;
+        put32(out, EnhancedPacketBlock);
+        put32(out, blockLen);
+        put32(out, 0); // Interface.
+        put32(out, static_cast<uint32_t>(ns >> 32));
+        put32(out, static_cast<uint32_t>(ns));
+        put32(out, len);
+        put32(out, rec.origLen);
+        out.insert(out.end(), data.begin(), data.end());
+        out.resize(out.size() + padded - len);
+        put16(out, OptEpbFlags);
+        put16(out, 4);
+        put32(out,
+              rec.dir == CaptureTap::In ? EpbFlagInbound : EpbFlagOutbound);
+        put16(out, OptEnd);
+        put16(out, 0);
+        put32(out, blockLen);
+    }
+    fwrite(out.data(), 1, out.size(), file);
+}
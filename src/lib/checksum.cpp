@@ -0,0 +1,200 @@
+#include "checksum.hpp"
+#include <atomic>
+#include <bit>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NETSTACK_X86 1
+#include <immintrin.h>
+#else
+#define NETSTACK_X86 0
+#endif
+
+using namespace tcp;
+using namespace tcp::checksum;
+
+// The kernels add up the buffer as native order 32 bit words, which is the
+// same sum modulo 0xffff as adding its 16 bit words, into 64 bit lanes that
+// can't overflow below 16GB. Only at the end is the sum folded and turned to
+// network order.
+namespace {
+
+// A one's complement sum of native order words is the sum of the big endian
+// words with its bytes swapped (RFC 1071 2B).
+[[nodiscard]] uint64_t toNetwork(uint64_t native) noexcept {
+    auto folded = fold(native);
+    if constexpr (std::endian::native == std::endian::little) {
+        folded = static_cast<uint16_t>((folded << 8) | (folded >> 8));
+    }
+    return folded;
+}
+
+// Adds the last few bytes, less than a step of any kernel, to `sum`.
+[[nodiscard]] uint64_t
+sumTail(const uint8_t* p, size_t n, uint64_t sum) noexcept {
+    for (; n >= 4; p += 4, n -= 4) {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+    }
+    if (n >= 2) {
+        uint16_t word;
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+        p += 2;
+        n -= 2;
+    }
+    if (n) {
+        // Padded with a zero byte after it.
+        sum += std::endian::native == std::endian::little
+                   ? uint64_t{p[0]}
+                   : uint64_t{p[0]} << 8;
+    }
+    return sum;
+}
+
+[[nodiscard]] uint64_t sumPortable(const uint8_t* data, size_t size) noexcept {
+    // Two accumulators so the adds of one step don't wait on each other.
+    uint64_t a = 0;
+    uint64_t b = 0;
+    size_t i   = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint64_t w0;
+        uint64_t w1;
+        memcpy(&w0, data + i, sizeof(w0));
+        memcpy(&w1, data + i + 8, sizeof(w1));
+        a += (w0 & 0xffffffff) + (w0 >> 32);
+        b += (w1 & 0xffffffff) + (w1 >> 32);
+    }
+    return toNetwork(sumTail(data + i, size - i, a + b));
+}
+
+#if NETSTACK_X86
+
+// Zero extends the 32 bit words of every 16 bytes into 64 bit lanes, the low
+// and high halves into separate accumulators.
+__attribute__((target("sse2"))) [[nodiscard]] uint64_t
+sumSSE2(const uint8_t* data, size_t size) noexcept {
+    auto zero = _mm_setzero_si128();
+    auto acc0 = zero;
+    auto acc1 = zero;
+    size_t i  = 0;
+    for (; i + 16 <= size; i += 16) {
+        auto v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes),
+                     _mm_add_epi64(acc0, acc1));
+    return toNetwork(sumTail(data + i, size - i, lanes[0] + lanes[1]));
+}
+
+// As sumSSE2 with twice the width, two loads per step to keep both load
+// ports busy.
+__attribute__((target("avx2"))) [[nodiscard]] uint64_t
+sumAVX2(const uint8_t* data, size_t size) noexcept {
+    auto zero = _mm256_setzero_si256();
+    auto acc0 = zero;
+    auto acc1 = zero;
+    auto acc2 = zero;
+    auto acc3 = zero;
+    size_t i  = 0;
+    for (; i + 64 <= size; i += 64) {
+        auto v0 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        auto v1 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + i + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc2 = _mm256_add_epi64(acc2, _mm256_unpacklo_epi32(v1, zero));
+        acc3 = _mm256_add_epi64(acc3, _mm256_unpackhi_epi32(v1, zero));
+    }
+    if (i + 32 <= size) {
+        auto v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+        i += 32;
+    }
+    auto acc = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1),
+                                _mm256_add_epi64(acc2, acc3));
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    uint64_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return toNetwork(sumTail(data + i, size - i, sum));
+}
+
+#endif
+
+[[nodiscard]] detail::SumFn fnFor(Kernel kernel) noexcept {
+#if NETSTACK_X86
+    switch (kernel) {
+    case Kernel::Portable:
+        return sumPortable;
+    case Kernel::SSE2:
+        return sumSSE2;
+    case Kernel::AVX2:
+        return sumAVX2;
+    }
+#else
+    (void)kernel;
+#endif
+    return sumPortable;
+}
+
+// What sumFn starts as: every call after the first goes straight to the
+// kernel. Threads racing through here store the same pointer.
+[[nodiscard]] uint64_t resolve(const uint8_t* data, size_t size) noexcept {
+    auto fn = fnFor(selected());
+    detail::sumFn.store(fn, std::memory_order_relaxed);
+    return fn(data, size);
+}
+
+} // namespace
+
+// Constant initialized, so it's usable from other static initializers.
+std::atomic<detail::SumFn> detail::sumFn{resolve};
+
+[[nodiscard]] const char* checksum::kernelName(Kernel kernel) noexcept {
+    switch (kernel) {
+    case Kernel::Portable:
+        return "portable";
+    case Kernel::SSE2:
+        return "sse2";
+    case Kernel::AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+[[nodiscard]] bool checksum::supported(Kernel kernel) noexcept {
+    if (kernel == Kernel::Portable) {
+        return true;
+    }
+#if NETSTACK_X86
+    // May run before the constructor that initializes the CPU model.
+    __builtin_cpu_init();
+    return kernel == Kernel::SSE2 ? __builtin_cpu_supports("sse2")
+                                  : __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+[[nodiscard]] Kernel checksum::selected() noexcept {
+    static const Kernel kernel = supported(Kernel::AVX2)   ? Kernel::AVX2
+                                 : supported(Kernel::SSE2) ? Kernel::SSE2
+                                                           : Kernel::Portable;
+    return kernel;
+}
+
+[[nodiscard]] uint64_t checksum::partialWith(Kernel kernel,
+                                             std::span<const uint8_t> data,
+                                             uint64_t sum) noexcept {
+    return sum + fnFor(kernel)(data.data(), data.size());
+}
@@ -0,0 +1,149 @@
+#include "congestion.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdint.h>
+
+using namespace tcp;
+
+CongestionControl::CongestionControl(uint32_t mss) noexcept
+    : smss(mss), congWnd(0), slowStartThresh(UINT32_MAX) {
+    congWnd = initialWindow();
+}
+
+void CongestionControl::setMSS(uint32_t mss) noexcept {
+    smss      = mss;
+    congWnd   = initialWindow();
+    ackedInCA = 0;
+}
+
+[[nodiscard]] uint32_t CongestionControl::initialWindow() const noexcept {
+    if (smss > 2190) {
+        return 2 * smss;
+    }
+    if (smss > 1095) {
+        return 3 * smss;
+    }
+    return 4 * smss;
+}
+
+void CongestionControl::onAck(uint32_t acked,
+                              Clock::time_point /*now*/) noexcept {
+    // Slow start grows by at most one segment per ACK (RFC 5681 3.1), and
+    // congestion avoidance by one segment per window acked.
+    if (inSlowStart()) {
+        congWnd += std::min(acked, smss);
+        return;
+    }
+
+    ackedInCA += acked;
+    if (ackedInCA >= congWnd) {
+        ackedInCA -= congWnd;
+        congWnd += smss;
+    }
+}
+
+void CongestionControl::onEnterRecovery(uint32_t inFlight) noexcept {
+    slowStartThresh = std::max(inFlight / 2, 2 * smss);
+    // Three segments have left the network.
+    congWnd = slowStartThresh + 3 * smss;
+}
+
+void CongestionControl::onDupAck() noexcept {
+    congWnd += smss;
+}
+
+void CongestionControl::onPartialAck(uint32_t acked) noexcept {
+    // Deflate by what was acked, and add back one segment if at least one
+    // segment's worth was acked (RFC 6582 3.2).
+    congWnd -= std::min(acked, congWnd);
+    if (acked >= smss) {
+        congWnd += smss;
+    }
+    congWnd = std::max(congWnd, smss);
+}
+
+void CongestionControl::onExitRecovery() noexcept {
+    congWnd   = slowStartThresh;
+    ackedInCA = 0;
+}
+
+void CongestionControl::onRTO(uint32_t inFlight) noexcept {
+    slowStartThresh = std::max(inFlight / 2, 2 * smss);
+    // Loss window, back to slow start.
+    congWnd   = smss;
+    ackedInCA = 0;
+}
+
+void CubicCongestionControl::onCongestion(uint32_t /*inFlight*/) noexcept {
+    double segments = static_cast<double>(congWnd) / smss;
+
+    // Fast convergence: losing below the last maximum means another flow
+    // needs the room, so don't aim as high.
+    wMax = segments < wMax ? segments * (1 + Beta) / 2 : segments;
+    k    = std::cbrt(wMax * (1 - Beta) / C);
+
+    slowStartThresh = std::max(static_cast<uint32_t>(congWnd * Beta), 2 * smss);
+    wEst            = static_cast<double>(slowStartThresh) / smss;
+    epochStart      = {};
+    ackedInCA       = 0;
+}
+
+void CubicCongestionControl::onEnterRecovery(uint32_t inFlight) noexcept {
+    onCongestion(inFlight);
+    congWnd = slowStartThresh + 3 * smss;
+}
+
+void CubicCongestionControl::onRTO(uint32_t inFlight) noexcept {
+    onCongestion(inFlight);
+    congWnd = smss;
+}
+
+void CubicCongestionControl::onAck(uint32_t acked,
+                                   Clock::time_point now) noexcept {
+    if (inSlowStart()) {
+        CongestionControl::onAck(acked, now);
+        return;
+    }
+
+    double segments = static_cast<double>(congWnd) / smss;
+    if (epochStart == Clock::time_point{}) {
+        epochStart = now;
+        // No loss seen yet, or already above the old maximum: start the
+        // curve here.
+        if (wMax < segments) {
+            wMax = segments;
+            k    = 0;
+        }
+        wEst = segments;
+    }
+
+    // No RTT estimate yet, so the curve is evaluated at the current time
+    // rather than one RTT ahead.
+    double t      = std::chrono::duration<double>(now - epochStart).count();
+    double target = C * std::pow(t - k, 3) + wMax;
+
+    // Reno-friendly estimate (RFC 9438 4.3), grows by alpha per window.
+    constexpr double alpha = 3 * (1 - Beta) / (1 + Beta);
+    wEst += alpha * acked / congWnd;
+    target = std::max(target, wEst);
+
+    // Never more than 1.5x per RTT.
+    target = std::clamp(target, segments, 1.5 * segments);
+    congWnd += static_cast<uint32_t>((target - segments) / segments * acked);
+}
+
+[[nodiscard]] std::unique_ptr<CongestionControl>
+tcp::makeCongestionControl(CongestionControl::Algorithm algorithm,
+                           uint32_t mss) {
+    switch (algorithm) {
+    case CongestionControl::Algorithm::Reno:
+        return std::make_unique<RenoCongestionControl>(mss);
+    case CongestionControl::Algorithm::Cubic:
+        return std::make_unique<CubicCongestionControl>(mss);
+    case CongestionControl::Algorithm::NewReno:
+    default:
+        return std::make_unique<NewRenoCongestionControl>(mss);
+    }
+}
@@ -1,100 +1,463 @@
 #include "connection.hpp"
+#include "batch.hpp"
+#include "capture.hpp"
 #include "debug.hpp"
+#include "endpoint.hpp"
 #include "fmt/core.h"
+#include "histogram.hpp"
+#include "packet.hpp"
+#include "ringBuffer.hpp"
+#include "scheduler.hpp"
+#include "segment.hpp"
 #include "socket.hpp"
+#include "stack.hpp"
 #include "tcp.hpp"
-#include "threadPool.hpp"
-#include "tins/ip.h"
-#include "tins/tcp.h"
+#include "timerWheel.hpp"
+#include "tsc.hpp"
+#include "virtioNet.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <errno.h>
+#include <iterator>
+#include <poll.h>
+#include <span>
 #include <stdexcept>
 #include <stdint.h>
-#include <tuple>
+#include <string.h>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 using namespace tcp;
+
+namespace {
+
+// The RST answering a segment that belongs to no connection (RFC 793 3.4).
+SegmentFields resetFor(const PacketView& pkt) noexcept {
+    const auto& tcp = pkt.tcp;
+    if (tcp.get_flag(TCPView::ACK)) {
+        return {
+            .seq    = tcp.ack_seq(),
+            .ack    = 0,
+            .flags  = TCPView::RST,
+            .window = 0,
+        };
+    }
+    return {
+        .seq    = 0,
+        .ack    = tcp.seq() + pkt.segLen(),
+        .flags  = TCPView::RST | TCPView::ACK,
+        .window = 0,
+    };
+}
+
+} // namespace
+
 void ConnectionManager::run() noexcept {
-    char readBuf[TunBufSize] = {0};
+    auto& link = *ctx.link;
+    int fd     = link.pollFd();
 
-    while (true) {
-        int readBytes = tun.get().read((void*)readBuf, TunBufSize);
-        if (readBytes == -1) {
-            fmt::println("Couldn't read from tun interface");
-            continue;
+    RxBatch rx(RxBatchSize, ctx.vnetHdr ? MaxVnetFrame : mtu);
+    TxBatch tx(link, &ctx.stats);
+    TxBatch::Scope txScope(tx);
+    Scheduler::Scope schedulerScope(ctx.scheduler);
+    ctx.timers.arm(sweepTimer, ReapInterval);
+
+    // When the handlers that queued frames in tx finished, for the time
+    // until the frames are written.
+    std::array<uint64_t, RxBatchSize> handled;
+    size_t numHandled = 0;
+    auto flush        = [&] {
+        tx.flush();
+        auto written = tsc::now();
+        for (size_t i = 0; i < numHandled; i++) {
+            ctx.latency.record(Stage::HandlerToWrite, written - handled[i]);
         }
+        numHandled = 0;
+    };
 
-        Tins::IP ip;
-        try {
-            ip = Tins::IP((uint8_t*)readBuf, readBytes);
-        } catch (...) {
-            debug::println("Skipping non ip packet");
-            continue;
+    while (!stopping) {
+        pollfd pfds[] = {
+            {.fd = fd, .events = POLLIN, .revents = 0},
+            {.fd = inbox.fd(), .events = POLLIN, .revents = 0},
+        };
+
+        // Sleep until there's input or the next timer is due.
+        int timeout = -1;
+        if (auto next = ctx.timers.nextTimeout()) {
+            timeout = static_cast<int>(
+                std::chrono::ceil<std::chrono::milliseconds>(*next).count());
         }
 
-        if (ip.protocol() != ProtocolNumInIP) {
-            debug::println("Skipping non TCP packet");
+        if (poll(pfds, std::size(pfds), timeout) == -1) {
+            if (errno != EINTR) {
+                fmt::println("Couldn't poll tun interface");
+            }
             continue;
         }
 
-        debug::println("");
-        debug::println("Rcvd ip packet. Src: {}, Dst: {}, protocol: TCP",
-                       ip.src_addr().to_string(),
-                       ip.dst_addr().to_string());
-        debug::println("Payload size: {}", ip.advertised_size());
+        ctx.timers.advance();
 
-        const auto* tcp = ip.find_pdu<Tins::TCP>();
-        if (!tcp) {
-            debug::println("Failed to parse tcp packet, skipping...");
-            continue;
+        if (pfds[1].revents & POLLIN) {
+            inbox.drain();
         }
 
-        debug::println("Src port: {}, Dst port: {}",
-                       tcp->sport(),
-                       tcp->dport());
+        // Drain everything the tun has, then flush whatever the burst
+        // produced in one go. A full batch means there may be more waiting.
+        if (pfds[0].revents & POLLIN) {
+            do {
+                rx.fill(link);
+                auto readAt = tsc::now();
+                for (size_t i = 0; i < rx.size(); i++) {
+                    ctx.stats.packetsIn.add();
+                    ctx.stats.bytesIn.add(rx.packet(i).size());
+                    if (ctx.capture) {
+                        ctx.capture->onFrame(CaptureTap::In, rx.packet(i));
+                    }
+                    auto queued = tx.size();
+                    auto gen    = tx.generation();
+                    auto done   = onPacket(rx.packet(i), readAt);
+                    bool sent   = tx.size() != queued || tx.generation() != gen;
+                    if (done && sent) {
+                        handled[numHandled++] = done;
+                    }
+                }
+                ctx.scheduler.runReady();
+                flush();
+            } while (rx.full());
+        }
+        ctx.scheduler.runReady();
+        flush();
+        reap();
+    }
+}
+
+void ConnectionManager::connectionInfo(
+    std::function<void(std::vector<ConnectionInfo>)> done) noexcept {
+    inbox.post([this, done = std::move(done)] {
+        std::vector<ConnectionInfo> infos;
+        infos.reserve(connections.size());
+        connections.forEach([&](const FlowKey&, const Connection& conn) {
+            infos.push_back(conn.info());
+        });
+        done(std::move(infos));
+    });
+}
 
-        auto dataOffset = ip.header_size() + tcp->header_size();
-        debug::println("TCP packet (size: {}):", readBytes - dataOffset);
-        for (size_t i = dataOffset; i < (size_t)readBytes; i++) {
-            debug::print("{}", readBuf[i]);
+void ConnectionManager::setCapture(std::shared_ptr<Capture> c) noexcept {
+    inbox.post([this, c = std::move(c)]() mutable {
+        capture     = std::move(c);
+        ctx.capture = capture ? &capture->tap(shardId) : nullptr;
+        // Posted work runs inside run(), with its batch current.
+        if (auto* tx = TxBatch::current()) {
+            tx->setTap(ctx.capture);
         }
+    });
+}
 
-        // Fully parsed tcp, now work with it.
-        Socket srcSocket      = {ip.src_addr(), tcp->sport()};
-        Socket dstSocket      = {ip.dst_addr(), tcp->dport()};
-        SocketPair socketPair = {
-            dstSocket,
-            srcSocket,
-        };
-        lastRvcd = socketPair;
-        if (!connections.contains(socketPair)) {
-            connections.emplace(std::piecewise_construct,
-                                std::forward_as_tuple(socketPair),
-                                std::forward_as_tuple(socketPair.src,
-                                                      socketPair.dst,
-                                                      tun,
-                                                      *tcp));
+void ConnectionManager::setSynQueue(const SynQueueConfig& config) noexcept {
+    inbox.post([this, config] {
+        ctx.synQueue = config;
+    });
+}
+
+void ConnectionManager::setIdleTimeout(std::chrono::seconds timeout) noexcept {
+    inbox.post([this, timeout] {
+        ctx.idleTimeout = timeout;
+    });
+}
+
+void ConnectionManager::stop() noexcept {
+    inbox.post([this] {
+        stopping = true;
+    });
+}
+
+uint64_t ConnectionManager::onPacket(std::span<const uint8_t> frame,
+                                     uint64_t readAt) noexcept {
+    auto buf = frame;
+    // The kernel already verified the TCP checksum of a DATA_VALID frame, and
+    // a NEEDS_CSUM one (from a local socket) only carries the pseudo header
+    // sum. That's all there is to take from the header, a GRO super packet
+    // has a valid total length.
+    bool tcpChecked = false;
+    if (ctx.vnetHdr) {
+        if (buf.size() < SegmentTemplate::VnetHdrSize) {
+            debug::println("Skipping frame shorter than its virtio-net header");
+            return 0;
+        }
+        VirtioNetHdr vnet;
+        memcpy(&vnet, buf.data(), sizeof(vnet));
+        tcpChecked =
+            vnet.flags & (VirtioNetHdr::DataValid | VirtioNetHdr::NeedsCsum);
+        buf = buf.subspan(SegmentTemplate::VnetHdrSize);
+    }
+
+    auto parsed = PacketView::parse(buf);
+    if (!parsed) {
+        ctx.stats.parseDrops.add();
+        debug::println("Skipping packet: {}", toString(parsed.error()));
+        return 0;
+    }
+    const auto& pkt = *parsed;
+    auto parsedAt   = tsc::now();
+    if (readAt) {
+        ctx.latency.record(Stage::ReadToParse, parsedAt - readAt);
+    }
+
+    debug::println("");
+    debug::println("Rcvd ip packet. Src: {}, Dst: {}, protocol: TCP",
+                   pkt.ip.src_addr().to_string(),
+                   pkt.ip.dst_addr().to_string());
+    debug::println("Payload size: {}", pkt.ip.tot_len());
+
+    debug::println("Src port: {}, Dst port: {}",
+                   pkt.tcp.sport(),
+                   pkt.tcp.dport());
+
+    debug::println("TCP packet (size: {}):", pkt.payload.size());
+    for (auto x : pkt.payload) {
+        debug::print("{}", (char)x);
+    }
+
+    // Fully parsed tcp, now work with it.
+    Socket srcSocket      = {pkt.ip.src_addr(), pkt.tcp.sport()};
+    Socket dstSocket      = {pkt.ip.dst_addr(), pkt.tcp.dport()};
+    SocketPair socketPair = {
+        dstSocket,
+        srcSocket,
+    };
+
+    // The kernel learns which queue a flow lives on from the queue we write
+    // it to, but the first packets of a flow can land anywhere. Hand those to
+    // the owning shard so a flow's state is only ever touched by one thread.
+    if (stack) {
+        auto& owner = stack->shardFor(socketPair);
+        if (&owner != this) {
+            owner.inbox.post([&owner,
+                              copy = std::vector<uint8_t>(frame.begin(),
+                                                          frame.end())] {
+                owner.onPacket(copy);
+            });
+            return 0;
         }
+    }
+
+    // Only the owning shard verifies, the frame handed to it isn't summed
+    // twice.
+    if (!pkt.ipChecksumValid() || (!tcpChecked && !pkt.tcpChecksumValid())) {
+        ctx.stats.checksumDrops.add();
+        debug::println("Skipping packet: bad checksum");
+        return 0;
+    }
 
-        auto& conn = connections[socketPair];
-        conn.onPacket(ip, *tcp);
+    setLastRecv(socketPair);
+    auto* conn = connections.find(FlowKey::from(socketPair));
+    if (!conn) {
+        conn = onNewFlow(socketPair, pkt);
+        if (!conn) {
+            return 0;
+        }
     }
+    auto foundAt = tsc::now();
+    ctx.latency.record(Stage::ParseToLookup, foundAt - parsedAt);
+
+    conn->onPacket(pkt);
+    auto handledAt = tsc::now();
+    ctx.latency.record(Stage::Handler, handledAt - foundAt);
+    return handledAt;
 }
 
-// validate l < m <= r.
-static bool validateAckSeqNums(int l, int m, int r) {
-    if (l < r) {
-        if (not(l < m && m <= r)) {
-            return false;
+Connection* ConnectionManager::onNewFlow(const SocketPair& socketPair,
+                                         const PacketView& pkt) noexcept {
+    const auto& tcp = pkt.tcp;
+    auto key        = FlowKey::from(socketPair);
+
+    auto* waiting = ctx.timeWait.find(key);
+    if (waiting && onTimeWait(socketPair, *waiting, pkt)) {
+        return nullptr;
+    }
+
+    if (tcp.get_flag(TCPView::RST)) {
+        debug::println("Dropping RST of an unknown flow");
+        return nullptr;
+    }
+
+    if (tcp.get_flag(TCPView::SYN) && !tcp.get_flag(TCPView::ACK)) {
+        if (ctx.halfOpen < ctx.synQueue.maxHalfOpen) {
+            auto* conn = connections
+                             .tryEmplace(key,
+                                         socketPair.src,
+                                         socketPair.dst,
+                                         ctx,
+                                         tcp)
+                             .first;
+            ctx.stats.connections.set(connections.size());
+            endTimeWait(key, *conn);
+            return conn;
         }
+        if (ctx.synQueue.cookies && !waiting) {
+            sendSynCookie(socketPair, tcp);
+        } else {
+            ctx.stats.synDrops.add();
+        }
+        return nullptr;
     }
-    // check for wrapping over seq num space.
-    else {
-        if (not(m > l || m <= r)) {
-            return false;
+
+    // The final ACK of a handshake answered with a cookie. Checked even if
+    // cookies were turned off since, so handshakes under way still finish.
+    if (tcp.get_flag(TCPView::ACK) && !tcp.get_flag(TCPView::SYN)) {
+        auto iss = tcp.ack_seq() - 1;
+        auto mss =
+            cookies.check(key, tcp.seq() - 1, iss, SynCookies::Clock::now());
+        if (mss) {
+            auto* conn =
+                connections.tryEmplace(key, socketPair.src, socketPair.dst, ctx)
+                    .first;
+            ctx.stats.connections.set(connections.size());
+            ctx.stats.synCookiesValid.add();
+            conn->onCookieAck(tcp, iss, *mss);
+            return conn;
         }
     }
+
+    // No such connection, or one that was closed and reaped (RFC 793 3.4).
+    debug::println("Resetting segment of an unknown flow");
+    sendStateless(socketPair, resetFor(pkt));
+    ctx.stats.resetsOut.add();
+    return nullptr;
+}
+
+bool ConnectionManager::onTimeWait(const SocketPair& socketPair,
+                                   TimeWaitTable::Entry& entry,
+                                   const PacketView& pkt) noexcept {
+    const auto& tcp = pkt.tcp;
+    // A SYN beyond anything of the old connection can only be a new one
+    // (RFC 1122 4.2.2.13). The flow stays in TIME-WAIT until the connection
+    // it gets takes it over.
+    if (tcp.get_flag(TCPView::SYN) && !tcp.get_flag(TCPView::ACK) &&
+        seqGT(tcp.seq(), entry.rcvNxt)) {
+        return false;
+    }
+    // RSTs don't end TIME-WAIT early (RFC 1337).
+    if (tcp.get_flag(TCPView::RST)) {
+        return true;
+    }
+
+    // Most likely the peer's FIN again, our ACK of it having been lost.
+    SegmentFields fields = {
+        .seq    = entry.sndNxt,
+        .ack    = entry.rcvNxt,
+        .flags  = TCPView::ACK,
+        .window = 0,
+    };
+    sendStateless(socketPair, fields);
+    // Restarts the wait through add, which also queues its new expiry.
+    if (tcp.get_flag(TCPView::FIN)) {
+        ctx.timeWait.add(FlowKey::from(socketPair),
+                         entry.sndNxt,
+                         entry.rcvNxt,
+                         TimeWaitTable::Clock::now());
+    }
     return true;
 }
 
+void ConnectionManager::endTimeWait(const FlowKey& key,
+                                    Connection& conn) noexcept {
+    auto* entry = ctx.timeWait.find(key);
+    if (!entry) {
+        return;
+    }
+    conn.startAfter(entry->sndNxt);
+    ctx.timeWait.erase(key);
+    ctx.stats.timeWait.set(ctx.timeWait.size());
+}
+
+void ConnectionManager::sendSynCookie(const SocketPair& socketPair,
+                                      const TCPView& syn) noexcept {
+    auto peerMss =
+        std::min(syn.mss().value_or(Connection::DefaultMSS), ctx.mss);
+    auto cookie = cookies.make(FlowKey::from(socketPair),
+                               syn.seq(),
+                               peerMss,
+                               SynCookies::Clock::now());
+
+    // Only the MSS is offered, the cookie has no room for the peer's window
+    // scale or SACK-Permitted.
+    uint8_t options[4] = {TCPOption::MSS, 4};
+    wire::store16(options + 2, ctx.mss);
+    SegmentFields fields = {
+        .seq    = cookie,
+        .ack    = syn.seq() + 1,
+        .flags  = TCPView::SYN | TCPView::ACK,
+        .window = 65535,
+    };
+    sendStateless(socketPair, fields, options);
+    ctx.stats.synCookiesSent.add();
+}
+
+void ConnectionManager::sendStateless(
+    const SocketPair& socketPair,
+    const SegmentFields& fields,
+    std::span<const uint8_t> options) noexcept {
+    // onPacket only runs inside run(), which has a batch current.
+    auto* batch = TxBatch::current();
+    if (!batch) {
+        return;
+    }
+
+    SegmentTemplate tmpl(
+        socketPair.src, socketPair.dst, Connection::DefaultTTL, ctx.vnetHdr);
+    auto* out = batch->reserve(tmpl.maxOverhead());
+    batch->commit(tmpl.emit(out, fields, options, {}));
+
+    if (trace::enabled()) [[unlikely]] {
+        trace::record({
+            .time  = tsc::now(),
+            .flow  = FlowKey::from(socketPair),
+            .seq   = fields.seq,
+            .ack   = fields.ack,
+            .len   = 0,
+            .flags = fields.flags,
+            .kind  = trace::Kind::SegmentOut,
+        });
+    }
+}
+
+void ConnectionManager::reap() noexcept {
+    if (ctx.closed.empty()) {
+        return;
+    }
+    for (const auto& key : ctx.closed) {
+        // It may have been reopened since it closed.
+        auto* conn = connections.find(key);
+        if (!conn || !conn->finished()) {
+            continue;
+        }
+        if (conn->endpoint) {
+            conn->endpoint->conn = nullptr;
+        }
+        connections.erase(key);
+    }
+    ctx.closed.clear();
+    ctx.stats.connections.set(connections.size());
+}
+
+void ConnectionManager::sweep() noexcept {
+    ctx.timeWait.expire(TimeWaitTable::Clock::now());
+    ctx.stats.timeWait.set(ctx.timeWait.size());
+
+    // Only marks them, reap erases them once the sweep is over.
+    connections.forEach([&](const FlowKey&, Connection& conn) {
+        if (!conn.finished() && conn.onIdleSweep(ReapInterval)) {
+            ctx.stats.idleTimeouts.add();
+            conn.abort();
+        }
+    });
+    ctx.timers.arm(sweepTimer, ReapInterval);
+}
+
 // vaidate l <= m < r.
 static bool validateRcvSeqNums(int l, int m, int r) {
     if (l < r) {
@@ -111,12 +474,30 @@ static bool validateRcvSeqNums(int l, int m, int r) {
     return true;
 }
 
+[[nodiscard]] ConnectionInfo Connection::info() const noexcept {
+    return {
+        .pair            = {src, dst},
+        .state           = state,
+        .sndUna          = snd.una,
+        .sndNxt          = snd.nxt,
+        .sndWnd          = snd.wnd,
+        .rcvNxt          = rcv.nxt,
+        .rcvWnd          = rcv.wnd,
+        .cwnd            = cc->cwnd(),
+        .srtt            = rtt.srtt,
+        .fastRetransmits = stats.fastRetransmits,
+        .timeouts        = stats.timeouts,
+    };
+}
+
 [[nodiscard]] bool
-Connection::isPacketValid(const Tins::TCP& tcp) const noexcept {
-    // If ack, check validity.
-    if (tcp.has_flags(Tins::TCP::ACK)) {
-        // Validate: SND.UNA < SEG.ACK =< SND.NXT.
-        if (!validateAckSeqNums(snd.una, tcp.ack_seq(), snd.nxt)) {
+Connection::isPacketValid(const PacketView& pkt) const noexcept {
+    const auto& tcp = pkt.tcp;
+    // If ack, check validity. Only an ack of something never sent is bad, a
+    // duplicate (SEG.ACK =< SND.UNA) may still carry data or a window update.
+    if (tcp.has_flags(TCPView::ACK)) {
+        // Validate: SEG.ACK =< SND.MAX.
+        if (seqGT(tcp.ack_seq(), snd.max)) {
             debug::println("Failed to validate ack seq num check for packet");
             return false;
         }
@@ -127,7 +508,7 @@ Connection::isPacketValid(const Tins::TCP& tcp) const noexcept {
     // OR
     // RCV.NXT =< SEG.SEQ+SEG.LEN-1 < RCV.NXT+RCV.WND.
 
-    auto segLen   = tcp.advertised_size();
+    auto segLen   = pkt.segLen();
     auto seqStart = tcp.seq();
     auto seqEnd   = seqStart + segLen - 1;
 
@@ -164,28 +545,831 @@ Connection::isPacketValid(const Tins::TCP& tcp) const noexcept {
     return true;
 }
 
-void ConnectionManager::send(const SocketPair& connSockets,
-                             const std::string& data) noexcept {
-    if (!connections.contains(connSockets)) {
-        fmt::println("Error: Connection does not exist");
+bool Connection::sendSegment(uint8_t flags, uint32_t seq) noexcept {
+    SegmentFields fields = {
+        .seq    = seq,
+        .ack    = (flags & TCPView::ACK) ? rcv.nxt : 0,
+        .flags  = flags,
+        .window = windowField(flags),
+    };
+
+    uint8_t optionsBuf[SegmentTemplate::MaxOptionsSize];
+    std::span<const uint8_t> options(optionsBuf,
+                                     buildOptions(flags, optionsBuf));
+
+    bool pureAck = flags == TCPView::ACK;
+    if (flags & TCPView::ACK) {
+        onAckSent();
+    }
+
+    auto* batch = TxBatch::current();
+    if (!batch) {
+        stats.pureAcksOut += pureAck;
+        return emit(fields, options);
+    }
+    traceEvent(trace::Kind::SegmentOut, fields.seq, fields.ack, 0, flags);
+
+    // ACKs are cumulative, a newer one that moves rcv.nxt or the window on
+    // replaces the one still queued for this connection rather than going
+    // out next to it. Duplicate ACKs never do, while data is missing the
+    // peer counts them to retransmit fast. The new one has to fit in the
+    // old one's place, the number of SACK blocks may have changed.
+    if (pureAck && queuedAck.gen == batch->generation() && reasm.empty() &&
+        (seqGT(fields.ack, queuedAck.ack) ||
+         fields.window > queuedAck.window)) {
+        auto frame = batch->frame(queuedAck.frame);
+        if (frame.size() == txTemplate.frameSize(options.size(), 0)) {
+            txTemplate.emit(frame.data(), fields, options, {});
+            queuedAck.ack    = fields.ack;
+            queuedAck.window = fields.window;
+            return true;
+        }
+    }
+
+    auto* out  = batch->reserve(txTemplate.maxOverhead());
+    auto frame = batch->commit(txTemplate.emit(out, fields, options, {}));
+    if (pureAck) {
+        queuedAck = {batch->generation(), frame, fields.ack, fields.window};
+        stats.pureAcksOut++;
+    }
+    return true;
+}
+
+size_t Connection::buildOptions(uint8_t flags, uint8_t* out) const noexcept {
+    size_t len = 0;
+
+    // A SYN offers everything, a SYN-ACK only what the peer's SYN did.
+    if (flags & TCPView::SYN) {
+        bool synAck = flags & TCPView::ACK;
+
+        out[len++] = TCPOption::MSS;
+        out[len++] = 4;
+        wire::store16(out + len, shard->mss);
+        len += 2;
+
+        if (!synAck || wsOk) {
+            out[len++] = TCPOption::NOP;
+            out[len++] = TCPOption::WindowScale;
+            out[len++] = 3;
+            out[len++] = rcv.wndShift;
+        }
+        if (!synAck || sackOk) {
+            out[len++] = TCPOption::NOP;
+            out[len++] = TCPOption::NOP;
+            out[len++] = TCPOption::SACKPermitted;
+            out[len++] = 2;
+        }
+        return len;
+    }
+
+    if (!(flags & TCPView::ACK) || !sackOk || reasm.empty()) {
+        return 0;
+    }
+
+    // SACK blocks, the one holding the latest segment first (RFC 2018 4).
+    uint8_t* blocks = out + 4;
+    size_t count    = 0;
+    auto put        = [&](const SeqRangeList::Range& r) {
+        wire::store32(blocks + count * 8, r.start);
+        wire::store32(blocks + count * 8 + 4, r.end);
+        count++;
+    };
+
+    auto latest = reasm.latest();
+    if (latest) {
+        put(*latest);
+    }
+    for (const auto& r : reasm.ranges()) {
+        if (count == MaxSackBlocks) {
+            break;
+        }
+        if (!latest || r.start != latest->start) {
+            put(r);
+        }
+    }
+
+    out[0] = TCPOption::NOP;
+    out[1] = TCPOption::NOP;
+    out[2] = TCPOption::SACK;
+    out[3] = static_cast<uint8_t>(2 + count * 8);
+    return 4 + count * 8;
+}
+
+[[nodiscard]] uint16_t Connection::windowField(uint8_t flags) const noexcept {
+    // The window in a SYN is never scaled (RFC 7323 2.2).
+    uint32_t wnd = rcv.wnd;
+    if (!(flags & TCPView::SYN)) {
+        wnd >>= rcv.wndShift;
+    }
+    return static_cast<uint16_t>(std::min<uint32_t>(wnd, 65535));
+}
+
+bool Connection::emit(const SegmentFields& fields,
+                      std::span<const uint8_t> options,
+                      std::span<const uint8_t> payload,
+                      std::span<const uint8_t> payloadTail) noexcept {
+    auto maxLen =
+        txTemplate.maxOverhead() + payload.size() + payloadTail.size();
+    traceEvent(trace::Kind::SegmentOut,
+               fields.seq,
+               fields.ack,
+               payload.size() + payloadTail.size(),
+               fields.flags);
+
+    auto* batch = TxBatch::current();
+    if (!batch) {
+        std::vector<uint8_t> buf(maxLen);
+        auto len = txTemplate.emit(
+            buf.data(), fields, options, payload, payloadTail);
+        // Batched frames are counted by the batch as it flushes.
+        shard->stats.packetsOut.add();
+        shard->stats.bytesOut.add(len);
+        std::span<const uint8_t> frame{buf.data(), len};
+        if (shard->capture) {
+            shard->capture->onFrame(CaptureTap::Out, frame);
+        }
+        bool ok = shard->link->write(frame);
+        shard->link->flush();
+        return ok;
+    }
+
+    auto* out = batch->reserve(maxLen);
+    batch->commit(
+        txTemplate.emit(out, fields, options, payload, payloadTail));
+    return true;
+}
+
+void Connection::write(std::span<const uint8_t> data) {
+    if (finQueued) {
+        debug::println("Dropping write after close");
         return;
     }
+    if (pendingWrites.empty()) {
+        auto n = sndBuf.write(data);
+        data   = data.subspan(n);
+    }
+    // Keep the stream in order behind anything already waiting.
+    if (!data.empty()) {
+        pendingWrites.emplace_back(data.begin(), data.end());
+    }
+    transmitPending();
+}
 
-    auto& conn = connections[connSockets];
-    return conn.send(data, threadPool);
+void Connection::refillSendBuffer() {
+    if (pendingWrites.empty()) {
+        return;
+    }
+    while (!pendingWrites.empty() && sndBuf.free() > 0) {
+        auto& front = pendingWrites.front();
+        auto n      = sndBuf.write(
+            {reinterpret_cast<const uint8_t*>(front.data()), front.size()});
+        if (n < front.size()) {
+            front.erase(0, n);
+            return;
+        }
+        pendingWrites.pop_front();
+    }
 }
 
-void ConnectionManager::open(const SocketPair& connSockets) noexcept {
-    if (connections.contains(connSockets)) {
-        fmt::println("Error: Connection already exists");
+void Connection::transmitPending() noexcept {
+    size_t inFlight = snd.nxt - snd.una;
+    // With offload the kernel cuts super segments into MSS sized ones.
+    size_t maxLen =
+        shard->vnetHdr ? SegmentTemplate::MaxSuperSegment : size_t(sndMSS);
+
+    while (inFlight < sndBuf.size()) {
+        size_t unsent  = sndBuf.size() - inFlight;
+        size_t wnd     = std::min<size_t>(snd.wnd, cc->cwnd());
+        size_t wndLeft = wnd > inFlight ? wnd - inFlight : 0;
+        size_t len     = std::min({unsent, wndLeft, maxLen});
+        if (len == 0) {
+            break;
+        }
+
+        auto [head, tail] = sndBuf.peek(inFlight, len);
+        uint8_t flags     = TCPView::ACK;
+        if (len == unsent) {
+            flags |= TCPView::PSH;
+        }
+
+        SegmentFields fields = {
+            .seq    = snd.nxt,
+            .ack    = rcv.nxt,
+            .flags  = flags,
+            .window = windowField(flags),
+            .mss    = sndMSS,
+        };
+        if (!emit(fields, {}, head, tail)) {
+            debug::println("Failed to send data segment");
+            break;
+        }
+        if (ackTimer.armed()) {
+            stats.acksPiggybacked++;
+        }
+        onAckSent();
+
+        if (seqLT(snd.nxt, snd.max)) {
+            shard->stats.retransmits.add();
+            traceEvent(trace::Kind::Retransmit, snd.nxt, 0, len);
+        } else if (!rttTiming) {
+            rttTiming = true;
+            rttSeq    = snd.nxt + static_cast<uint32_t>(len);
+            rttStart  = TimerWheel::Clock::now();
+        }
+        snd.nxt += len;
+        inFlight += len;
+        if (seqGT(snd.nxt, snd.max)) {
+            snd.max = snd.nxt;
+        }
+    }
+
+    // The FIN follows the last byte, once that was sent. It doesn't wait
+    // for window.
+    if (finQueued && pendingWrites.empty() && inFlight == sndBuf.size() &&
+        !finAcked()) {
+        if (seqLT(snd.nxt, snd.max)) {
+            shard->stats.retransmits.add();
+            traceEvent(trace::Kind::Retransmit, snd.nxt, 0, 0);
+        }
+        if (sendSegment(TCPView::FIN | TCPView::ACK, snd.nxt)) {
+            finSent = true;
+            snd.nxt++;
+            if (seqGT(snd.nxt, snd.max)) {
+                snd.max = snd.nxt;
+            }
+        }
+    }
+
+    // Data or a FIN in flight needs the retransmission timer, and data held
+    // back by a zero window needs it to probe the window.
+    if ((!sndBuf.empty() || (finSent && !finAcked())) && !rtxTimer.armed()) {
+        shard->timers.arm(rtxTimer, TCPRetransmissionTime);
+    }
+}
+
+void Connection::onAck(const PacketView& pkt) noexcept {
+    const auto& tcp = pkt.tcp;
+    auto ack        = tcp.ack_seq();
+
+    if (sackOk) {
+        onSackBlocks(tcp);
+    }
+
+    if (seqGT(ack, snd.una)) {
+        auto now       = TimerWheel::Clock::now();
+        uint32_t acked = ack - snd.una;
+        // The FIN takes a sequence number but no place in the buffer.
+        auto consumed = std::min<size_t>(acked, sndBuf.size());
+        sndBuf.consume(consumed);
+        if (endpoint) {
+            endpoint->onSendAcked(consumed);
+        }
+        if (rttTiming && seqGEQ(ack, rttSeq)) {
+            rtt.sample(now - rttStart);
+            rttTiming = false;
+        }
+        snd.una  = ack;
+        rtxCount = 0;
+        sacked.trim(snd.una);
+        // After a retransmission rewound snd.nxt, the peer may ack data
+        // beyond it that it already got the first time.
+        if (seqLT(snd.nxt, snd.una)) {
+            snd.nxt = snd.una;
+        }
+
+        if (snd.una == snd.max) {
+            shard->timers.cancel(rtxTimer);
+        } else {
+            // RFC 6298 (5.3): restart the timer when new data is acked.
+            shard->timers.arm(rtxTimer, TCPRetransmissionTime);
+        }
+
+        if (!inRecovery) {
+            cc->onAck(acked, now);
+        } else if (seqGEQ(ack, recover) || !cc->partialAckRecovery()) {
+            inRecovery = false;
+            cc->onExitRecovery();
+        } else {
+            // Partial ACK (NewReno). Without SACK the next hole starts at
+            // snd.una, with it we go on from the last retransmission.
+            cc->onPartialAck(acked);
+            if (!sackOk) {
+                rtxHigh = snd.una;
+            }
+            retransmitHole();
+        }
+        dupAcks = 0;
+
+        refillSendBuffer();
+    } else if (ack == snd.una && pkt.payload.empty() &&
+               !(tcp.flags() & (TCPView::SYN | TCPView::FIN)) &&
+               peerWindow(tcp) == snd.wnd && snd.nxt != snd.una) {
+        // Duplicate ACK as RFC 5681 defines it, checked before the window
+        // update below.
+        onDupAck();
+    }
+
+    // RFC 793: update the window only from segments newer than the last one
+    // that updated it.
+    if (seqLT(snd.wl1, tcp.seq()) ||
+        (snd.wl1 == tcp.seq() && seqLEQ(snd.wl2, ack))) {
+        snd.wnd = peerWindow(tcp);
+        snd.wl1 = tcp.seq();
+        snd.wl2 = ack;
+    }
+
+    transmitPending();
+}
+
+void Connection::onDupAck() noexcept {
+    if (inRecovery) {
+        // Another segment left the network, the inflated window may let
+        // new data out. With SACK we also know where the next hole is.
+        cc->onDupAck();
+        if (sackOk) {
+            retransmitHole();
+        }
+        return;
+    }
+    if (++dupAcks != DupAckThreshold) {
+        return;
+    }
+    // Losses in a window that was already recovered from don't start
+    // another recovery (RFC 6582 3.2).
+    if (!seqGT(snd.una - 1, recover)) {
+        return;
+    }
+
+    // Fast retransmit, then fast recovery until everything outstanding now
+    // is acked.
+    stats.fastRetransmits++;
+    inRecovery = true;
+    recover    = snd.max;
+    rtxHigh    = snd.una;
+    cc->onEnterRecovery(snd.nxt - snd.una);
+    retransmitHole();
+}
+
+void Connection::onSackBlocks(const TCPView& tcp) noexcept {
+    for (const auto& option : tcp.options()) {
+        if (option.kind != TCPOption::SACK) {
+            continue;
+        }
+        for (size_t i = 0; i + 8 <= option.data.size(); i += 8) {
+            uint32_t start = wire::load32(option.data.data() + i);
+            uint32_t end   = wire::load32(option.data.data() + i + 4);
+            // Only blocks of what is outstanding mean anything, that also
+            // drops D-SACKs (RFC 2883) below snd.una.
+            if (!seqGT(end, snd.una) || seqGT(end, snd.max)) {
+                continue;
+            }
+            sacked.add(seqLT(start, snd.una) ? snd.una : start, end);
+        }
+    }
+}
+
+void Connection::retransmitHole() noexcept {
+    if (seqLT(rtxHigh, snd.una)) {
+        rtxHigh = snd.una;
+    }
+
+    auto ranges    = sacked.ranges();
+    uint32_t limit = ranges.empty() ? snd.una + sndMSS : ranges.back().start;
+    if (seqGT(limit, snd.nxt)) {
+        limit = snd.nxt;
+    }
+    // A lost FIN is left to the retransmission timer.
+    auto dataEnd = snd.una + static_cast<uint32_t>(sndBuf.size());
+    if (seqGT(limit, dataEnd)) {
+        limit = dataEnd;
+    }
+    auto hole = sacked.firstGap(rtxHigh, limit);
+    if (!hole) {
+        return;
+    }
+
+    size_t len        = std::min<size_t>(hole->end - hole->start, sndMSS);
+    auto [head, tail] = sndBuf.peek(hole->start - snd.una, len);
+    SegmentFields fields = {
+        .seq    = hole->start,
+        .ack    = rcv.nxt,
+        .flags  = TCPView::ACK,
+        .window = windowField(TCPView::ACK),
+    };
+    if (emit(fields, {}, head, tail)) {
+        onAckSent();
+        shard->stats.retransmits.add();
+        traceEvent(trace::Kind::Retransmit, hole->start, 0, len);
+    }
+    // An ACK from here on might be for either send (Karn).
+    rttTiming = false;
+    rtxHigh   = hole->start + static_cast<uint32_t>(len);
+}
+
+void Connection::onSynOptions(const TCPView& tcp) noexcept {
+    sndMSS = std::min(tcp.mss().value_or(DefaultMSS), shard->mss);
+    cc->setMSS(sndMSS);
+
+    auto shift = tcp.winscale();
+    wsOk       = shift.has_value();
+    if (wsOk) {
+        snd.wndShift = std::min(*shift, RcvSeqSpace::MaxWndShift);
+    } else {
+        // No scaling either way, so our window has to fit in 16 bits.
+        snd.wndShift = 0;
+        rcv.wndShift = 0;
+        rcv.wnd      = std::min<uint32_t>(rcv.wnd, 65535);
+    }
+
+    sackOk = tcp.sack_permitted();
+}
+
+void Connection::startAfter(uint32_t sndNxt) noexcept {
+    if (seqGT(snd.iss, sndNxt)) {
         return;
     }
+    // Past a whole unscaled window of the old connection too, as Linux
+    // does.
+    auto iss = sndNxt + 65535 + 2;
+    snd.iss  = snd.una = snd.nxt = snd.max = iss;
+    recover  = iss;
+}
+
+void Connection::onCookieAck(const TCPView& ack,
+                             uint32_t iss,
+                             uint16_t mss) noexcept {
+    snd.iss = iss;
+    snd.una = snd.nxt = snd.max = iss + 1;
+    // The SYN-ACK offered no scaling, so neither side scales.
+    wsOk         = false;
+    sackOk       = false;
+    snd.wndShift = 0;
+    rcv.wndShift = 0;
+    rcv.wnd      = std::min<uint32_t>(rcv.wnd, 65535);
+    snd.wnd      = ack.window();
+    snd.wl1      = ack.seq();
+    snd.wl2      = ack.ack_seq();
+    recover      = iss + 1;
 
-    connections.emplace(
-        std::piecewise_construct,
-        std::forward_as_tuple(connSockets),
-        std::forward_as_tuple(connSockets.src, connSockets.dst, tun));
+    rcv.irs = ack.seq() - 1;
+    rcv.nxt = ack.seq();
 
-    auto& conn = connections[connSockets];
-    return conn.open();
+    sndMSS = std::min(mss, shard->mss);
+    cc->setMSS(sndMSS);
+    moveTo(State::Value::Established);
+}
+
+void Connection::setCongestionControl(
+    CongestionControl::Algorithm algorithm) {
+    cc = makeCongestionControl(algorithm, sndMSS);
+}
+
+void Connection::onRetransmitTimeout() noexcept {
+    if (state == State::Value::SynSent || state == State::Value::SynRcvd) {
+        onHandshakeTimeout();
+        return;
+    }
+    if (sndBuf.empty() && !(finSent && !finAcked())) {
+        return;
+    }
+
+    // The peer closed its window, so this is the persist timer: probe the
+    // window with one byte. Probing doesn't count towards giving up.
+    if (snd.wnd == 0 && !sndBuf.empty()) {
+        auto [head, tail] = sndBuf.peek(0, 1);
+        SegmentFields fields = {
+            .seq    = snd.una,
+            .ack    = rcv.nxt,
+            .flags  = TCPView::ACK,
+            .window = windowField(TCPView::ACK),
+        };
+        emit(fields, {}, head, tail);
+        if (seqLT(snd.nxt, snd.una + 1)) {
+            snd.nxt = snd.una + 1;
+        }
+        if (seqGT(snd.nxt, snd.max)) {
+            snd.max = snd.nxt;
+        }
+        shard->timers.arm(rtxTimer, TCPRetransmissionTime);
+        return;
+    }
+
+    if (++rtxCount >= MaxRetransmissions) {
+        debug::println("Giving up on unacknowledged data after {} sends",
+                       MaxRetransmissions);
+        abort();
+        return;
+    }
+
+    stats.timeouts++;
+    shard->stats.rtoTimeouts.add();
+    traceEvent(trace::Kind::Timeout, snd.una, 0, rtxCount);
+    rttTiming = false;
+    cc->onRTO(snd.nxt - snd.una);
+    inRecovery = false;
+    dupAcks    = 0;
+    recover    = snd.max;
+    // The peer may renege on what it SACKed, start over (RFC 2018 8).
+    sacked.clear();
+
+    // Go back N: send again from snd.una, as far as the (now one segment)
+    // congestion window allows.
+    snd.nxt = snd.una;
+    transmitPending();
+    shard->timers.arm(rtxTimer, TCPRetransmissionTime);
+}
+
+void Connection::abort() noexcept {
+    bool synchronized = state != State::Value::Listen &&
+                        state != State::Value::SynSent && !finished();
+    if (synchronized) {
+        sendSegment(TCPView::RST, snd.nxt);
+        shard->stats.resetsOut.add();
+    }
+    if (endpoint) {
+        endpoint->setFailed();
+    }
+    moveTo(State::Value::Closed);
+}
+
+bool Connection::onIdleSweep(std::chrono::seconds interval) noexcept {
+    bool orphan = !endpoint && finQueued;
+    auto limit  = orphan ? OrphanTimeout : shard->idleTimeout;
+    if (limit.count() == 0) {
+        return false;
+    }
+    return ++idleSweeps * interval >= limit;
+}
+
+void Connection::onFin() noexcept {
+    rcv.nxt++;
+    ackNow();
+    if (endpoint) {
+        endpoint->setPeerClosed();
+    }
+}
+
+void Connection::onReset() noexcept {
+    shard->stats.resetsIn.add();
+    if (endpoint) {
+        endpoint->setFailed();
+    }
+}
+
+void Connection::replyReset(const PacketView& pkt) noexcept {
+    emit(resetFor(pkt));
+    shard->stats.resetsOut.add();
+}
+
+void Connection::onHandshakeTimeout() noexcept {
+    bool active = state == State::Value::SynSent;
+    if (rtxCount >= (active ? MaxSynRetries : MaxSynAckRetries)) {
+        debug::println("Dropping handshake after {} {}",
+                       rtxCount + 1,
+                       active ? "SYNs" : "SYN-ACKs");
+        shard->stats.handshakeTimeouts.add();
+        rtxCount = 0;
+        if (endpoint) {
+            endpoint->setFailed();
+        }
+        moveTo(State::Value::Closed);
+        return;
+    }
+    rtxCount++;
+    traceEvent(trace::Kind::Timeout, snd.iss, 0, rtxCount);
+    shard->stats.retransmits.add();
+    sendSegment(active ? TCPView::SYN : TCPView::SYN | TCPView::ACK, snd.iss);
+    shard->timers.arm(rtxTimer, TCPRetransmissionTime * (1 << rtxCount));
+}
+
+void Connection::onData(uint32_t seq, std::span<const uint8_t> data) {
+    stats.dataSegsIn++;
+
+    // Whatever is before rcv.nxt was already received.
+    if (seqLT(seq, rcv.nxt)) {
+        uint32_t skip = rcv.nxt - seq;
+        if (skip >= data.size()) {
+            return;
+        }
+        data = data.subspan(skip);
+        seq  = rcv.nxt;
+    }
+    // Never take in more than the window we advertised.
+    uint32_t offset = seq - rcv.nxt;
+    if (offset >= rcv.wnd) {
+        return;
+    }
+    data = data.first(std::min<size_t>(data.size(), rcv.wnd - offset));
+
+    if (seq != rcv.nxt) {
+        shard->stats.outOfOrder.add();
+        if (!reasm.insert(rcv.nxt, seq, data)) {
+            debug::println("Reassembly queue full, dropping segment");
+        }
+        return;
+    }
+
+    deliver(data);
+    rcv.nxt += data.size();
+
+    // This may have filled a gap, take everything that is now contiguous.
+    reasm.advance(rcv.nxt);
+    auto [head, tail] = reasm.front(rcv.nxt);
+    if (!head.empty()) {
+        deliver(head, tail);
+        rcv.nxt += head.size() + tail.size();
+        reasm.advance(rcv.nxt);
+    }
+}
+
+bool Connection::ackNow() noexcept {
+    return sendSegment(TCPView::ACK, snd.nxt);
+}
+
+void Connection::ackLater(size_t len) noexcept {
+    unackedBytes += len;
+    if (!delayedAck.enabled ||
+        unackedBytes >= delayedAck.maxSegments * sndMSS) {
+        ackNow();
+        return;
+    }
+
+    stats.acksDelayed++;
+    if (!ackTimer.armed()) {
+        shard->timers.arm(ackTimer, delayedAck.timeout);
+    }
+}
+
+void Connection::onAckSent() noexcept {
+    unackedBytes = 0;
+    shard->timers.cancel(ackTimer);
+}
+
+void Connection::deliver(std::span<const uint8_t> data,
+                         std::span<const uint8_t> tail) {
+    if (endpoint) {
+        // What the application holds comes out of the window, so the right
+        // edge stays put until it reads.
+        rcv.wnd -= static_cast<uint32_t>(data.size() + tail.size());
+        endpoint->deliver(data, tail, windowUpdateAt());
+        return;
+    }
+    fmt::print("{}:{} > ", dst.addr.to_string(), dst.port);
+    fmt::print("{}", std::string_view((const char*)data.data(), data.size()));
+    fmt::print("{}", std::string_view((const char*)tail.data(), tail.size()));
+}
+
+void Connection::onRecvSpace() noexcept {
+    // Without an application the shell takes data as it comes.
+    auto space = endpoint ? endpoint->rcvSpace() : Endpoint::RcvBufSize;
+    space      = std::min<size_t>(space, size_t{65535} << rcv.wndShift);
+    if (space >= windowUpdateAt()) {
+        rcv.wnd = static_cast<uint32_t>(space);
+        if (!ackNow()) {
+            debug::println("Failed to send window update");
+        }
+    }
+    // The application only calls again once a read reaches the next one.
+    if (endpoint) {
+        endpoint->setWindowUpdateAt(windowUpdateAt());
+    }
+}
+
+[[nodiscard]] size_t Connection::windowUpdateAt() const noexcept {
+    // Receiver side silly window avoidance: small openings aren't worth
+    // announcing.
+    auto threshold = std::min<size_t>(Endpoint::RcvBufSize / 2, shard->mss);
+    auto at        = size_t{rcv.wnd} + threshold;
+    return at <= size_t{65535} << rcv.wndShift ? at : SIZE_MAX;
+}
+
+void Connection::onStateChange(State::Value prev) {
+    if (state == State::Value::SynRcvd) {
+        shard->stats.halfOpen.set(++shard->halfOpen);
+    } else if (prev == State::Value::SynRcvd) {
+        shard->stats.halfOpen.set(--shard->halfOpen);
+        shard->timers.cancel(rtxTimer);
+        rtxCount = 0;
+    } else if (prev == State::Value::SynSent) {
+        shard->timers.cancel(rtxTimer);
+        rtxCount = 0;
+    }
+    if (finished()) {
+        shard->timers.cancel(rtxTimer);
+        shard->timers.cancel(ackTimer);
+        auto key = FlowKey::from({src, dst});
+        if (state == State::Value::TimeWait) {
+            shard->timeWait.add(
+                key, snd.nxt, rcv.nxt, TimeWaitTable::Clock::now());
+            shard->stats.timeWait.set(shard->timeWait.size());
+        }
+        shard->closed.push_back(key);
+        return;
+    }
+    // Nobody is left to close a connection of the shell, or one whose
+    // application let go of it.
+    if (state == State::Value::CloseWait && !endpoint) {
+        close();
+        return;
+    }
+    if (state != State::Value::Established) {
+        return;
+    }
+    shard->stats.established.add();
+    if (endpoint) {
+        endpoint->setConnected();
+        return;
+    }
+
+    // Passive open on a port an application listens on, through SYN-RECEIVED
+    // or straight from LISTEN when the SYN-ACK carried a cookie.
+    bool passive =
+        prev == State::Value::SynRcvd || prev == State::Value::Listen;
+    if (passive && shard->stack) {
+        if (auto listener = shard->stack->listener(src.port)) {
+            endpoint       = std::make_shared<Endpoint>(SocketPair{src, dst});
+            endpoint->conn = this;
+            endpoint->setConnected();
+            listener->pushAccepted(endpoint);
+        }
+    }
+}
+
+void ConnectionManager::setLastRecv(const SocketPair& socketPair) noexcept {
+    // Bulk traffic on one flow keeps hitting this, only the first packet of
+    // a different flow has to take the lock.
+    if (lastSeen == socketPair) {
+        return;
+    }
+    lastSeen = socketPair;
+
+    {
+        std::scoped_lock lock(lastRcvdMutex);
+        lastRvcd = socketPair;
+    }
+    if (stack) {
+        stack->setLastShard(shardId);
+    }
+}
+
+void ConnectionManager::send(const SocketPair& connSockets,
+                             const std::string& data) noexcept {
+    inbox.post([this, connSockets, data, postedAt = tsc::now()] {
+        auto startedAt = tsc::now();
+        ctx.latency.record(Stage::InboxWait, startedAt - postedAt);
+
+        auto* conn = connections.find(FlowKey::from(connSockets));
+        if (!conn) {
+            fmt::println("Error: Connection does not exist");
+            return;
+        }
+
+        conn->send(data);
+        ctx.latency.record(Stage::Send, tsc::now() - startedAt);
+    });
+}
+
+void ConnectionManager::open(const SocketPair& connSockets,
+                             std::shared_ptr<Endpoint> endpoint) noexcept {
+    inbox.post([this, connSockets, endpoint] {
+        auto key             = FlowKey::from(connSockets);
+        auto [conn, created] = connections.tryEmplace(
+            key, connSockets.src, connSockets.dst, ctx);
+        if (!created) {
+            fmt::println("Error: Connection already exists");
+            ctx.stats.handshakeFails.add();
+            if (endpoint) {
+                endpoint->setFailed();
+            }
+            return;
+        }
+        ctx.stats.connections.set(connections.size());
+        endTimeWait(key, *conn);
+
+        if (endpoint) {
+            conn->endpoint = endpoint;
+            endpoint->conn = conn;
+        }
+        conn->open();
+    });
+}
+
+void ConnectionManager::spawn(Task task) noexcept {
+    resume(task.release());
+}
+
+void ConnectionManager::resume(std::coroutine_handle<> h) noexcept {
+    inbox.post([this, h] {
+        ctx.scheduler.schedule(h);
+    });
+}
+
+void ConnectionManager::withConnection(
+    const SocketPair& connSockets,
+    std::function<void(Connection&)> fn) noexcept {
+    inbox.post([this, connSockets, fn = std::move(fn)] {
+        if (auto* conn = connections.find(FlowKey::from(connSockets))) {
+            fn(*conn);
+        }
+    });
 }
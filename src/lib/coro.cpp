@@ -0,0 +1,127 @@
+#include "coro.hpp"
+#include "connection.hpp"
+#include "endpoint.hpp"
+#include "scheduler.hpp"
+#include "socketApi.hpp"
+#include <coroutine>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <tl/expected.hpp>
+#include <utility>
+
+using namespace tcp;
+
+bool AsyncSocket::RecvAwaiter::await_ready() {
+    n = endpoint.read(buf);
+    return n > 0 || endpoint.failed() || endpoint.peerClosed();
+}
+
+tl::expected<size_t, SocketError> AsyncSocket::RecvAwaiter::await_resume() {
+    if (n == 0) {
+        n = endpoint.read(buf);
+    }
+    if (n == 0) {
+        return tl::make_unexpected(endpoint.failed() ? SocketError::Failed
+                                                     : SocketError::Closed);
+    }
+    // The read made room, the connection may have a window to announce.
+    if (endpoint.conn && endpoint.takeWindowUpdate()) {
+        endpoint.conn->onRecvSpace();
+    }
+    return n;
+}
+
+bool AsyncSocket::SendAwaiter::await_ready() {
+    auto* conn = endpoint.conn;
+    if (!conn || !endpoint.connected() || endpoint.failed()) {
+        return true;
+    }
+    // All of it goes to the connection, and the coroutine waits while that
+    // took the send buffer past its size.
+    endpoint.claimSendSpaceOver(data.size());
+    conn->write(data);
+    queued = true;
+    return false;
+}
+
+tl::expected<size_t, SocketError> AsyncSocket::SendAwaiter::await_resume() {
+    if (endpoint.failed()) {
+        return tl::make_unexpected(SocketError::Failed);
+    }
+    if (!queued) {
+        return tl::make_unexpected(SocketError::NotConnected);
+    }
+    return data.size();
+}
+
+void AsyncSocket::close() noexcept {
+    auto* conn = std::exchange(endpoint->conn, nullptr);
+    if (!conn) {
+        return;
+    }
+    conn->endpoint.reset();
+    conn->onRecvSpace();
+    conn->close();
+}
+
+[[nodiscard]] tl::expected<AsyncListener, SocketError>
+AsyncListener::listen(Stack& stack,
+                      const Tins::IPv4Address& localIP,
+                      uint16_t port) {
+    auto endpoint = std::make_shared<Endpoint>(SocketPair{
+        .src = {localIP, port},
+        .dst = {},
+    });
+    if (!stack.listen(port, endpoint)) {
+        return tl::make_unexpected(SocketError::AddressInUse);
+    }
+    return AsyncListener(stack, std::move(endpoint));
+}
+
+bool AsyncListener::AcceptAwaiter::await_suspend(std::coroutine_handle<> h) {
+    conn = listener.popAccepted();
+    if (!conn) {
+        if (listener.awaitReady(h, Readable)) {
+            return true;
+        }
+        conn = listener.popAccepted();
+        if (!conn) {
+            return false;
+        }
+    }
+    auto& owner = stack.shardFor(conn->pair);
+    if (owner.isCurrent()) {
+        return false;
+    }
+    owner.resume(h);
+    return true;
+}
+
+AsyncSocket AsyncListener::AcceptAwaiter::await_resume() {
+    if (!conn) {
+        // Woken by the shard that queued a connection on the empty listener,
+        // on its thread. With a single coroutine taking them, that's the
+        // connection at the front.
+        conn = listener.popAccepted();
+    }
+    return AsyncSocket(std::move(conn));
+}
+
+AsyncListener::~AsyncListener() {
+    if (!endpoint) {
+        return;
+    }
+    stack->unlisten(endpoint->pair.src.port);
+    while (auto conn = endpoint->popAccepted()) {
+        stack->detach(std::move(conn));
+    }
+}
+
+void SleepAwaiter::await_suspend(std::coroutine_handle<> h) {
+    auto* scheduler = Scheduler::current();
+    timer.setCallback([scheduler, h] {
+        scheduler->schedule(h);
+    });
+    scheduler->timers().arm(timer, after);
+}
@@ -0,0 +1,278 @@
+#include "endpoint.hpp"
+#include "debug.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+using namespace tcp;
+
+void Endpoint::deliver(std::span<const uint8_t> data,
+                       std::span<const uint8_t> tail,
+                       size_t updateAt) {
+    std::scoped_lock lock(mutex);
+    rcvBuf.write(data);
+    rcvBuf.write(tail);
+    wndUpdateAt      = updateAt;
+    wndUpdatePending = false;
+    notifyLocked();
+}
+
+void Endpoint::setWindowUpdateAt(size_t updateAt) {
+    std::scoped_lock lock(mutex);
+    wndUpdateAt      = updateAt;
+    wndUpdatePending = false;
+}
+
+void Endpoint::onSendAcked(size_t n) {
+    std::scoped_lock lock(mutex);
+    bool wasFull = sndClaimed >= SndBufSize;
+    sndClaimed -= std::min(n, sndClaimed);
+    if (!wasFull || sndClaimed >= SndBufSize) {
+        return;
+    }
+    notifyLocked();
+    if (sendWaiter) {
+        resumeLater(std::exchange(sendWaiter, {}));
+    }
+}
+
+void Endpoint::setConnected() {
+    std::scoped_lock lock(mutex);
+    isConnected = true;
+    notifyLocked();
+}
+
+void Endpoint::setFailed() {
+    std::scoped_lock lock(mutex);
+    isFailed = true;
+    notifyLocked();
+    if (sendWaiter) {
+        resumeLater(std::exchange(sendWaiter, {}));
+    }
+}
+
+void Endpoint::setPeerClosed() {
+    std::scoped_lock lock(mutex);
+    isPeerClosed = true;
+    notifyLocked();
+}
+
+void Endpoint::pushAccepted(std::shared_ptr<Endpoint> endpoint) {
+    std::scoped_lock lock(mutex);
+    accepted.push_back(std::move(endpoint));
+    notifyLocked();
+}
+
+[[nodiscard]] size_t Endpoint::read(std::span<uint8_t> out) {
+    std::scoped_lock lock(mutex);
+    return rcvBuf.read(out);
+}
+
+[[nodiscard]] bool Endpoint::takeWindowUpdate() {
+    std::scoped_lock lock(mutex);
+    if (wndUpdatePending || rcvBuf.free() < wndUpdateAt) {
+        return false;
+    }
+    wndUpdatePending = true;
+    return true;
+}
+
+[[nodiscard]] size_t Endpoint::claimSendSpace(size_t n) {
+    std::scoped_lock lock(mutex);
+    n = std::min(n, SndBufSize - std::min(sndClaimed, SndBufSize));
+    sndClaimed += n;
+    return n;
+}
+
+void Endpoint::claimSendSpaceOver(size_t n) {
+    std::scoped_lock lock(mutex);
+    sndClaimed += n;
+}
+
+[[nodiscard]] std::shared_ptr<Endpoint> Endpoint::popAccepted() {
+    std::scoped_lock lock(mutex);
+    if (accepted.empty()) {
+        return nullptr;
+    }
+    auto next = std::move(accepted.front());
+    accepted.pop_front();
+    return next;
+}
+
+[[nodiscard]] bool Endpoint::connected() const {
+    std::scoped_lock lock(mutex);
+    return isConnected;
+}
+
+[[nodiscard]] bool Endpoint::failed() const {
+    std::scoped_lock lock(mutex);
+    return isFailed;
+}
+
+[[nodiscard]] bool Endpoint::peerClosed() const {
+    std::scoped_lock lock(mutex);
+    return isPeerClosed;
+}
+
+[[nodiscard]] size_t Endpoint::rcvSpace() const {
+    std::scoped_lock lock(mutex);
+    return rcvBuf.free();
+}
+
+[[nodiscard]] uint32_t Endpoint::readiness() const {
+    std::scoped_lock lock(mutex);
+    return readinessLocked();
+}
+
+void Endpoint::watch(Poller* p, SocketHandle h) {
+    std::scoped_lock lock(mutex);
+    poller = p;
+    handle = h;
+    // Whatever is ready already has to be reported too.
+    notifyLocked();
+}
+
+[[nodiscard]] bool Endpoint::awaitReady(std::coroutine_handle<> h,
+                                        uint32_t events) {
+    std::scoped_lock lock(mutex);
+    if (readinessLocked() & events) {
+        return false;
+    }
+    readWaiter       = h;
+    readWaiterEvents = events;
+    return true;
+}
+
+[[nodiscard]] bool Endpoint::awaitSendSpace(std::coroutine_handle<> h) {
+    std::scoped_lock lock(mutex);
+    if (sndClaimed < SndBufSize || isFailed) {
+        return false;
+    }
+    sendWaiter = h;
+    return true;
+}
+
+void Endpoint::resumeLater(std::coroutine_handle<> h) {
+    if (auto* scheduler = Scheduler::current()) {
+        scheduler->schedule(h);
+        return;
+    }
+    debug::println("No scheduler on this thread, coroutine is lost");
+}
+
+[[nodiscard]] uint32_t Endpoint::readinessLocked() const noexcept {
+    uint32_t events = 0;
+    if (!rcvBuf.empty() || !accepted.empty() || isFailed || isPeerClosed) {
+        events |= Readable;
+    }
+    if (isConnected && !isFailed && sndClaimed < SndBufSize) {
+        events |= Writable;
+    }
+    if (isFailed) {
+        events |= Failed;
+    }
+    return events;
+}
+
+void Endpoint::notifyLocked() {
+    auto events = readinessLocked();
+    if (poller && events != 0) {
+        poller->markReady(handle);
+    }
+    if (readWaiter && (events & readWaiterEvents)) {
+        resumeLater(std::exchange(readWaiter, {}));
+    }
+}
+
+size_t Poller::wait(std::span<Event> out,
+                    std::optional<std::chrono::milliseconds> timeout) {
+    if (out.empty()) {
+        return 0;
+    }
+    auto deadline = std::chrono::steady_clock::now() +
+                    timeout.value_or(std::chrono::milliseconds::zero());
+
+    std::vector<std::pair<SocketHandle, Watch>> candidates;
+    std::unique_lock lock(mutex);
+    while (true) {
+        auto hasReady = [this] {
+            return !ready.empty();
+        };
+        if (!timeout) {
+            cv.wait(lock, hasReady);
+        } else if (!cv.wait_until(lock, deadline, hasReady)) {
+            return 0;
+        }
+
+        candidates.clear();
+        while (!ready.empty() && candidates.size() < out.size()) {
+            auto h = ready.front();
+            ready.pop_front();
+            // Not queued anymore if it was removed since.
+            if (queued.erase(h) == 0) {
+                continue;
+            }
+            if (auto it = watches.find(h); it != watches.end()) {
+                candidates.emplace_back(h, it->second);
+            }
+        }
+
+        // Endpoints are locked before the poller when they report, so they
+        // are looked at with the poller unlocked.
+        lock.unlock();
+        size_t n = 0;
+        for (auto& [h, w] : candidates) {
+            auto events = w.endpoint->readiness() & (w.interest | Failed);
+            if (events != 0) {
+                out[n++] = {h, events};
+            }
+        }
+        lock.lock();
+
+        // Level triggered: whatever was ready stays on the list, and is
+        // dropped by a later wait once it isn't.
+        for (size_t i = 0; i < n; i++) {
+            auto h = out[i].handle;
+            if (watches.contains(h) && queued.insert(h).second) {
+                ready.push_back(h);
+            }
+        }
+        if (n > 0) {
+            return n;
+        }
+    }
+}
+
+void Poller::add(SocketHandle handle,
+                 std::shared_ptr<Endpoint> endpoint,
+                 uint32_t interest) {
+    std::scoped_lock lock(mutex);
+    watches[handle] = {std::move(endpoint), interest};
+}
+
+void Poller::remove(SocketHandle handle) {
+    std::scoped_lock lock(mutex);
+    watches.erase(handle);
+    // Left in ready, if it's there, for wait to skip.
+    queued.erase(handle);
+}
+
+void Poller::markReady(SocketHandle handle) {
+    {
+        std::scoped_lock lock(mutex);
+        if (!queued.insert(handle).second) {
+            return;
+        }
+        ready.push_back(handle);
+    }
+    cv.notify_one();
+}
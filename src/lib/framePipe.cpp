@@ -0,0 +1,64 @@
+#include "framePipe.hpp"
+#include <algorithm>
+#include <bit>
+#include <span>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace tcp;
+
+FramePipe::FramePipe(size_t numSlots, size_t slotSize)
+    : buf(std::bit_ceil(numSlots) * slotSize), lens(std::bit_ceil(numSlots)),
+      slotSize(slotSize), mask(lens.size() - 1),
+      efd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (efd == -1) {
+        throw std::runtime_error("Couldn't create eventfd for frame pipe");
+    }
+}
+
+FramePipe::~FramePipe() {
+    close(efd);
+}
+
+bool FramePipe::push(std::span<const uint8_t> frame,
+                     std::span<const uint8_t> rest) noexcept {
+    auto t   = tail.load(std::memory_order_relaxed);
+    auto len = frame.size() + rest.size();
+    if (len > slotSize ||
+        t - head.load(std::memory_order_acquire) == lens.size()) {
+        return false;
+    }
+    auto* out = buf.data() + (t & mask) * slotSize;
+    memcpy(out, frame.data(), frame.size());
+    if (!rest.empty()) {
+        memcpy(out + frame.size(), rest.data(), rest.size());
+    }
+    lens[t & mask] = static_cast<uint32_t>(len);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+void FramePipe::signal() noexcept {
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(efd, &one, sizeof(one));
+}
+
+[[nodiscard]] size_t FramePipe::pop(std::span<uint8_t> out) noexcept {
+    auto h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    auto slot = h & mask;
+    auto len  = std::min<size_t>(lens[slot], out.size());
+    memcpy(out.data(), buf.data() + slot * slotSize, len);
+    head.store(h + 1, std::memory_order_release);
+    return len;
+}
+
+void FramePipe::clearSignal() noexcept {
+    uint64_t count;
+    [[maybe_unused]] auto n = ::read(efd, &count, sizeof(count));
+}
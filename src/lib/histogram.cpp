@@ -0,0 +1,42 @@
+#include "histogram.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace tcp;
+
+[[nodiscard]] uint64_t HistogramSnapshot::percentile(double q) const noexcept {
+    if (total == 0) {
+        return 0;
+    }
+    // Rank of the value, from 1.
+    auto rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return LatencyHistogram::upperBound(i);
+        }
+    }
+    return LatencyHistogram::upperBound(counts.size() - 1);
+}
+
+[[nodiscard]] const char* tcp::stageName(Stage stage) noexcept {
+    switch (stage) {
+    case Stage::ReadToParse:
+        return "read_to_parse";
+    case Stage::ParseToLookup:
+        return "parse_to_lookup";
+    case Stage::Handler:
+        return "handler";
+    case Stage::HandlerToWrite:
+        return "handler_to_write";
+    case Stage::InboxWait:
+        return "inbox_wait";
+    case Stage::Send:
+        return "send";
+    }
+    return "?";
+}
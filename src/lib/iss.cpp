@@ -0,0 +1,22 @@
+#include "iss.hpp"
+#include "sipHash.hpp"
+#include "socket.hpp"
+#include <array>
+#include <chrono>
+#include <stdint.h>
+
+using namespace tcp;
+
+IssGenerator::IssGenerator() : secret(sipHash::randomKey()) {
+}
+
+[[nodiscard]] uint32_t
+IssGenerator::make(const FlowKey& flow,
+                   Clock::time_point now) const noexcept {
+    std::array<uint64_t, 2> words = {
+        static_cast<uint64_t>(flow.srcAddr) << 32 | flow.dstAddr,
+        flow.ports,
+    };
+    auto clock = static_cast<uint32_t>(now.time_since_epoch() / Tick);
+    return clock + static_cast<uint32_t>(sipHash::hash(secret, words));
+}
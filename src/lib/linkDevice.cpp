@@ -0,0 +1,115 @@
+#include "linkDevice.hpp"
+#include "debug.hpp"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utility>
+
+#ifdef __APPLE__
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+using namespace tcp;
+
+TunLink::TunLink(int fd) : fd(fd) {
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+        throw std::runtime_error("Couldn't make tun interface non blocking");
+    }
+}
+
+[[nodiscard]] ssize_t TunLink::read(std::span<uint8_t> buf) noexcept {
+    while (true) {
+        auto n = ::read(fd, buf.data(), buf.size());
+        if (n != -1) {
+            return n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        debug::println("Couldn't read from tun interface, errno: {}", errno);
+        return -1;
+    }
+}
+
+bool TunLink::write(std::span<const uint8_t> frame) noexcept {
+    ssize_t n;
+    do {
+        n = ::write(fd, frame.data(), frame.size());
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        debug::println("Failed to write frame to tun, errno: {}", errno);
+        return false;
+    }
+    return true;
+}
+
+#ifdef __APPLE__
+[[nodiscard]] ssize_t UTunLink::read(std::span<uint8_t> buf) noexcept {
+    uint32_t family;
+    iovec iov[] = {
+        {.iov_base = &family, .iov_len = sizeof(family)},
+        {.iov_base = buf.data(), .iov_len = buf.size()},
+    };
+    auto n = ::readv(utun.Fd(), iov, 2);
+    if (n == -1) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    return std::max<ssize_t>(n - static_cast<ssize_t>(sizeof(family)), 0);
+}
+
+bool UTunLink::write(std::span<const uint8_t> frame) noexcept {
+    uint32_t family = htonl(AF_INET);
+    iovec iov[]     = {
+        {.iov_base = &family, .iov_len = sizeof(family)},
+        {.iov_base = const_cast<uint8_t*>(frame.data()),
+         .iov_len  = frame.size()},
+    };
+    return ::writev(utun.Fd(), iov, 2) != -1;
+}
+#endif
+
+[[nodiscard]] std::pair<std::unique_ptr<MemoryLink>,
+                        std::unique_ptr<MemoryLink>>
+MemoryLink::pair(size_t slotSize, size_t numSlots) {
+    auto aToB = std::make_shared<FramePipe>(numSlots, slotSize);
+    auto bToA = std::make_shared<FramePipe>(numSlots, slotSize);
+    return {std::make_unique<MemoryLink>(bToA, aToB),
+            std::make_unique<MemoryLink>(aToB, bToA)};
+}
+
+[[nodiscard]] ssize_t MemoryLink::read(std::span<uint8_t> buf) noexcept {
+    if (auto n = rx->pop(buf)) {
+        return static_cast<ssize_t>(n);
+    }
+    // Empty: clear the wakeup and look once more, anything pushed before
+    // its signal was cleared is visible now, anything after signals again.
+    rx->clearSignal();
+    return static_cast<ssize_t>(rx->pop(buf));
+}
+
+bool MemoryLink::write(std::span<const uint8_t> frame) noexcept {
+    if (!tx->push(frame)) {
+        debug::println("Memory link full, dropping frame");
+        return false;
+    }
+    pending = true;
+    return true;
+}
+
+void MemoryLink::flush() noexcept {
+    if (pending) {
+        tx->signal();
+        pending = false;
+    }
+}
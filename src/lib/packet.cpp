@@ -0,0 +1,90 @@
+#include "packet.hpp"
+#include "checksum.hpp"
+#include "tcp.hpp"
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <tl/expected.hpp>
+
+using namespace tcp;
+
+[[nodiscard]] tl::expected<PacketView, PacketView::ParseError>
+PacketView::parse(std::span<const uint8_t> buf) noexcept {
+    if (buf.size() < IPv4View::MinHeaderSize) {
+        return tl::make_unexpected(ParseError::Truncated);
+    }
+
+    IPv4View ip(buf.data());
+    if (ip.version() != 4) {
+        return tl::make_unexpected(ParseError::NotIPv4);
+    }
+
+    auto ipHeaderSize = ip.header_size();
+    size_t totLen     = ip.tot_len();
+    if (ipHeaderSize < IPv4View::MinHeaderSize || totLen < ipHeaderSize) {
+        return tl::make_unexpected(ParseError::BadIPHeader);
+    }
+    if (totLen > buf.size()) {
+        return tl::make_unexpected(ParseError::Truncated);
+    }
+
+    // We don't do reassembly, so fragments are of no use to us.
+    if (ip.more_fragments() || ip.fragment_offset() != 0) {
+        return tl::make_unexpected(ParseError::Fragmented);
+    }
+
+    if (ip.protocol() != ProtocolNumInIP) {
+        return tl::make_unexpected(ParseError::NotTCP);
+    }
+
+    // Anything after tot_len is link padding, not part of the packet.
+    auto segment = buf.subspan(ipHeaderSize, totLen - ipHeaderSize);
+    if (segment.size() < TCPView::MinHeaderSize) {
+        return tl::make_unexpected(ParseError::Truncated);
+    }
+
+    TCPView tcp(segment.data());
+    auto tcpHeaderSize = tcp.header_size();
+    if (tcpHeaderSize < TCPView::MinHeaderSize ||
+        tcpHeaderSize > segment.size()) {
+        return tl::make_unexpected(ParseError::BadTCPHeader);
+    }
+
+    return PacketView{
+        .ip      = ip,
+        .tcp     = tcp,
+        .payload = segment.subspan(tcpHeaderSize),
+    };
+}
+
+[[nodiscard]] bool PacketView::ipChecksumValid() const noexcept {
+    return checksum::valid(checksum::partial(ip.bytes()));
+}
+
+[[nodiscard]] bool PacketView::tcpChecksumValid() const noexcept {
+    auto header = tcp.bytes();
+    auto tcpLen = header.size() + payload.size();
+    // Pseudo header: the addresses, protocol and TCP length.
+    uint64_t sum = checksum::partial(ip.bytes().subspan(12, 8)) +
+                   ProtocolNumInIP + tcpLen;
+    sum = checksum::partial(header, sum);
+    return checksum::valid(checksum::partial(payload, sum));
+}
+
+[[nodiscard]] const char* tcp::toString(PacketView::ParseError err) noexcept {
+    switch (err) {
+    case PacketView::ParseError::Truncated:
+        return "truncated packet";
+    case PacketView::ParseError::NotIPv4:
+        return "not an ipv4 packet";
+    case PacketView::ParseError::BadIPHeader:
+        return "malformed ip header";
+    case PacketView::ParseError::Fragmented:
+        return "ip fragment";
+    case PacketView::ParseError::NotTCP:
+        return "not a tcp packet";
+    case PacketView::ParseError::BadTCPHeader:
+        return "malformed tcp header";
+    }
+    return "unknown";
+}
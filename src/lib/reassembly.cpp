@@ -0,0 +1,83 @@
+#include "reassembly.hpp"
+#include "ringBuffer.hpp"
+#include "tcp.hpp"
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+
+using namespace tcp;
+
+ReassemblyQueue::ReassemblyQueue(size_t window) noexcept
+    : blocks(MaxBlocks), cap(std::bit_ceil(window)) {
+}
+
+bool ReassemblyQueue::insert(uint32_t nxt,
+                             uint32_t seq,
+                             std::span<const uint8_t> data) {
+    advance(nxt);
+
+    // Trim what was already received.
+    if (seqLT(seq, nxt)) {
+        uint32_t skip = nxt - seq;
+        if (skip >= data.size()) {
+            return true;
+        }
+        data = data.subspan(skip);
+        seq  = nxt;
+    }
+    // And what doesn't fit in the window.
+    uint32_t offset = seq - nxt;
+    if (offset >= cap) {
+        return false;
+    }
+    data = data.first(std::min<size_t>(data.size(), cap - offset));
+    if (data.empty()) {
+        return true;
+    }
+    uint32_t end = seq + static_cast<uint32_t>(data.size());
+    reserve(end - nxt);
+    if (!blocks.add(seq, end)) {
+        return false;
+    }
+    lastInsert = seq;
+    ring::copyIn(buf.get(), alloc, seq, data);
+    return true;
+}
+
+void ReassemblyQueue::reserve(size_t need) {
+    if (need <= alloc) {
+        return;
+    }
+    auto newAlloc = ring::allocFor(need, cap);
+    auto newBuf   = std::make_unique_for_overwrite<uint8_t[]>(newAlloc);
+    // Every block lies within `alloc` bytes of rcv.nxt, so it has a place
+    // in both.
+    for (const auto& r : blocks.ranges()) {
+        auto [first, second] =
+            ring::pieces(buf.get(), alloc, r.start, r.end - r.start);
+        ring::copyIn(newBuf.get(), newAlloc, r.start, first);
+        ring::copyIn(
+            newBuf.get(), newAlloc, r.start + first.size(), second);
+    }
+    buf   = std::move(newBuf);
+    alloc = newAlloc;
+}
+
+[[nodiscard]] std::pair<std::span<const uint8_t>, std::span<const uint8_t>>
+ReassemblyQueue::front(uint32_t nxt) const noexcept {
+    auto ranges = blocks.ranges();
+    if (ranges.empty() || ranges.front().start != nxt) {
+        return {};
+    }
+
+    return ring::pieces(buf.get(), alloc, nxt, ranges.front().end - nxt);
+}
+
+void ReassemblyQueue::advance(uint32_t nxt) noexcept {
+    blocks.trim(nxt);
+}
@@ -0,0 +1,5 @@
+#include "scheduler.hpp"
+
+using namespace tcp;
+
+thread_local Scheduler* Scheduler::active = nullptr;
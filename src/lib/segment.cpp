@@ -0,0 +1,111 @@
+#include "segment.hpp"
+#include "checksum.hpp"
+#include "packet.hpp"
+#include "socket.hpp"
+#include "tcp.hpp"
+#include "virtioNet.hpp"
+#include <span>
+#include <stdint.h>
+#include <string.h>
+
+using namespace tcp;
+
+SegmentTemplate::SegmentTemplate(const Socket& local,
+                                 const Socket& remote,
+                                 uint8_t ttl,
+                                 bool vnetHdr)
+    : prefix(vnetHdr ? VnetHdrSize : 0) {
+    uint8_t* ip = header.data();
+    ip[0]       = 0x45; // IPv4, 5 words of header.
+    ip[6]       = 0x40; // Don't fragment.
+    ip[8]       = ttl;
+    ip[9]       = ProtocolNumInIP;
+
+    // IPv4Address converts to a network order integer.
+    uint32_t srcAddr = local.addr;
+    uint32_t dstAddr = remote.addr;
+    memcpy(ip + 12, &srcAddr, sizeof(srcAddr));
+    memcpy(ip + 16, &dstAddr, sizeof(dstAddr));
+
+    uint8_t* tcp = ip + IPHeaderSize;
+    wire::store16(tcp, local.port);
+    wire::store16(tcp + 2, remote.port);
+
+    // tot_len, id and checksum are still zero here.
+    ipSum = checksum::partial({ip, IPHeaderSize});
+
+    // Pseudo header (addresses and protocol) and the ports.
+    pseudoSum = checksum::partial({ip + 12, 8}) + ProtocolNumInIP;
+    tcpSum    = checksum::partial({tcp, 4}, pseudoSum);
+}
+
+size_t SegmentTemplate::emit(uint8_t* out,
+                             const SegmentFields& fields,
+                             std::span<const uint8_t> options,
+                             std::span<const uint8_t> payload,
+                             std::span<const uint8_t> payloadTail)
+    const noexcept {
+    auto payloadLen    = payload.size() + payloadTail.size();
+    auto tcpHeaderSize = TCPHeaderSize + options.size();
+    auto tcpLen        = tcpHeaderSize + payloadLen;
+    auto totLen        = IPHeaderSize + tcpLen;
+
+    if (prefix) {
+        // The kernel finishes the TCP checksum from csum_start on, and with
+        // GSO also cuts the payload into gso_size segments.
+        VirtioNetHdr vnet{};
+        vnet.flags      = VirtioNetHdr::NeedsCsum;
+        vnet.csumStart  = IPHeaderSize;
+        vnet.csumOffset = TCPChecksumOffset - IPHeaderSize;
+        if (fields.mss && payloadLen > fields.mss) {
+            vnet.gsoType = VirtioNetHdr::GSOTCPv4;
+            vnet.gsoSize = fields.mss;
+            vnet.hdrLen  = static_cast<uint16_t>(IPHeaderSize + tcpHeaderSize);
+        }
+        memcpy(out, &vnet, sizeof(vnet));
+    }
+
+    uint8_t* ip = out + prefix;
+    memcpy(ip, header.data(), HeaderSize);
+
+    wire::store16(ip + 2, static_cast<uint16_t>(totLen));
+    wire::store16(ip + IPChecksumOffset, checksum::finish(ipSum + totLen));
+
+    uint8_t* tcp = ip + IPHeaderSize;
+    uint16_t offsetFlags =
+        static_cast<uint16_t>((tcpHeaderSize / 4) << 12) | fields.flags;
+    wire::store32(tcp + 4, fields.seq);
+    wire::store32(tcp + 8, fields.ack);
+    wire::store16(tcp + 12, offsetFlags);
+    wire::store16(tcp + 14, fields.window);
+
+    uint8_t* data = tcp + TCPHeaderSize;
+    if (!options.empty()) {
+        memcpy(data, options.data(), options.size());
+        data += options.size();
+    }
+    if (!payload.empty()) {
+        memcpy(data, payload.data(), payload.size());
+    }
+    if (!payloadTail.empty()) {
+        memcpy(data + payload.size(), payloadTail.data(), payloadTail.size());
+    }
+
+    if (prefix) {
+        // Only the pseudo header sum, not complemented, the kernel adds the
+        // rest.
+        wire::store16(tcp + 16, checksum::fold(pseudoSum + tcpLen));
+        return prefix + totLen;
+    }
+
+    uint64_t sum = tcpSum + tcpLen + offsetFlags + fields.window;
+    sum          = checksum::add32(sum, fields.seq);
+    sum          = checksum::add32(sum, fields.ack);
+    sum          = checksum::partial(options, sum);
+    // Sum the copied payload, the two pieces may not split on a 16 bit
+    // boundary.
+    sum = checksum::partial({data, payloadLen}, sum);
+    wire::store16(tcp + 16, checksum::finish(sum));
+
+    return totLen;
+}
@@ -0,0 +1,87 @@
+#include "seqRanges.hpp"
+#include "tcp.hpp"
+#include <algorithm>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace tcp;
+
+bool SeqRangeList::add(uint32_t start, uint32_t end) {
+    if (!seqLT(start, end)) {
+        return true;
+    }
+
+    // Ranges in [first, last) overlap or touch the new one and get merged
+    // into it.
+    auto first = std::find_if(list.begin(), list.end(), [&](auto& r) {
+        return seqGEQ(r.end, start);
+    });
+    auto last  = std::find_if(first, list.end(), [&](auto& r) {
+        return seqGT(r.start, end);
+    });
+    if (first == last && list.size() >= maxRanges) {
+        return false;
+    }
+
+    Range merged = {start, end};
+    if (first != last) {
+        if (seqLT(first->start, merged.start)) {
+            merged.start = first->start;
+        }
+        if (seqGT((last - 1)->end, merged.end)) {
+            merged.end = (last - 1)->end;
+        }
+    }
+    list.insert(list.erase(first, last), merged);
+    return true;
+}
+
+void SeqRangeList::trim(uint32_t seq) noexcept {
+    auto done = std::find_if(list.begin(), list.end(), [&](auto& r) {
+        return seqGT(r.end, seq);
+    });
+    list.erase(list.begin(), done);
+
+    if (!list.empty() && seqLT(list.front().start, seq)) {
+        list.front().start = seq;
+    }
+}
+
+[[nodiscard]] size_t SeqRangeList::bytes() const noexcept {
+    size_t total = 0;
+    for (const auto& r : list) {
+        total += r.end - r.start;
+    }
+    return total;
+}
+
+[[nodiscard]] std::optional<SeqRangeList::Range>
+SeqRangeList::find(uint32_t seq) const noexcept {
+    for (const auto& r : list) {
+        if (seqLEQ(r.start, seq) && seqLT(seq, r.end)) {
+            return r;
+        }
+    }
+    return std::nullopt;
+}
+
+[[nodiscard]] std::optional<SeqRangeList::Range>
+SeqRangeList::firstGap(uint32_t from, uint32_t to) const noexcept {
+    for (const auto& r : list) {
+        if (!seqLT(from, to)) {
+            return std::nullopt;
+        }
+        if (seqLEQ(r.end, from)) {
+            continue;
+        }
+        if (seqGT(r.start, from)) {
+            return Range{from, seqLT(r.start, to) ? r.start : to};
+        }
+        from = r.end;
+    }
+    if (!seqLT(from, to)) {
+        return std::nullopt;
+    }
+    return Range{from, to};
+}
@@ -0,0 +1,214 @@
+#include "socketApi.hpp"
+#include "connection.hpp"
+#include "endpoint.hpp"
+#include "socket.hpp"
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <tl/expected.hpp>
+#include <utility>
+
+using namespace tcp;
+
+[[nodiscard]] tl::expected<SocketHandle, SocketError>
+SocketApi::listen(uint16_t port) {
+    auto listener = std::make_shared<Endpoint>(SocketPair{
+        .src = {localIP, port},
+        .dst = {},
+    });
+    if (!stack.listen(port, listener)) {
+        return tl::make_unexpected(SocketError::AddressInUse);
+    }
+    return add(std::move(listener), true);
+}
+
+[[nodiscard]] tl::expected<SocketHandle, SocketError>
+SocketApi::accept(SocketHandle listener) {
+    std::shared_ptr<Endpoint> endpoint;
+    {
+        std::scoped_lock lock(mutex);
+        auto* entry = find(listener);
+        if (!entry || !entry->listener) {
+            return tl::make_unexpected(SocketError::BadHandle);
+        }
+        endpoint = entry->endpoint;
+    }
+
+    auto conn = endpoint->popAccepted();
+    if (!conn) {
+        return tl::make_unexpected(SocketError::WouldBlock);
+    }
+    return add(std::move(conn), false);
+}
+
+[[nodiscard]] tl::expected<SocketHandle, SocketError>
+SocketApi::connect(const Socket& remote, uint16_t localPort) {
+    SocketPair pair{
+        .src = {localIP, localPort},
+        .dst = remote,
+    };
+    auto endpoint = std::make_shared<Endpoint>(pair);
+    stack.open(pair, endpoint);
+    return add(std::move(endpoint), false);
+}
+
+[[nodiscard]] tl::expected<size_t, SocketError>
+SocketApi::recv(SocketHandle handle, std::span<uint8_t> out) {
+    std::shared_ptr<Endpoint> endpoint;
+    {
+        std::scoped_lock lock(mutex);
+        auto* entry = find(handle);
+        if (!entry || entry->listener) {
+            return tl::make_unexpected(SocketError::BadHandle);
+        }
+        endpoint = entry->endpoint;
+    }
+
+    auto n = endpoint->read(out);
+    if (n == 0) {
+        if (endpoint->failed()) {
+            return tl::make_unexpected(SocketError::Failed);
+        }
+        if (!endpoint->connected()) {
+            return tl::make_unexpected(SocketError::NotConnected);
+        }
+        if (endpoint->peerClosed()) {
+            // Read again, data may have come in right before the FIN.
+            if ((n = endpoint->read(out))) {
+                return n;
+            }
+            return tl::make_unexpected(SocketError::Closed);
+        }
+        return tl::make_unexpected(SocketError::WouldBlock);
+    }
+
+    // The read made room, the connection may have a window to announce.
+    if (endpoint->takeWindowUpdate()) {
+        stack.withConnection(endpoint->pair, [](Connection& conn) {
+            conn.onRecvSpace();
+        });
+    }
+    return n;
+}
+
+tl::expected<size_t, SocketError>
+SocketApi::send(SocketHandle handle, std::span<const uint8_t> data) {
+    std::shared_ptr<Endpoint> endpoint;
+    {
+        std::scoped_lock lock(mutex);
+        auto* entry = find(handle);
+        if (!entry || entry->listener) {
+            return tl::make_unexpected(SocketError::BadHandle);
+        }
+        endpoint = entry->endpoint;
+    }
+
+    if (endpoint->failed()) {
+        return tl::make_unexpected(SocketError::Failed);
+    }
+    if (!endpoint->connected()) {
+        return tl::make_unexpected(SocketError::NotConnected);
+    }
+    auto n = endpoint->claimSendSpace(data.size());
+    if (n == 0) {
+        return tl::make_unexpected(SocketError::WouldBlock);
+    }
+    stack.send(endpoint->pair, std::string(data.begin(), data.begin() + n));
+    return n;
+}
+
+tl::expected<void, SocketError> SocketApi::close(SocketHandle handle) {
+    Entry entry;
+    {
+        std::scoped_lock lock(mutex);
+        auto* found = find(handle);
+        if (!found) {
+            return tl::make_unexpected(SocketError::BadHandle);
+        }
+        entry = std::move(*found);
+        *found = {};
+        freeHandles.push_back(handle);
+    }
+
+    if (entry.watcher) {
+        entry.endpoint->watch(nullptr, InvalidSocket);
+        entry.watcher->remove(handle);
+    }
+
+    if (!entry.listener) {
+        stack.close(std::move(entry.endpoint));
+        return {};
+    }
+    stack.unlisten(entry.endpoint->pair.src.port);
+    while (auto conn = entry.endpoint->popAccepted()) {
+        stack.detach(std::move(conn));
+    }
+    return {};
+}
+
+tl::expected<void, SocketError>
+SocketApi::watch(Poller& poller, SocketHandle handle, uint32_t interest) {
+    std::shared_ptr<Endpoint> endpoint;
+    {
+        std::scoped_lock lock(mutex);
+        auto* entry = find(handle);
+        if (!entry || (entry->watcher && entry->watcher != &poller)) {
+            return tl::make_unexpected(SocketError::BadHandle);
+        }
+        entry->watcher = &poller;
+        endpoint       = entry->endpoint;
+    }
+
+    // Registered first, so what watch reports right away isn't lost.
+    poller.add(handle, endpoint, interest);
+    endpoint->watch(&poller, handle);
+    return {};
+}
+
+tl::expected<void, SocketError> SocketApi::unwatch(SocketHandle handle) {
+    std::shared_ptr<Endpoint> endpoint;
+    Poller* poller;
+    {
+        std::scoped_lock lock(mutex);
+        auto* entry = find(handle);
+        if (!entry || !entry->watcher) {
+            return tl::make_unexpected(SocketError::BadHandle);
+        }
+        poller   = std::exchange(entry->watcher, nullptr);
+        endpoint = entry->endpoint;
+    }
+
+    endpoint->watch(nullptr, InvalidSocket);
+    poller->remove(handle);
+    return {};
+}
+
+[[nodiscard]] SocketHandle
+SocketApi::add(std::shared_ptr<Endpoint> endpoint, bool listener) {
+    std::scoped_lock lock(mutex);
+    SocketHandle handle;
+    if (!freeHandles.empty()) {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+    } else {
+        handle = static_cast<SocketHandle>(sockets.size());
+        sockets.emplace_back();
+    }
+    sockets[handle] = {
+        .endpoint = std::move(endpoint),
+        .listener = listener,
+        .watcher  = nullptr,
+    };
+    return handle;
+}
+
+[[nodiscard]] SocketApi::Entry* SocketApi::find(SocketHandle handle) {
+    if (handle < 0 || static_cast<size_t>(handle) >= sockets.size() ||
+        !sockets[handle].endpoint) {
+        return nullptr;
+    }
+    return &sockets[handle];
+}
@@ -0,0 +1,323 @@
+#include "stack.hpp"
+#include "capture.hpp"
+#include "connection.hpp"
+#include "debug.hpp"
+#include "endpoint.hpp"
+#include "histogram.hpp"
+#include "linkDevice.hpp"
+#include "tsc.hpp"
+#include "tunDevice.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fmt/core.h>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace tcp;
+
+Stack::Stack(TunDevice& tun, const Tins::IPv4Address& tunIP)
+    : vnetHdr(tun.vnetHdr()) {
+    auto mtu = static_cast<size_t>(tun.mtu());
+    for (size_t i = 0; i < tun.numQueues(); i++) {
+        links.push_back(std::make_unique<TunLink>(tun.queueFd(i)));
+        shards.push_back(std::make_unique<ConnectionManager>(
+            *links.back(), tunIP, this, i, mtu, tun.vnetHdr()));
+    }
+}
+
+Stack::Stack(std::vector<std::unique_ptr<LinkDevice>> links,
+             const Tins::IPv4Address& ip,
+             size_t mtu,
+             bool vnetHdr)
+    : links(std::move(links)), vnetHdr(vnetHdr) {
+    for (size_t i = 0; i < this->links.size(); i++) {
+        shards.push_back(std::make_unique<ConnectionManager>(
+            *this->links[i], ip, this, i, mtu, vnetHdr));
+    }
+}
+
+void Stack::run() noexcept {
+    auto numCores = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < shards.size(); i++) {
+        threads.emplace_back(&ConnectionManager::run, shards[i].get());
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(i % numCores, &cpus);
+        if (pthread_setaffinity_np(threads.back().native_handle(),
+                                   sizeof(cpus),
+                                   &cpus) != 0) {
+            debug::println("Couldn't pin shard {} to a core", i);
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool Stack::listen(uint16_t port, std::shared_ptr<Endpoint> listener) {
+    std::scoped_lock lock(listenersMutex);
+    return listeners.emplace(port, std::move(listener)).second;
+}
+
+void Stack::unlisten(uint16_t port) {
+    std::scoped_lock lock(listenersMutex);
+    listeners.erase(port);
+}
+
+[[nodiscard]] std::shared_ptr<Endpoint> Stack::listener(uint16_t port) {
+    std::scoped_lock lock(listenersMutex);
+    auto it = listeners.find(port);
+    return it == listeners.end() ? nullptr : it->second;
+}
+
+void Stack::detach(std::shared_ptr<Endpoint> endpoint) noexcept {
+    auto pair = endpoint->pair;
+    withConnection(pair, [endpoint = std::move(endpoint)](Connection& conn) {
+        if (conn.endpoint == endpoint) {
+            endpoint->conn = nullptr;
+            conn.endpoint.reset();
+            conn.onRecvSpace();
+        }
+    });
+}
+
+void Stack::close(std::shared_ptr<Endpoint> endpoint) noexcept {
+    auto pair = endpoint->pair;
+    withConnection(pair, [endpoint = std::move(endpoint)](Connection& conn) {
+        if (conn.endpoint == endpoint) {
+            endpoint->conn = nullptr;
+            conn.endpoint.reset();
+            conn.onRecvSpace();
+            conn.close();
+        }
+    });
+}
+
+void Stack::startCapture(const CaptureConfig& config) {
+    auto prefix = vnetHdr ? SegmentTemplate::VnetHdrSize : 0;
+    std::scoped_lock lock(captureMutex);
+    capture = std::make_shared<Capture>(config, shards.size(), prefix);
+    for (auto& shard : shards) {
+        shard->setCapture(capture);
+    }
+}
+
+void Stack::stopCapture() noexcept {
+    std::scoped_lock lock(captureMutex);
+    for (auto& shard : shards) {
+        shard->setCapture(nullptr);
+    }
+    capture.reset();
+}
+
+[[nodiscard]] std::optional<CaptureStats> Stack::captureStats() {
+    std::scoped_lock lock(captureMutex);
+    if (!capture) {
+        return std::nullopt;
+    }
+    return capture->stats();
+}
+
+[[nodiscard]] std::vector<ConnectionInfo>
+Stack::connections(std::chrono::milliseconds timeout) {
+    using Infos = std::vector<ConnectionInfo>;
+
+    // Shared with the shards, one that answers late still has its promise.
+    std::vector<std::future<Infos>> futures;
+    for (auto& shard : shards) {
+        auto promise = std::make_shared<std::promise<Infos>>();
+        futures.push_back(promise->get_future());
+        shard->connectionInfo([promise](Infos infos) {
+            promise->set_value(std::move(infos));
+        });
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    Infos all;
+    for (auto& future : futures) {
+        if (future.wait_until(deadline) != std::future_status::ready) {
+            continue;
+        }
+        auto infos = future.get();
+        all.insert(all.end(), infos.begin(), infos.end());
+    }
+    return all;
+}
+
+[[nodiscard]] std::vector<LatencySummary> Stack::latency() const {
+    auto ticksPerNs = tsc::ticksPerNs();
+    std::vector<LatencySummary> summaries;
+    for (size_t i = 0; i < NumStages; i++) {
+        auto stage = static_cast<Stage>(i);
+        HistogramSnapshot all;
+        for (const auto& shard : shards) {
+            all.merge(shard->latency()[stage]);
+        }
+        auto ns = [&](double q) {
+            return static_cast<double>(all.percentile(q)) / ticksPerNs;
+        };
+        summaries.push_back({
+            .stage = stage,
+            .count = all.count(),
+            .p50   = ns(0.5),
+            .p99   = ns(0.99),
+            .p999  = ns(0.999),
+            .max   = ns(1.0),
+        });
+    }
+    return summaries;
+}
+
+namespace {
+
+std::string label(const Socket& s) {
+    return fmt::format("{}:{}", s.addr.to_string(), s.port);
+}
+
+} // namespace
+
+[[nodiscard]] std::string
+Stack::prometheus(std::chrono::milliseconds timeout) {
+    std::string out;
+    auto header = [&](const char* name, const char* help, const char* type) {
+        out += fmt::format("# HELP netstack_{} {}\n", name, help);
+        out += fmt::format("# TYPE netstack_{} {}\n", name, type);
+    };
+
+    // One metric at a time, with a sample per shard.
+    std::vector<std::vector<std::pair<MetricInfo, uint64_t>>> samples;
+    for (auto& shard : shards) {
+        auto& metrics = samples.emplace_back();
+        shard->stats().visit([&](const MetricInfo& info, uint64_t value) {
+            metrics.emplace_back(info, value);
+        });
+    }
+    for (size_t m = 0; !samples.empty() && m < samples[0].size(); m++) {
+        const auto& info = samples[0][m].first;
+        header(info.name,
+               info.help,
+               info.type == MetricInfo::Type::Counter ? "counter" : "gauge");
+        for (size_t i = 0; i < samples.size(); i++) {
+            out += fmt::format("netstack_{}{{shard=\"{}\"}} {}\n",
+                               info.name,
+                               i,
+                               samples[i][m].second);
+        }
+    }
+
+    header("inbox_depth", "Tasks posted to the shard, not run yet.", "gauge");
+    for (size_t i = 0; i < shards.size(); i++) {
+        out += fmt::format("netstack_inbox_depth{{shard=\"{}\"}} {}\n",
+                           i,
+                           shards[i]->inboxDepth());
+    }
+
+    header("stage_latency_seconds",
+           "Time spent in each stage of the packet path.",
+           "summary");
+    for (const auto& s : latency()) {
+        std::pair<const char*, double> quantiles[] = {
+            {"0.5", s.p50},
+            {"0.99", s.p99},
+            {"0.999", s.p999},
+            {"1", s.max},
+        };
+        for (auto [q, ns] : quantiles) {
+            out += fmt::format("netstack_stage_latency_seconds{{stage=\"{}\","
+                               "quantile=\"{}\"}} {}\n",
+                               stageName(s.stage),
+                               q,
+                               ns / 1e9);
+        }
+        out += fmt::format(
+            "netstack_stage_latency_seconds_count{{stage=\"{}\"}} {}\n",
+            stageName(s.stage),
+            s.count);
+    }
+
+    auto infos         = connections(timeout);
+    auto perConnection = [&](const char* name,
+                             const char* help,
+                             auto&& value) {
+        header(name, help, "gauge");
+        for (const auto& info : infos) {
+            out += fmt::format(
+                "netstack_{}{{local=\"{}\",remote=\"{}\"}} {}\n",
+                name,
+                label(info.pair.src),
+                label(info.pair.dst),
+                value(info));
+        }
+    };
+    perConnection("connection_state",
+                  "TCP state, in RFC 793 order from CLOSED = 0.",
+                  [](const ConnectionInfo& c) {
+                      return static_cast<int>(c.state);
+                  });
+    perConnection("connection_snd_una",
+                  "Oldest unacknowledged sequence number.",
+                  [](const ConnectionInfo& c) {
+                      return c.sndUna;
+                  });
+    perConnection("connection_snd_nxt",
+                  "Next sequence number to send.",
+                  [](const ConnectionInfo& c) {
+                      return c.sndNxt;
+                  });
+    perConnection("connection_snd_wnd_bytes",
+                  "Window advertised by the peer.",
+                  [](const ConnectionInfo& c) {
+                      return c.sndWnd;
+                  });
+    perConnection("connection_rcv_nxt",
+                  "Next sequence number expected.",
+                  [](const ConnectionInfo& c) {
+                      return c.rcvNxt;
+                  });
+    perConnection("connection_rcv_wnd_bytes",
+                  "Window advertised to the peer.",
+                  [](const ConnectionInfo& c) {
+                      return c.rcvWnd;
+                  });
+    perConnection("connection_cwnd_bytes",
+                  "Congestion window.",
+                  [](const ConnectionInfo& c) {
+                      return c.cwnd;
+                  });
+    perConnection("connection_srtt_seconds",
+                  "Smoothed round trip time, 0 before the first sample.",
+                  [](const ConnectionInfo& c) {
+                      using Seconds = std::chrono::duration<double>;
+                      return c.srtt ? Seconds(*c.srtt).count() : 0.0;
+                  });
+    return out;
+}
+
+void Stack::startStatsExport(const std::string& path,
+                             std::chrono::milliseconds interval) {
+    std::scoped_lock lock(exporterMutex);
+    // The old export stops before the new one writes to the same path.
+    exporter.reset();
+    exporter = std::make_unique<StatsExporter>(path, interval, [this] {
+        return prometheus(std::chrono::milliseconds(100));
+    });
+}
+
+void Stack::stopStatsExport() noexcept {
+    std::scoped_lock lock(exporterMutex);
+    exporter.reset();
+}
@@ -0,0 +1,55 @@
+#include "stats.hpp"
+#include "fmt/core.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace tcp;
+
+StatsExporter::StatsExporter(std::string path,
+                             std::chrono::milliseconds interval,
+                             std::function<std::string()> render)
+    : path(std::move(path)), interval(interval), render(std::move(render)),
+      thread(&StatsExporter::run, this) {
+}
+
+StatsExporter::~StatsExporter() {
+    {
+        std::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+void StatsExporter::run() {
+    std::unique_lock lock(mutex);
+    while (!stopping) {
+        lock.unlock();
+        write();
+        lock.lock();
+        cv.wait_for(lock, interval, [this] {
+            return stopping;
+        });
+    }
+}
+
+void StatsExporter::write() {
+    auto text = render();
+    auto tmp  = path + ".tmp";
+
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        fmt::println("Couldn't write stats to {}", tmp);
+        return;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok      = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        fmt::println("Couldn't write stats to {}", path);
+    }
+}
@@ -0,0 +1,72 @@
+#include "synCookies.hpp"
+#include "sipHash.hpp"
+#include "socket.hpp"
+#include <array>
+#include <chrono>
+#include <optional>
+#include <stdint.h>
+
+using namespace tcp;
+
+namespace {
+
+constexpr unsigned TimeBits = 5;
+constexpr unsigned MssBits  = 3;
+constexpr unsigned MacBits  = 32 - TimeBits - MssBits;
+constexpr uint32_t MacMask  = (uint32_t{1} << MacBits) - 1;
+
+uint32_t periodOf(SynCookies::Clock::time_point now) noexcept {
+    return static_cast<uint32_t>(now.time_since_epoch() / SynCookies::Period);
+}
+
+} // namespace
+
+SynCookies::SynCookies() : secret(sipHash::randomKey()) {
+}
+
+[[nodiscard]] uint32_t SynCookies::mac(const FlowKey& flow,
+                                       uint32_t peerIss,
+                                       uint32_t time) const noexcept {
+    std::array<uint64_t, 3> words = {
+        static_cast<uint64_t>(flow.srcAddr) << 32 | flow.dstAddr,
+        static_cast<uint64_t>(flow.ports) << 32 | peerIss,
+        time,
+    };
+    return static_cast<uint32_t>(sipHash::hash(secret, words)) & MacMask;
+}
+
+[[nodiscard]] uint32_t SynCookies::make(const FlowKey& flow,
+                                        uint32_t peerIss,
+                                        uint16_t mss,
+                                        Clock::time_point now) const noexcept {
+    // The largest table entry not above the peer's MSS, the smallest entry
+    // is the minimum every host takes.
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < MssTable.size(); i++) {
+        if (MssTable[i] <= mss) {
+            index = i;
+        }
+    }
+    auto time = periodOf(now) & ((uint32_t{1} << TimeBits) - 1);
+    return time << (MssBits + MacBits) | index << MacBits |
+           mac(flow, peerIss, time);
+}
+
+[[nodiscard]] std::optional<uint16_t>
+SynCookies::check(const FlowKey& flow,
+                  uint32_t peerIss,
+                  uint32_t cookie,
+                  Clock::time_point now) const noexcept {
+    constexpr uint32_t timeMask = (uint32_t{1} << TimeBits) - 1;
+
+    auto time    = cookie >> (MssBits + MacBits);
+    auto current = periodOf(now) & timeMask;
+    // Made in this period or the one before.
+    if (time != current && time != ((current - 1) & timeMask)) {
+        return std::nullopt;
+    }
+    if ((cookie & MacMask) != mac(flow, peerIss, time)) {
+        return std::nullopt;
+    }
+    return MssTable[(cookie >> MacBits) & ((uint32_t{1} << MssBits) - 1)];
+}
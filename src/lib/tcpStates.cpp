@@ -1,48 +1,140 @@
 #include "tcpStates.hpp"
 #include "connection.hpp"
 #include "debug.hpp"
+#include "endpoint.hpp"
 #include "fmt/core.h"
+#include "packet.hpp"
 #include "tcp.hpp"
-#include "threadPool.hpp"
-#include "tins/ip.h"
-#include "tins/rawpdu.h"
-#include "tins/tcp.h"
-#include <mutex>
+#include <span>
 #include <stdint.h>
 #include <string>
-#include <thread>
 
 using namespace tcp;
 
+namespace {
+
+// What the checks every synchronized state starts with (RFC 793 3.9) made
+// of a segment.
+enum class Check : uint8_t {
+    Accept,
+    Drop,  // Dropped, the peer may have been sent an ACK.
+    Reset, // An acceptable RST, the connection closes.
+};
+
+// Checks a segment arriving in a synchronized state. It has to be in the
+// window and carry an ACK. A RST only resets the connection if it is exactly
+// at rcv.nxt and a SYN never does: for either, anywhere else in the window,
+// the peer gets a challenge ACK it has to answer with the right sequence
+// number, so blind RSTs and SYNs can't tear connections down (RFC 5961).
+Check checkSegment(Connection& conn, const PacketView& pkt) noexcept {
+    const auto& tcp = pkt.tcp;
+    if (!conn.isPacketValid(pkt)) {
+        conn.shard->stats.invalidDrops.add();
+        conn.traceEvent(trace::Kind::Invalid,
+                        tcp.seq(),
+                        tcp.ack_seq(),
+                        pkt.payload.size(),
+                        tcp.flags());
+        // The ACK tells the peer what we expect, unless it sent a RST.
+        if (!tcp.get_flag(TCPView::RST)) {
+            conn.ackNow();
+        }
+        return Check::Drop;
+    }
+
+    if (tcp.get_flag(TCPView::RST)) {
+        if (tcp.seq() != conn.rcv.nxt) {
+            conn.ackNow();
+            return Check::Drop;
+        }
+        debug::println("Connection reset by peer");
+        conn.onReset();
+        return Check::Reset;
+    }
+
+    if (tcp.get_flag(TCPView::SYN)) {
+        conn.ackNow();
+        return Check::Drop;
+    }
+
+    if (!tcp.get_flag(TCPView::ACK)) {
+        return Check::Drop;
+    }
+    return Check::Accept;
+}
+
+// Takes the payload of an acceptable segment, and its FIN once everything
+// before the FIN arrived. A FIN ahead of a hole is dropped, the peer sends it
+// again once the hole is filled. Returns whether the FIN was taken.
+bool receive(Connection& conn, const PacketView& pkt) noexcept {
+    const auto& tcp  = pkt.tcp;
+    const auto& data = pkt.payload;
+
+    bool inOrder = tcp.seq() == conn.rcv.nxt && conn.reasm.empty();
+    if (!data.empty()) {
+        debug::println("Got Data for in socket: src: {}:{} dst: {}:{}",
+                       conn.src.addr.to_string(),
+                       conn.src.port,
+                       conn.dst.addr.to_string(),
+                       conn.dst.port);
+        if (!inOrder) {
+            debug::println("Out of order segment, or one filling a hole");
+        }
+        conn.onData(tcp.seq(), data);
+    }
+
+    // The ACK of the FIN covers the data too.
+    if (tcp.get_flag(TCPView::FIN) &&
+        tcp.seq() + static_cast<uint32_t>(data.size()) == conn.rcv.nxt) {
+        conn.onFin();
+        return true;
+    }
+
+    if (data.empty()) {
+        // Nothing to ack.
+        return false;
+    }
+    if (inOrder) {
+        conn.ackLater(data.size());
+        return false;
+    }
+
+    // Out of order data is acked right away, the duplicate ack tells the
+    // peer where the hole is. So is data filling a hole, so the peer learns
+    // it was repaired without waiting (RFC 5681, 4.2).
+    if (!conn.ackNow()) {
+        debug::print("Failed to send ACK after receiving data");
+    }
+    return false;
+}
+
+} // namespace
+
 [[nodiscard]] State::Value
 ListenState::onPacket(Connection& conn,
-                      const Tins::IP& ip,
-                      const Tins::TCP& tcp) const noexcept {
-    std::scoped_lock lock(conn.connDataMutex);
-    // If not a valid packet we do nothing.
-    if (!conn.isPacketValid(tcp)) {
-        debug::println("Dropping tcp packet due to failing validity check");
-        return stateValue;
-    }
+                      const PacketView& pkt) noexcept {
+    const auto& tcp = pkt.tcp;
+    // No acceptability check here, as per RFC 793 there is no receive window
+    // to check against until the SYN is processed.
 
     // Ignore RST packets.
-    if (tcp.get_flag(Tins::TCP::RST)) {
+    if (tcp.get_flag(TCPView::RST)) {
         debug::println("Rcvd RST in Listen State, ignoring...");
-        return stateValue;
+        return value;
     }
 
     // If ACK, send reset, since it is probably from a packet from prev
     // connection.
-    if (tcp.get_flag(Tins::TCP::ACK)) {
-        debug::println("Rcvd ACK in Listen State, unimplemented...");
-        // TODO: create a RST and send.
-        return stateValue;
+    if (tcp.get_flag(TCPView::ACK)) {
+        debug::println("Rcvd ACK in Listen State, resetting...");
+        conn.replyReset(pkt);
+        return value;
     }
 
     // By this point, getting non SYN should be unlikely but if so, drop it.
-    if (!tcp.get_flag(Tins::TCP::SYN)) [[unlikely]] {
+    if (!tcp.get_flag(TCPView::SYN)) [[unlikely]] {
         debug::println("Rcvd weird packed in Listen State, ignoring...");
-        return stateValue;
+        return value;
     }
 
     // SYN Packet.
@@ -51,285 +143,271 @@ ListenState::onPacket(Connection& conn,
     // As per RFC 793, we set `snd` and `rcv` here, but we have that set
     // in the connection constructor, so just send the SYN-ACK packet.
 
-    Tins::TCP tcpResp(tcp.sport(), tcp.dport());
-    tcpResp.set_flag(Tins::TCP::SYN, 1);
-    tcpResp.set_flag(Tins::TCP::ACK, 1);
-    tcpResp.seq(conn.snd.nxt); // or send iss here.
-    tcpResp.ack_seq(tcp.seq() + 1);
-    tcpResp.window(conn.snd.wnd);
-
-    // Note: Ignoring optional options like Timestamp, mss, and sack.
-
-    Tins::IP ipResp = Tins::IP(ip.src_addr(), ip.dst_addr()) / tcpResp;
-    ipResp.ttl(Connection::DefaultTTL);
-
-    auto resp = ipResp.serialize();
-
-    int numWrite = conn.tun->write(resp.data(), resp.size());
-    if (numWrite != -1) {
+    // rcv.nxt was set to SEG.SEQ + 1 by the connection constructor, so the
+    // SYN-ACK acks the peer's SYN.
+    // The peer's SYN options were taken by the connection constructor, and
+    // ours go out on the SYN-ACK.
+    // Note: Ignoring optional options like Timestamp.
+    if (conn.sendSegment(TCPView::SYN | TCPView::ACK, conn.snd.iss)) {
         debug::println("Sent SYN-ACK reply TO SYN");
     }
+    conn.shard->stats.passiveOpens.add();
+    // The SYN takes up a sequence number.
+    conn.snd.nxt = conn.snd.max = conn.snd.iss + 1;
+    // Resends the SYN-ACK until the handshake completes, or gives up.
+    conn.shard->timers.arm(conn.rtxTimer, Connection::TCPRetransmissionTime);
     return State::Value::SynRcvd;
 }
 
 [[nodiscard]] State::Value
 SynRcvdState::onPacket(Connection& conn,
-                       const Tins::IP& ip,
-                       const Tins::TCP& tcp) const noexcept {
-    std::scoped_lock lock(conn.connDataMutex);
-    // If not a valid packet, send RST.
-    if (!conn.isPacketValid(tcp)) {
-        debug::println(
-            "Invalid packet in SynRcvd State. Unimplemented, need to send RST");
-        // TODO: Send RST.
-        return stateValue;
+                       const PacketView& pkt) noexcept {
+    const auto& ip  = pkt.ip;
+    const auto& tcp = pkt.tcp;
+    if (!conn.isPacketValid(pkt)) {
+        // The peer's SYN again: our SYN-ACK may have been lost.
+        if (tcp.get_flag(TCPView::SYN) && !tcp.get_flag(TCPView::ACK) &&
+            tcp.seq() == conn.rcv.irs) {
+            conn.sendSegment(TCPView::SYN | TCPView::ACK, conn.snd.iss);
+            return value;
+        }
+        conn.shard->stats.invalidDrops.add();
+        conn.traceEvent(trace::Kind::Invalid,
+                        tcp.seq(),
+                        tcp.ack_seq(),
+                        pkt.payload.size(),
+                        tcp.flags());
+        debug::println("Invalid packet in SynRcvd State, dropping");
+        return value;
     }
 
-    // TODO: If RST bit, close connection.
-    if (tcp.has_flags(Tins::TCP::RST)) {
-        debug::println(
-            "RST rcvd in SyncRecd State. Unimplemented, need to close here");
-        return stateValue;
+    // A passive open goes back to LISTEN, which for us means it's gone.
+    if (tcp.has_flags(TCPView::RST)) {
+        debug::println("RST rcvd in SynRcvd State, closing");
+        conn.onReset();
+        return State::Value::Closed;
     }
 
     // TODO: Check security compartment stuff (or not?).
 
-    // If SYN, it is wrong, send RST and close.
-    if (tcp.has_flags(Tins::TCP::SYN)) {
-        debug::println(
-            "SYN recvd in SynRcvd State. Unimplemented, need to sent "
-            "RST and close here.");
-        return stateValue;
+    if (tcp.has_flags(TCPView::SYN)) {
+        debug::println("SYN recvd in SynRcvd State, dropping");
+        return value;
     }
 
     // If ACK, enter Established State. GG 3-way handshake done.
-    if (tcp.has_flags(Tins::TCP::ACK)) {
-        conn.snd.nxt++;
+    if (tcp.has_flags(TCPView::ACK)) {
+        // The ack has to cover our SYN: SND.UNA < SEG.ACK.
+        if (!seqGT(tcp.ack_seq(), conn.snd.una)) {
+            debug::println("ACK in SynRcvd State doesn't ack our SYN");
+            conn.replyReset(pkt);
+            return value;
+        }
+        conn.snd.una = tcp.ack_seq();
+        conn.snd.wnd = conn.peerWindow(tcp);
+        conn.snd.wl1 = tcp.seq();
+        conn.snd.wl2 = tcp.ack_seq();
         fmt::println("Connection Established with: {}:{} at port: {}",
                      ip.src_addr().to_string(),
                      tcp.sport(),
                      tcp.dport());
+        // Its data and FIN go to EstablishedState::onHandshakeAck.
         return State::Value::Established;
     }
 
-    // TODO: If FIN, enter CLOSE-WAIT state.
-    debug::println("Reached unimplemented part of SynRcvd State's onPacket");
-    return stateValue;
+    // Without an ACK nothing of the segment is taken (RFC 793 3.9).
+    debug::println("Segment without ACK in SynRcvd State, dropping");
+    return value;
 }
 
 [[nodiscard]] State::Value
 EstablishedState::onPacket(Connection& conn,
-                           const Tins::IP& ip,
-                           const Tins::TCP& tcp) const noexcept {
-    std::scoped_lock lock(conn.connDataMutex);
-    // If not a valid packet, send RST.
-    if (!conn.isPacketValid(tcp)) {
-        debug::println("Invalid packet in Established State. Unimplemented, "
-                       "need to send RST");
-        // TODO: Send RST.
-        return stateValue;
+                           const PacketView& pkt) noexcept {
+    if (auto check = checkSegment(conn, pkt); check != Check::Accept) {
+        return check == Check::Reset ? State::Value::Closed : value;
     }
+    conn.onAck(pkt);
+    return receive(conn, pkt) ? State::Value::CloseWait : value;
+}
 
-    if (tcp.has_flags(Tins::TCP::RST)) {
-        debug::println("Got RST in Established state, need to close connection "
-                       "and send RST on every snd/rcv here. Unimplemented...");
-        return stateValue;
-    }
+[[nodiscard]] State::Value
+EstablishedState::onHandshakeAck(Connection& conn,
+                                 const PacketView& pkt) noexcept {
+    return receive(conn, pkt) ? State::Value::CloseWait : value;
+}
 
-    // TODO: check security stuff.
+[[nodiscard]] State::Value
+EstablishedState::onSend(Connection& conn,
+                         const std::string& data) noexcept {
+    std::span<const uint8_t> payload((const uint8_t*)data.data(),
+                                     data.size());
+    // Queued in the send buffer, it goes out as the peer's window allows and
+    // is retransmitted by the connection's timer.
+    conn.write(payload);
+    return value;
+}
 
-    if (tcp.has_flags(Tins::TCP::SYN)) {
-        debug::println(
-            "Rcvd SYN in Established state, need to RST now. Unimplemented");
-        return stateValue;
-    }
+[[nodiscard]] State::Value
+EstablishedState::onClose(Connection& conn) noexcept {
+    conn.queueFin();
+    return State::Value::FinWait1;
+}
 
-    if (tcp.has_flags(Tins::TCP::ACK)) {
-        conn.snd.una = tcp.ack_seq();
+[[nodiscard]] State::Value
+FinWait1State::onPacket(Connection& conn, const PacketView& pkt) noexcept {
+    if (auto check = checkSegment(conn, pkt); check != Check::Accept) {
+        return check == Check::Reset ? State::Value::Closed : value;
     }
-
-    // TODO : check for urg bit (no not?).
-
-    // Process segement data now.
-    debug::println("Got Data for in socket: src: {}:{} dst: {}:{}",
-                   conn.src.addr.to_string(),
-                   conn.src.port,
-                   conn.dst.addr.to_string(),
-                   conn.dst.port);
-
-    if (tcp.seq() != conn.rcv.nxt) {
-        debug::println("Ignoring segement with seg.seq != rcv.nxt");
-        return stateValue;
+    conn.onAck(pkt);
+    bool finAcked = conn.finAcked();
+    if (receive(conn, pkt)) {
+        return finAcked ? State::Value::TimeWait : State::Value::Closing;
     }
+    return finAcked ? State::Value::FinWait2 : value;
+}
 
-    auto* rawPDU = tcp.find_pdu<Tins::RawPDU>();
-
-    if (!rawPDU) {
-        debug::println("Failed to get raw pdu from tcp");
-        return stateValue;
+[[nodiscard]] State::Value
+FinWait2State::onPacket(Connection& conn, const PacketView& pkt) noexcept {
+    if (auto check = checkSegment(conn, pkt); check != Check::Accept) {
+        return check == Check::Reset ? State::Value::Closed : value;
     }
+    conn.onAck(pkt);
+    return receive(conn, pkt) ? State::Value::TimeWait : value;
+}
 
-    fmt::print("{}:{} > ", ip.src_addr().to_string(), tcp.sport());
-    auto data = rawPDU->payload();
-    for (auto x : data) {
-        fmt::print("{}", (char)x);
+[[nodiscard]] State::Value
+CloseWaitState::onPacket(Connection& conn, const PacketView& pkt) noexcept {
+    if (auto check = checkSegment(conn, pkt); check != Check::Accept) {
+        return check == Check::Reset ? State::Value::Closed : value;
     }
+    // Nothing can follow the peer's FIN, only ACKs of what we send matter.
+    conn.onAck(pkt);
+    return value;
+}
 
-    conn.rcv.nxt += data.size();
-
-    auto tcpResp = Tins::TCP(tcp.sport(), tcp.dport());
-    tcpResp.set_flag(Tins::TCP::ACK, 1);
-    tcpResp.ack_seq(conn.rcv.nxt);
-    tcpResp.seq(conn.snd.nxt);
+[[nodiscard]] State::Value
+CloseWaitState::onSend(Connection& conn, const std::string& data) noexcept {
+    (void)EstablishedState::onSend(conn, data);
+    return value;
+}
 
-    auto ipResp = Tins::IP(ip.src_addr(), ip.dst_addr()) / tcpResp;
-    ipResp.ttl(64);
+[[nodiscard]] State::Value
+CloseWaitState::onClose(Connection& conn) noexcept {
+    conn.queueFin();
+    return State::Value::LastAck;
+}
 
-    auto resp        = ipResp.serialize();
-    int bytesWritten = conn.tun->write(resp.data(), resp.size());
-    if (bytesWritten == -1) {
-        debug::print(
-            "Failed to send ACK after receiving data in Established state");
-        return stateValue;
+[[nodiscard]] State::Value
+ClosingState::onPacket(Connection& conn, const PacketView& pkt) noexcept {
+    if (auto check = checkSegment(conn, pkt); check != Check::Accept) {
+        return check == Check::Reset ? State::Value::Closed : value;
     }
-
-    return stateValue;
+    conn.onAck(pkt);
+    return conn.finAcked() ? State::Value::TimeWait : value;
 }
 
 [[nodiscard]] State::Value
-EstablishedState::onSend(Connection& conn,
-                         const std::string& data,
-                         ThreadPool& threadPool) const noexcept {
-    auto task = [&conn, data]() {
-        Tins::RawPDU rawData((uint8_t*)data.data(), data.size());
-        Tins::TCP tcpResp = Tins::TCP(conn.dst.port, conn.src.port);
-        tcpResp.set_flag(Tins::TCP::ACK, 1);
-        tcpResp.set_flag(Tins::TCP::PSH, 1);
-
-        // Make sure that on every retry, we send with same sequence number.
-        std::unique_lock lock(conn.connDataMutex);
-        // lock.lock();
-        auto sentSeqNum = conn.snd.nxt;
-        conn.snd.nxt += data.size();
-
-        tcpResp.seq(sentSeqNum);
-        lock.unlock();
-
-        bool transmitted = false;
-        int maxRetryies = 7, retries = 0;
-        while (!transmitted && retries < maxRetryies) {
-            if (retries > 0) {
-                fmt::println("Retring send for {} time", retries);
-            }
-            lock.lock();
-            tcpResp.ack_seq(conn.rcv.nxt);
-
-            auto ipResp =
-                Tins::IP(conn.dst.addr, conn.src.addr) / tcpResp / rawData;
-            ipResp.ttl(64);
-
-            auto resp = ipResp.serialize();
-
-            int bytesWritten = conn.tun->write(resp.data(), resp.size());
-            lock.unlock();
-
-            if (bytesWritten == -1) {
-                debug::println("Failed to send Seg in Established state during "
-                               "onSend call");
-                return;
-            }
-
-            std::this_thread::sleep_for(Connection::TCPRetransmissionTime);
-
-            lock.lock();
-            if (conn.snd.una >= sentSeqNum + data.size()) {
-                transmitted = true;
-            }
-            lock.unlock();
-
-            retries++;
-        }
-    };
-
-    auto res = threadPool.pushTask(task);
-    // res.get(); // TODO: WHAT EVEN. WHY IS THIS REQUIRED? Welp, as it turns
-    // out, I was passing local references to lambda, gg.
-
-    return stateValue;
+LastAckState::onPacket(Connection& conn, const PacketView& pkt) noexcept {
+    if (auto check = checkSegment(conn, pkt); check != Check::Accept) {
+        return check == Check::Reset ? State::Value::Closed : value;
+    }
+    conn.onAck(pkt);
+    return conn.finAcked() ? State::Value::Closed : value;
 }
 
 [[nodiscard]] State::Value
-ListenState::onOpen(Connection& conn) const noexcept {
-    std::scoped_lock lock(conn.connDataMutex);
-
+ListenState::onOpen(Connection& conn) noexcept {
     if (!conn.src.port || !conn.dst.port) {
         fmt::println("Can't open partial connection actively");
-        return stateValue;
+        conn.shard->stats.handshakeFails.add();
+        if (conn.endpoint) {
+            conn.endpoint->setFailed();
+        }
+        return State::Value::Closed;
     }
 
-    Tins::TCP tcpResp(conn.dst.port, conn.src.port);
-    tcpResp.set_flag(Tins::TCP::SYN, 1);
-    tcpResp.seq(conn.snd.nxt);
-    tcpResp.window(conn.snd.wnd);
-
-    Tins::IP ipResp = Tins::IP(conn.dst.addr, conn.src.addr) / tcpResp;
-    ipResp.ttl(64);
-
-    auto resp = ipResp.serialize();
-
-    int bytesWritten = conn.tun->write(resp.data(), resp.size());
-    if (bytesWritten == -1) {
+    if (!conn.sendSegment(TCPView::SYN, conn.snd.nxt)) {
         fmt::println("Failed to sent SYN due to tun problem");
-        return stateValue;
+        conn.shard->stats.handshakeFails.add();
+        if (conn.endpoint) {
+            conn.endpoint->setFailed();
+        }
+        return State::Value::Closed;
     }
+    conn.snd.nxt = conn.snd.max = conn.snd.iss + 1;
+    conn.shard->stats.activeOpens.add();
+    // Resends the SYN until the peer answers, or gives up.
+    conn.shard->timers.arm(conn.rtxTimer, Connection::TCPRetransmissionTime);
     return State::Value::SynSent;
 }
 
+[[nodiscard]] State::Value ListenState::onClose(Connection&) noexcept {
+    return State::Value::Closed;
+}
+
+[[nodiscard]] State::Value SynRcvdState::onClose(Connection& conn) noexcept {
+    // The FIN goes out once our SYN is acked.
+    conn.queueFin();
+    return State::Value::FinWait1;
+}
+
+[[nodiscard]] State::Value SynSentState::onClose(Connection&) noexcept {
+    return State::Value::Closed;
+}
+
 [[nodiscard]] State::Value
 SynSentState::onPacket(Connection& conn,
-                       const Tins::IP& ip,
-                       const Tins::TCP& tcp) const noexcept {
-    std::scoped_lock lock(conn.connDataMutex);
+                       const PacketView& pkt) noexcept {
+    const auto& tcp = pkt.tcp;
+
+    // An ACK of anything but our SYN is from another incarnation of the
+    // flow.
+    bool hasAck = tcp.get_flag(TCPView::ACK);
+    if (hasAck && (!seqGT(tcp.ack_seq(), conn.snd.iss) ||
+                   seqGT(tcp.ack_seq(), conn.snd.max))) {
+        if (!tcp.get_flag(TCPView::RST)) {
+            conn.replyReset(pkt);
+        }
+        return value;
+    }
 
-    // TODO :Check ACK, RST, Security bits.
-    if (!tcp.has_flags(Tins::TCP::SYN | Tins::TCP::ACK)) {
+    // Refused, if it acks our SYN.
+    if (tcp.get_flag(TCPView::RST)) {
+        if (!hasAck) {
+            return value;
+        }
+        fmt::println("Connection refused by {}:{}",
+                     conn.dst.addr.to_string(),
+                     conn.dst.port);
+        conn.onReset();
+        return State::Value::Closed;
+    }
+
+    // TODO: Check security bits.
+    if (!tcp.has_flags(TCPView::SYN | TCPView::ACK)) {
         debug::println(
             "SYN or ACK not set in SynSent state. Unimplemeneted...");
-        return stateValue;
+        return value;
     }
 
-    // if (!conn.isPacketValid(tcp)) {
+    // if (!conn.isPacketValid(pkt)) {
     //     fmt::println("Got invalid packet in SynSent State");
-    //     return stateValue;
+    //     return value;
     // }
 
-    if (tcp.ack_seq() <= conn.snd.iss) {
-        debug::println("Bad ACK packet, ignoring (unimplemented)");
-        return stateValue;
-    }
-
     conn.rcv.nxt = tcp.seq() + 1;
     conn.rcv.irs = tcp.seq();
-    conn.rcv.wnd = tcp.window();
 
     conn.snd.una = tcp.ack_seq();
-    conn.snd.nxt = conn.snd.una;
-
-    Tins::TCP tcpResp(conn.dst.port, conn.src.port);
-    tcpResp.set_flag(Tins::TCP::ACK, 1);
-    tcpResp.ack_seq(conn.rcv.nxt);
-    tcpResp.seq(conn.snd.nxt);
-
-    Tins::IP ipResp = Tins::IP(conn.dst.addr, conn.src.addr) / tcpResp;
-    ipResp.ttl(64);
-    auto resp = ipResp.serialize();
+    conn.snd.wnd = conn.peerWindow(tcp);
+    conn.snd.wl1 = tcp.seq();
+    conn.snd.wl2 = tcp.ack_seq();
+    conn.onSynOptions(tcp);
 
-    int bytesWritten = conn.tun->write(resp.data(), resp.size());
-    if (bytesWritten == -1) {
+    if (!conn.sendSegment(TCPView::ACK, conn.snd.nxt)) {
         fmt::println("Failed to sent SYN due to tun problem");
-        conn.snd.nxt = conn.snd.iss;
         conn.snd.una = conn.snd.iss;
-        return stateValue;
+        return value;
     }
     fmt::println("Connection Established with: {}:{} at port: {}",
                  conn.dst.addr.to_string(),
@@ -0,0 +1,26 @@
+#include "timeWait.hpp"
+#include "socket.hpp"
+#include <chrono>
+#include <stdint.h>
+
+using namespace tcp;
+
+void TimeWaitTable::add(const FlowKey& flow,
+                        uint32_t sndNxt,
+                        uint32_t rcvNxt,
+                        Clock::time_point now) {
+    auto expires = now + Duration;
+    *entries.tryEmplace(flow).first = {sndNxt, rcvNxt, expires};
+    order.emplace_back(flow, expires);
+}
+
+void TimeWaitTable::expire(Clock::time_point now) {
+    while (!order.empty() && order.front().second <= now) {
+        auto [flow, expires] = order.front();
+        order.pop_front();
+        auto* entry = entries.find(flow);
+        if (entry && entry->expires == expires) {
+            entries.erase(flow);
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#include "timerWheel.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace tcp;
+
+Timer::~Timer() {
+    if (wheel) {
+        wheel->cancel(*this);
+    }
+}
+
+TimerWheel::TimerWheel(Clock::time_point now) noexcept : start(now) {
+}
+
+TimerWheel::~TimerWheel() {
+    // Detach whatever is still armed so the timers don't point at us.
+    for (auto& level : levels) {
+        for (auto*& head : level.slots) {
+            while (head) {
+                auto* timer  = head;
+                head         = timer->next;
+                timer->wheel = nullptr;
+                timer->prev = timer->next = nullptr;
+            }
+        }
+    }
+}
+
+[[nodiscard]] uint64_t
+TimerWheel::toTicks(Clock::time_point t) const noexcept {
+    if (t <= start) {
+        return 0;
+    }
+    return static_cast<uint64_t>((t - start) / Tick);
+}
+
+void TimerWheel::arm(Timer& timer, Clock::duration after) noexcept {
+    if (timer.wheel) {
+        cancel(timer);
+    }
+
+    // Round up, a timer must never fire early.
+    auto ticks = static_cast<uint64_t>((after + Tick - Clock::duration(1)) /
+                                       Tick);
+    // The current tick has already been processed, so the earliest a timer
+    // can fire is the next one. The loop may not have advanced the wheel in a
+    // while, so count from the real time.
+    ticks     = std::max<uint64_t>(ticks, 1);
+    auto base = std::max(toTicks(Clock::now()), current);
+
+    timer.expiresAt = std::min(base + ticks, current + MaxTicks - 1);
+    timer.wheel     = this;
+    insert(timer);
+    count++;
+}
+
+void TimerWheel::cancel(Timer& timer) noexcept {
+    if (timer.wheel != this) {
+        return;
+    }
+    unlink(timer);
+    timer.wheel = nullptr;
+    count--;
+}
+
+void TimerWheel::insert(Timer& timer) noexcept {
+    uint64_t delta = timer.expiresAt > current ? timer.expiresAt - current : 0;
+
+    // Level l holds timers due within Slots^(l+1) ticks, indexed by the bits
+    // of the expiry that belong to that level.
+    size_t level = 0;
+    while (level + 1 < Levels && delta >> (LevelBits * (level + 1))) {
+        level++;
+    }
+    // A timer cascaded down on its own tick lands in the level 0 slot that
+    // is about to be run, so it still fires on time.
+    auto slot = (timer.expiresAt >> (LevelBits * level)) & (Slots - 1);
+
+    auto& lvl   = levels[level];
+    timer.level = static_cast<uint8_t>(level);
+    timer.slot  = static_cast<uint8_t>(slot);
+    timer.prev  = nullptr;
+    timer.next  = lvl.slots[slot];
+    if (timer.next) {
+        timer.next->prev = &timer;
+    }
+    lvl.slots[slot] = &timer;
+    lvl.occupied |= uint64_t(1) << slot;
+}
+
+void TimerWheel::unlink(Timer& timer) noexcept {
+    auto& lvl = levels[timer.level];
+    if (timer.prev) {
+        timer.prev->next = timer.next;
+    } else {
+        lvl.slots[timer.slot] = timer.next;
+    }
+    if (timer.next) {
+        timer.next->prev = timer.prev;
+    }
+    if (!lvl.slots[timer.slot]) {
+        lvl.occupied &= ~(uint64_t(1) << timer.slot);
+    }
+    timer.prev = timer.next = nullptr;
+}
+
+void TimerWheel::cascade(size_t level) noexcept {
+    auto& lvl = levels[level];
+    auto slot = (current >> (LevelBits * level)) & (Slots - 1);
+
+    auto* timer     = lvl.slots[slot];
+    lvl.slots[slot] = nullptr;
+    lvl.occupied &= ~(uint64_t(1) << slot);
+
+    // Everything in this slot is now within reach of a lower level.
+    while (timer) {
+        auto* next = timer->next;
+        insert(*timer);
+        timer = next;
+    }
+
+    if (slot == 0 && level + 1 < Levels) {
+        cascade(level + 1);
+    }
+}
+
+void TimerWheel::advance(Clock::time_point now) {
+    auto target = toTicks(now);
+
+    while (current < target) {
+        // Nothing armed, nothing to walk through.
+        if (count == 0) {
+            current = target;
+            return;
+        }
+
+        current++;
+        auto slot = current & (Slots - 1);
+        if (slot == 0) {
+            cascade(1);
+        }
+
+        auto& lvl = levels[0];
+        while (auto* timer = lvl.slots[slot]) {
+            cancel(*timer);
+            // The callback may re-arm this timer or touch any other.
+            if (timer->callback) {
+                timer->callback();
+            }
+        }
+    }
+}
+
+[[nodiscard]] std::optional<TimerWheel::Clock::duration>
+TimerWheel::nextTimeout(Clock::time_point now) const noexcept {
+    if (count == 0) {
+        return std::nullopt;
+    }
+
+    // Distance, in ticks, to the next occupied level 0 slot. With nothing
+    // on level 0 we have to wake up at the next cascade anyway.
+    auto base     = (current + 1) & (Slots - 1);
+    auto rotated  = std::rotr(levels[0].occupied, static_cast<int>(base));
+    uint64_t wait = rotated ? std::countr_zero(rotated) + 1
+                            : Slots - (current & (Slots - 1));
+
+    auto deadline = start + Tick * (current + wait);
+    if (deadline <= now) {
+        return Clock::duration::zero();
+    }
+    return deadline - now;
+}
@@ -0,0 +1,233 @@
+#include "trace.hpp"
+#include "fmt/core.h"
+#include "packet.hpp"
+#include "socket.hpp"
+#include "tcp.hpp"
+#include "tins/ip_address.h"
+#include "tsc.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace tcp;
+using namespace tcp::trace;
+
+namespace {
+
+struct Registered {
+    size_t thread; // In order of their first event.
+    std::shared_ptr<TraceRing> ring;
+};
+
+std::mutex registryMutex;
+std::vector<Registered> rings;
+size_t ringCapacity = 0;
+
+// When tracing was enabled, to turn ticks into time.
+uint64_t startTicks = 0;
+std::chrono::steady_clock::time_point startClock;
+
+thread_local TraceRing* local = nullptr;
+
+const char* kindName(Kind kind) noexcept {
+    switch (kind) {
+    case Kind::StateChange:
+        return "state";
+    case Kind::SegmentIn:
+        return "in";
+    case Kind::SegmentOut:
+        return "out";
+    case Kind::Invalid:
+        return "invalid";
+    case Kind::Retransmit:
+        return "retransmit";
+    case Kind::Timeout:
+        return "timeout";
+    }
+    return "?";
+}
+
+std::string flagNames(uint8_t flags) {
+    constexpr std::pair<uint8_t, char> names[] = {
+        {TCPView::SYN, 'S'},
+        {TCPView::FIN, 'F'},
+        {TCPView::RST, 'R'},
+        {TCPView::PSH, 'P'},
+        {TCPView::ACK, '.'},
+        {TCPView::URG, 'U'},
+    };
+    std::string s;
+    for (auto [flag, name] : names) {
+        if (flags & flag) {
+            s += name;
+        }
+    }
+    return s;
+}
+
+// The flow in the direction of the segment: from the peer for inbound ones.
+std::string flowName(const FlowKey& flow, bool inbound) {
+    auto ours   = fmt::format("{}:{}",
+                            Tins::IPv4Address(flow.srcAddr).to_string(),
+                            flow.ports >> 16);
+    auto theirs = fmt::format("{}:{}",
+                              Tins::IPv4Address(flow.dstAddr).to_string(),
+                              flow.ports & 0xffff);
+    return inbound ? theirs + " > " + ours : ours + " > " + theirs;
+}
+
+} // namespace
+
+TraceRing::TraceRing(size_t capacity)
+    : mask(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1),
+      slots(std::make_unique<Slot[]>(mask + 1)) {
+}
+
+// A seqlock per ring: claimed moves before a slot is overwritten and
+// committed after, so a reader can tell which of the slots it copied may
+// have changed under it.
+void TraceRing::push(const Event& event) noexcept {
+    uint64_t words[Words];
+    memcpy(words, &event, sizeof(event));
+
+    auto i = claimed.load(std::memory_order_relaxed);
+    claimed.store(i + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto& slot = slots[i & mask];
+    for (size_t w = 0; w < Words; w++) {
+        slot.words[w].store(words[w], std::memory_order_relaxed);
+    }
+    committed.store(i + 1, std::memory_order_release);
+}
+
+[[nodiscard]] std::vector<Event> TraceRing::snapshot() const {
+    auto size  = mask + 1;
+    auto end   = committed.load(std::memory_order_acquire);
+    auto begin = end > size ? end - size : 0;
+
+    std::vector<uint64_t> words((end - begin) * Words);
+    for (auto i = begin; i < end; i++) {
+        const auto& slot = slots[i & mask];
+        for (size_t w = 0; w < Words; w++) {
+            words[(i - begin) * Words + w] =
+                slot.words[w].load(std::memory_order_relaxed);
+        }
+    }
+    // Whatever the writer claimed by now may have been overwritten.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto claimedNow = claimed.load(std::memory_order_relaxed);
+    auto first      = begin;
+    if (claimedNow > size) {
+        first = std::max(first, claimedNow - size);
+    }
+
+    // The writer may have lapped the whole ring meanwhile.
+    std::vector<Event> events(first < end ? end - first : 0);
+    if (!events.empty()) {
+        memcpy(events.data(),
+               words.data() + (first - begin) * Words,
+               events.size() * sizeof(Event));
+    }
+    return events;
+}
+
+void trace::enable(size_t eventsPerThread) {
+    std::scoped_lock lock(registryMutex);
+    ringCapacity = eventsPerThread;
+    startTicks   = tsc::now();
+    startClock   = std::chrono::steady_clock::now();
+    active.store(true, std::memory_order_relaxed);
+}
+
+void trace::disable() noexcept {
+    active.store(false, std::memory_order_relaxed);
+}
+
+void trace::record(const Event& event) noexcept {
+    if (!local) [[unlikely]] {
+        std::scoped_lock lock(registryMutex);
+        try {
+            auto ring = std::make_shared<TraceRing>(ringCapacity);
+            rings.push_back({rings.size(), ring});
+            local = ring.get();
+        } catch (const std::bad_alloc&) {
+            return;
+        }
+    }
+    local->push(event);
+}
+
+size_t trace::dump(FILE* out) {
+    struct Entry {
+        size_t thread;
+        Event event;
+    };
+    std::vector<Entry> entries;
+    uint64_t ticks0;
+    std::chrono::steady_clock::time_point clock0;
+    {
+        std::scoped_lock lock(registryMutex);
+        ticks0 = startTicks;
+        clock0 = startClock;
+        for (const auto& [thread, ring] : rings) {
+            for (const auto& event : ring->snapshot()) {
+                entries.push_back({thread, event});
+            }
+        }
+    }
+    std::stable_sort(entries.begin(),
+                     entries.end(),
+                     [](const Entry& a, const Entry& b) {
+                         return a.event.time < b.event.time;
+                     });
+
+    // Ticks per nanosecond, measured over the time tracing has been on.
+    auto elapsed = std::chrono::duration<double, std::nano>(
+                       std::chrono::steady_clock::now() - clock0)
+                       .count();
+    auto ticksPerNs =
+        elapsed > 0 ? static_cast<double>(tsc::now() - ticks0) / elapsed : 1.0;
+
+    for (const auto& [thread, e] : entries) {
+        // Seconds since tracing was enabled, negative for events from before
+        // the last enable.
+        auto seconds =
+            (static_cast<double>(e.time) - static_cast<double>(ticks0)) /
+            ticksPerNs / 1e9;
+        bool inbound = e.kind == Kind::SegmentIn || e.kind == Kind::Invalid;
+        auto head    = fmt::format("{:>14.6f} t{:<2} {:<10} {}",
+                                   seconds,
+                                   thread,
+                                   kindName(e.kind),
+                                   flowName(e.flow, inbound));
+        if (e.kind == Kind::StateChange) {
+            fmt::println(out,
+                         "{} {} -> {}",
+                         head,
+                         State::name(static_cast<State::Value>(e.flags)),
+                         State::name(static_cast<State::Value>(e.len)));
+        } else if (e.kind == Kind::Timeout) {
+            fmt::println(out, "{} una {} retry {}", head, e.seq, e.len);
+        } else {
+            fmt::println(out,
+                         "{} [{}] seq {} ack {} len {}",
+                         head,
+                         flagNames(e.flags),
+                         e.seq,
+                         e.ack,
+                         e.len);
+        }
+    }
+    return entries.size();
+}
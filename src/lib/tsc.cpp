@@ -0,0 +1,21 @@
+#include "tsc.hpp"
+#include <chrono>
+#include <stdint.h>
+#include <thread>
+
+using namespace tcp;
+
+[[nodiscard]] double tsc::ticksPerNs() noexcept {
+    static const double ratio = [] {
+        auto clock0 = std::chrono::steady_clock::now();
+        auto ticks0 = now();
+        std::this_thread::sleep_for(CalibrationTime);
+        auto ticks1  = now();
+        auto elapsed = std::chrono::duration<double, std::nano>(
+                           std::chrono::steady_clock::now() - clock0)
+                           .count();
+        return elapsed > 0 ? static_cast<double>(ticks1 - ticks0) / elapsed
+                           : 1.0;
+    }();
+    return ratio;
+}
@@ -0,0 +1,141 @@
+#include "tunDevice.hpp"
+#include "debug.hpp"
+#include "virtioNet.hpp"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace tcp;
+
+namespace {
+
+// Runs an interface ioctl through a throwaway AF_INET socket, as the
+// SIOCxIFxxx requests need one.
+void ifIoctl(unsigned long request, ifreq& ifr, const char* what) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == -1) {
+        throw std::runtime_error("tun: couldn't open control socket");
+    }
+    int res = ioctl(sock, request, &ifr);
+    close(sock);
+    if (res == -1) {
+        throw std::runtime_error(std::string("tun: ") + what + ": " +
+                                 strerror(errno));
+    }
+}
+
+ifreq makeIfreq(const std::string& name) {
+    ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+    return ifr;
+}
+
+} // namespace
+
+TunDevice::TunDevice(const std::string& name,
+                     size_t numQueues,
+                     bool vnetHdr)
+    : ifName(name), hasVnetHdr(vnetHdr) {
+    if (numQueues == 0) {
+        throw std::invalid_argument("tun: need at least one queue");
+    }
+
+    short flags = IFF_TUN | IFF_NO_PI;
+    if (numQueues > 1) {
+        flags |= IFF_MULTI_QUEUE;
+    }
+    if (vnetHdr) {
+        flags |= IFF_VNET_HDR;
+    }
+
+    for (size_t i = 0; i < numQueues; i++) {
+        int fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+        if (fd == -1) {
+            closeQueues();
+            throw std::runtime_error("tun: couldn't open /dev/net/tun");
+        }
+
+        auto ifr      = makeIfreq(ifName);
+        ifr.ifr_flags = flags;
+        if (ioctl(fd, TUNSETIFF, &ifr) == -1) {
+            int err = errno;
+            close(fd);
+            closeQueues();
+            throw std::runtime_error(std::string("tun: TUNSETIFF: ") +
+                                     strerror(err));
+        }
+        // Kernel may have picked the name (for patterns like "tun%d").
+        ifName = ifr.ifr_name;
+        fds.push_back(fd);
+
+        if (vnetHdr) {
+            int hdrSize = sizeof(VirtioNetHdr);
+            if (ioctl(fd, TUNSETVNETHDRSZ, &hdrSize) == -1) {
+                int err = errno;
+                closeQueues();
+                throw std::runtime_error(
+                    std::string("tun: TUNSETVNETHDRSZ: ") + strerror(err));
+            }
+        }
+    }
+
+    if (vnetHdr) {
+        // Offloads are a property of the device, setting them through one
+        // queue is enough. Without them we still get to use the transmit
+        // side offloads.
+        unsigned int offloads = TUN_F_CSUM | TUN_F_TSO4;
+        hasRxOffload          = ioctl(fds[0], TUNSETOFFLOAD, offloads) != -1;
+        if (!hasRxOffload) {
+            debug::println("tun: TUNSETOFFLOAD failed, errno: {}", errno);
+        }
+    }
+}
+
+TunDevice::~TunDevice() {
+    closeQueues();
+}
+
+void TunDevice::closeQueues() noexcept {
+    for (int fd : fds) {
+        close(fd);
+    }
+    fds.clear();
+}
+
+void TunDevice::ip(const Tins::IPv4Address& addr, int prefixLen) {
+    auto ifr = makeIfreq(ifName);
+
+    auto* sin       = reinterpret_cast<sockaddr_in*>(&ifr.ifr_addr);
+    sin->sin_family = AF_INET;
+    // IPv4Address converts to a network order integer.
+    sin->sin_addr.s_addr = static_cast<uint32_t>(addr);
+    ifIoctl(SIOCSIFADDR, ifr, "SIOCSIFADDR");
+
+    uint32_t mask = prefixLen == 0 ? 0 : ~uint32_t(0) << (32 - prefixLen);
+    sin->sin_addr.s_addr = htonl(mask);
+    ifIoctl(SIOCSIFNETMASK, ifr, "SIOCSIFNETMASK");
+}
+
+void TunDevice::up() {
+    auto ifr = makeIfreq(ifName);
+    ifIoctl(SIOCGIFFLAGS, ifr, "SIOCGIFFLAGS");
+    ifr.ifr_flags |= IFF_UP | IFF_RUNNING;
+    ifIoctl(SIOCSIFFLAGS, ifr, "SIOCSIFFLAGS");
+}
+
+[[nodiscard]] int TunDevice::mtu() const {
+    auto ifr = makeIfreq(ifName);
+    ifIoctl(SIOCGIFMTU, ifr, "SIOCGIFMTU");
+    return ifr.ifr_mtu;
+}
@@ -1,25 +1,45 @@
-#include "connection.hpp"
+#include "capture.hpp"
 #include "socket.hpp"
+#include "stack.hpp"
+#include "stats.hpp"
 #include "tins/ip.h"
 #include "tins/ip_address.h"
+#include "trace.hpp"
+#include "tunDevice.hpp"
+#include <algorithm>
+#include <chrono>
 #include <fmt/core.h>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <thread>
 #include <tl/expected.hpp>
-#include <tuntap++.hh>
 #include <unistd.h>
 
 const Tins::IPv4Address TunIP  = Tins::IPv4Address("192.168.0.1");
 const Tins::IPv4Address HostIP = Tins::IPv4Address("192.168.0.2");
+const std::string TunName       = "tun0";
 
 std::vector<std::string> splitString(std::string s, std::string delimiter);
+void printStats(tcp::Stack& stack);
+void printLatency(const tcp::Stack& stack);
 
-int main(int, char**) {
-    tuntap::tun tun;
-    tun.ip(TunIP.to_string(), 24);
+int main(int argc, char** argv) {
+    // Optional first argument: number of tun queues, one shard (and core)
+    // per queue. Optional second argument "offload": open the tun with a
+    // virtio-net header for checksum and segmentation offloads.
+    size_t numQueues = 1;
+    if (argc > 1) {
+        numQueues = std::max(1, std::atoi(argv[1]));
+    }
+    bool offload = argc > 2 && std::string(argv[2]) == "offload";
+
+    tcp::TunDevice tun(TunName, numQueues, offload);
+    tun.ip(TunIP, 24);
     tun.up();
 
     fmt::println("Welcome to TCP terminal");
@@ -27,11 +47,21 @@ int main(int, char**) {
     fmt::println("send:<dst ipAddr>:<dst port>:<src port>:<data to send>");
     fmt::println("reply:<text>");
     fmt::println("connect:<ip>:<port>:<src port>");
+    fmt::println("close:<ip>:<port>:<src port>");
+    fmt::println("capture:<pcapng file>[:<port>]");
+    fmt::println("capture:stop");
+    fmt::println("stats");
+    fmt::println("stats:<prometheus file>");
+    fmt::println("stats:stop");
+    fmt::println("latency");
+    fmt::println("trace:on|off");
+    fmt::println("trace:dump[:<file>]");
+    fmt::println("synqueue:<max half-open>:cookies|nocookies");
     fmt::println("");
 
-    tcp::ConnectionManager tcpManager(tun, HostIP);
+    tcp::Stack tcpManager(tun, HostIP);
 
-    std::thread rcvr(&tcp::ConnectionManager::run, &tcpManager);
+    std::thread rcvr(&tcp::Stack::run, &tcpManager);
 
     std::string line;
     while (std::getline(std::cin, line)) {
@@ -77,6 +107,96 @@ int main(int, char**) {
                     continue;
                 }
             }
+            if (line.starts_with("close:")) {
+                auto tokens = splitString(line, ":");
+                if (tokens.size() == 4) {
+                    tcp::SocketPair socketPair{
+                        .src = {HostIP,
+                                static_cast<uint16_t>(std::stoi(tokens[3]))},
+                        .dst = {Tins::IPv4Address(tokens[1]),
+                                static_cast<uint16_t>(std::stoi(tokens[2]))},
+                    };
+
+                    tcpManager.withConnection(socketPair,
+                                              [](tcp::Connection& conn) {
+                                                  conn.close();
+                                              });
+                    continue;
+                }
+            }
+            if (line == "capture:stop") {
+                if (auto stats = tcpManager.captureStats()) {
+                    fmt::println("[TCP Shell] Captured {} frames, dropped {}",
+                                 stats->captured,
+                                 stats->dropped);
+                }
+                tcpManager.stopCapture();
+                continue;
+            }
+            if (line == "stats") {
+                printStats(tcpManager);
+                continue;
+            }
+            if (line == "latency") {
+                printLatency(tcpManager);
+                continue;
+            }
+            if (line == "stats:stop") {
+                tcpManager.stopStatsExport();
+                continue;
+            }
+            if (line.starts_with("stats:")) {
+                tcpManager.startStatsExport(line.substr(6),
+                                            std::chrono::seconds(1));
+                continue;
+            }
+            if (line == "trace:on") {
+                tcp::trace::enable();
+                continue;
+            }
+            if (line == "trace:off") {
+                tcp::trace::disable();
+                continue;
+            }
+            if (line == "trace:dump") {
+                tcp::trace::dump(stdout);
+                continue;
+            }
+            if (line.starts_with("trace:dump:")) {
+                auto path = line.substr(11);
+                if (FILE* f = fopen(path.c_str(), "w")) {
+                    auto n = tcp::trace::dump(f);
+                    fclose(f);
+                    fmt::println("[TCP Shell] Wrote {} events to {}", n, path);
+                    continue;
+                }
+            }
+            if (line.starts_with("synqueue:")) {
+                auto tokens = splitString(line, ":");
+                if (tokens.size() == 3 &&
+                    (tokens[2] == "cookies" || tokens[2] == "nocookies")) {
+                    tcpManager.setSynQueue({
+                        .maxHalfOpen = std::stoul(tokens[1]),
+                        .cookies     = tokens[2] == "cookies",
+                    });
+                    continue;
+                }
+            }
+            if (line.starts_with("capture:")) {
+                auto tokens = splitString(line, ":");
+                if (tokens.size() == 2 || tokens.size() == 3) {
+                    tcp::CaptureConfig config{.path = tokens[1]};
+                    if (tokens.size() == 3) {
+                        config.filters.push_back({
+                            .flow = std::nullopt,
+                            .port = static_cast<uint16_t>(
+                                std::stoi(tokens[2])),
+                        });
+                    }
+                    tcpManager.startCapture(config);
+                    continue;
+                }
+            }
         } catch (...) {
         }
         fmt::println("[TCP Shell] Invalid Command");
@@ -98,3 +218,68 @@ std::vector<std::string> splitString(std::string s, std::string delimiter) {
     res.push_back(s.substr(pos_start));
     return res;
 }
+
+// Counters summed over the shards, then one line per connection.
+void printStats(tcp::Stack& stack) {
+    std::vector<std::pair<const char*, uint64_t>> totals;
+    for (size_t i = 0; i < stack.numShards(); i++) {
+        size_t m = 0;
+        stack.shard(i).stats().visit(
+            [&](const tcp::MetricInfo& info, uint64_t value) {
+                if (m == totals.size()) {
+                    totals.emplace_back(info.name, 0);
+                }
+                totals[m++].second += value;
+            });
+    }
+    for (const auto& [name, value] : totals) {
+        fmt::println("{:<28} {}", name, value);
+    }
+
+    fmt::println("{:<21} {:<21} {:<12} {:>10} {:>10} {:>8} {:>6}",
+                 "local",
+                 "remote",
+                 "state",
+                 "cwnd",
+                 "snd.wnd",
+                 "srtt ms",
+                 "rto");
+    for (const auto& c : stack.connections(std::chrono::milliseconds(500))) {
+        auto srtt =
+            c.srtt ? fmt::format("{:.1f}",
+                                 std::chrono::duration<double, std::milli>(
+                                     *c.srtt)
+                                     .count())
+                   : std::string("-");
+        fmt::println("{:<21} {:<21} {:<12} {:>10} {:>10} {:>8} {:>6}",
+                     fmt::format("{}:{}", c.pair.src.addr.to_string(),
+                                 c.pair.src.port),
+                     fmt::format("{}:{}", c.pair.dst.addr.to_string(),
+                                 c.pair.dst.port),
+                     tcp::State::name(c.state),
+                     c.cwnd,
+                     c.sndWnd,
+                     srtt,
+                     c.timeouts);
+    }
+}
+
+// Percentiles of every stage of the packet path, in microseconds.
+void printLatency(const tcp::Stack& stack) {
+    fmt::println("{:<18} {:>10} {:>10} {:>10} {:>10} {:>10}",
+                 "stage",
+                 "count",
+                 "p50 us",
+                 "p99 us",
+                 "p99.9 us",
+                 "max us");
+    for (const auto& s : stack.latency()) {
+        fmt::println("{:<18} {:>10} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}",
+                     tcp::stageName(s.stage),
+                     s.count,
+                     s.p50 / 1e3,
+                     s.p99 / 1e3,
+                     s.p999 / 1e3,
+                     s.max / 1e3);
+    }
+}
@@ -0,0 +1,110 @@
+#include "checksum.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace tcp::checksum;
+
+namespace {
+
+constexpr Kernel Kernels[] = {Kernel::Portable, Kernel::SSE2, Kernel::AVX2};
+
+// RFC 1071 as written: big endian 16 bit words, an odd byte padded with zero.
+uint16_t reference(std::span<const uint8_t> data) {
+    uint64_t sum = 0;
+    size_t i     = 0;
+    for (; i + 1 < data.size(); i += 2) {
+        sum += static_cast<uint64_t>(data[i] << 8 | data[i + 1]);
+    }
+    if (i < data.size()) {
+        sum += static_cast<uint64_t>(data[i] << 8);
+    }
+    return fold(sum);
+}
+
+// 0x0000 and 0xffff are both zero in one's complement.
+uint16_t canonical(uint16_t folded) {
+    return folded == 0xffff ? 0 : folded;
+}
+
+std::vector<uint8_t> randomBytes(size_t size) {
+    std::mt19937 rng(17);
+    std::vector<uint8_t> buf(size);
+    for (auto& b : buf) {
+        b = static_cast<uint8_t>(rng());
+    }
+    return buf;
+}
+
+} // namespace
+
+TEST(Checksum, KernelsAgreeOnEveryLengthAndAlignment) {
+    auto buf = randomBytes(4096 + 64);
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t size = 0; size <= 300; size++) {
+            std::span<const uint8_t> data(buf.data() + offset, size);
+            auto want = canonical(reference(data));
+            for (auto kernel : Kernels) {
+                if (!supported(kernel)) {
+                    continue;
+                }
+                EXPECT_EQ(canonical(fold(partialWith(kernel, data))), want)
+                    << kernelName(kernel) << " size " << size << " offset "
+                    << offset;
+            }
+            EXPECT_EQ(canonical(fold(partial(data))), want)
+                << "size " << size << " offset " << offset;
+        }
+    }
+}
+
+TEST(Checksum, KernelsAgreeOnPayloadSizes) {
+    auto buf = randomBytes(65536 + 8);
+    for (size_t size : {1459, 1460, 1461, 4095, 9001, 65535, 65536}) {
+        for (size_t offset : {0, 1, 3}) {
+            std::span<const uint8_t> data(buf.data() + offset, size);
+            auto want = canonical(reference(data));
+            for (auto kernel : Kernels) {
+                if (!supported(kernel)) {
+                    continue;
+                }
+                EXPECT_EQ(canonical(fold(partialWith(kernel, data))), want)
+                    << kernelName(kernel) << " size " << size << " offset "
+                    << offset;
+            }
+        }
+    }
+}
+
+// The largest sums a buffer can have, for carries out of every lane.
+TEST(Checksum, KernelsCarryOnAllOnes) {
+    std::vector<uint8_t> buf(65537, 0xff);
+    auto want = canonical(reference(buf));
+    for (auto kernel : Kernels) {
+        if (!supported(kernel)) {
+            continue;
+        }
+        EXPECT_EQ(canonical(fold(partialWith(kernel, buf))), want)
+            << kernelName(kernel);
+    }
+}
+
+TEST(Checksum, PiecesAddUp) {
+    auto buf = randomBytes(1500);
+    std::span<const uint8_t> data(buf);
+    for (auto kernel : Kernels) {
+        if (!supported(kernel)) {
+            continue;
+        }
+        // Only the last piece may have an odd length.
+        auto sum = partialWith(kernel, data.first(40));
+        sum      = partialWith(kernel, data.subspan(40, 1000), sum);
+        sum      = partialWith(kernel, data.subspan(1040, 459), sum);
+        EXPECT_EQ(canonical(fold(sum)),
+                  canonical(reference(data.first(1499))))
+            << kernelName(kernel);
+    }
+}
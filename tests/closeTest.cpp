@@ -0,0 +1,307 @@
+#include "connection.hpp"
+#include "linkDevice.hpp"
+#include "packet.hpp"
+#include "segment.hpp"
+#include "socket.hpp"
+#include "stack.hpp"
+#include "tcp.hpp"
+#include "tins/ip_address.h"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace tcp;
+using namespace std::chrono_literals;
+
+namespace {
+
+// A stack on one end of a MemoryLink pair, and a peer on the other that
+// writes segments by hand and reads what the stack answers.
+class CloseTest : public ::testing::Test {
+  protected:
+    struct Segment {
+        uint32_t seq;
+        uint32_t ack;
+        uint8_t flags;
+        size_t len;
+    };
+
+    CloseTest() : stack(linkOf(ends.first), UsIP) {
+    }
+
+    void SetUp() override {
+        thread = std::thread(&Stack::run, &stack);
+    }
+
+    void TearDown() override {
+        stack.stop();
+        thread.join();
+    }
+
+    // Polls `fn` until it returns true, for at most `timeout`.
+    template <typename F>
+    static bool eventually(F&& fn, std::chrono::milliseconds timeout = 5s) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!fn()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+        return true;
+    }
+
+    static std::vector<std::unique_ptr<LinkDevice>>
+    linkOf(std::unique_ptr<MemoryLink>& end) {
+        std::vector<std::unique_ptr<LinkDevice>> links;
+        links.push_back(std::move(end));
+        return links;
+    }
+
+    void send(uint8_t flags, uint32_t seq, uint32_t ack = 0) {
+        SegmentTemplate tmpl(Peer, Us, Connection::DefaultTTL);
+        std::vector<uint8_t> out(tmpl.maxOverhead());
+        SegmentFields fields = {
+            .seq    = seq,
+            .ack    = ack,
+            .flags  = flags,
+            .window = 65535,
+        };
+        out.resize(tmpl.emit(out.data(), fields, {}, {}));
+        ASSERT_TRUE(peer->write(out));
+        peer->flush();
+    }
+
+    // The next segment the stack sends.
+    std::optional<Segment> receive() {
+        std::optional<Segment> seg;
+        eventually([&] {
+            uint8_t buf[2048];
+            auto n = peer->read(buf);
+            if (n <= 0) {
+                return false;
+            }
+            auto pkt = PacketView::parse(
+                std::span<const uint8_t>(buf, static_cast<size_t>(n)));
+            if (!pkt) {
+                return false;
+            }
+            seg = Segment{
+                .seq   = pkt->tcp.seq(),
+                .ack   = pkt->tcp.ack_seq(),
+                .flags = pkt->tcp.flags(),
+                .len   = pkt->payload.size(),
+            };
+            return true;
+        });
+        return seg;
+    }
+
+    // The state of our connection, nothing once it's gone.
+    std::optional<State::Value> state() {
+        for (const auto& info : stack.connections(100ms)) {
+            if (info.pair == Pair) {
+                return info.state;
+            }
+        }
+        return std::nullopt;
+    }
+
+    bool reaches(std::optional<State::Value> want) {
+        return eventually([&] {
+            return state() == want;
+        });
+    }
+
+    uint64_t inTimeWait() {
+        return stack.shard(0).stats().timeWait.get();
+    }
+
+    void closeOurs() {
+        stack.withConnection(Pair, [](Connection& conn) {
+            conn.close();
+        });
+    }
+
+    // Runs the handshake from the peer, starting its sequence at `iss`.
+    void establish(uint32_t iss) {
+        send(TCPView::SYN, iss);
+        auto synAck = receive();
+        ASSERT_TRUE(synAck);
+        ASSERT_EQ(synAck->flags, TCPView::SYN | TCPView::ACK);
+        ASSERT_EQ(synAck->ack, iss + 1);
+        ourIss  = synAck->seq;
+        ourNxt  = ourIss + 1;
+        peerNxt = iss + 1;
+        send(TCPView::ACK, peerNxt, ourNxt);
+        ASSERT_TRUE(reaches(State::Value::Established));
+    }
+
+    // Has our side send `data` and acks each of its segments.
+    void transfer(const std::string& data) {
+        stack.send(Pair, data);
+        auto end = ourNxt + static_cast<uint32_t>(data.size());
+        while (seqLT(ourNxt, end)) {
+            auto seg = receive();
+            ASSERT_TRUE(seg);
+            ASSERT_EQ(seg->seq, ourNxt);
+            ourNxt += static_cast<uint32_t>(seg->len);
+            send(TCPView::ACK, peerNxt, ourNxt);
+        }
+    }
+
+    // Closes ours, then the peer's, leaving ours in TIME-WAIT.
+    void closeActively() {
+        closeOurs();
+        auto fin = receive();
+        ASSERT_TRUE(fin);
+        ASSERT_EQ(fin->flags, TCPView::FIN | TCPView::ACK);
+        ASSERT_EQ(fin->seq, ourNxt);
+        ourNxt++;
+        ASSERT_TRUE(reaches(State::Value::FinWait1));
+
+        send(TCPView::ACK, peerNxt, ourNxt);
+        ASSERT_TRUE(reaches(State::Value::FinWait2));
+
+        send(TCPView::FIN | TCPView::ACK, peerNxt, ourNxt);
+        peerNxt++;
+        auto ack = receive();
+        ASSERT_TRUE(ack);
+        EXPECT_EQ(ack->flags, TCPView::ACK);
+        EXPECT_EQ(ack->seq, ourNxt);
+        EXPECT_EQ(ack->ack, peerNxt);
+        // TIME-WAIT keeps no Connection.
+        ASSERT_TRUE(reaches(std::nullopt));
+        ASSERT_TRUE(eventually([&] {
+            return inTimeWait() == 1;
+        }));
+    }
+
+    inline static const Tins::IPv4Address UsIP{"10.0.0.1"};
+    inline static const Socket Us{UsIP, 80};
+    inline static const Socket Peer{Tins::IPv4Address("10.0.0.2"), 40000};
+    inline static const SocketPair Pair{Us, Peer};
+
+    std::pair<std::unique_ptr<MemoryLink>, std::unique_ptr<MemoryLink>> ends =
+        MemoryLink::pair(2048);
+    std::unique_ptr<MemoryLink>& peer = ends.second;
+    Stack stack;
+    std::thread thread;
+
+    uint32_t ourIss  = 0;
+    uint32_t ourNxt  = 0;
+    uint32_t peerNxt = 0;
+};
+
+} // namespace
+
+TEST_F(CloseTest, ActiveCloseEndsInTimeWait) {
+    establish(1000);
+    closeActively();
+
+    // The peer's FIN again, our ACK of it having been lost: acked again.
+    send(TCPView::FIN | TCPView::ACK, peerNxt - 1, ourNxt);
+    auto ack = receive();
+    ASSERT_TRUE(ack);
+    EXPECT_EQ(ack->flags, TCPView::ACK);
+    EXPECT_EQ(ack->seq, ourNxt);
+    EXPECT_EQ(ack->ack, peerNxt);
+    // A RST doesn't end the wait early (RFC 1337).
+    send(TCPView::RST, peerNxt);
+    std::this_thread::sleep_for(50ms);
+    EXPECT_EQ(inTimeWait(), 1u);
+}
+
+TEST_F(CloseTest, SimultaneousCloseGoesThroughClosing) {
+    establish(1000);
+    closeOurs();
+    auto fin = receive();
+    ASSERT_TRUE(fin);
+    ASSERT_EQ(fin->flags, TCPView::FIN | TCPView::ACK);
+    ourNxt++;
+
+    // The peer's FIN crosses ours.
+    send(TCPView::FIN | TCPView::ACK, peerNxt, ourNxt - 1);
+    peerNxt++;
+    ASSERT_TRUE(reaches(State::Value::Closing));
+    auto ack = receive();
+    ASSERT_TRUE(ack);
+    EXPECT_EQ(ack->ack, peerNxt);
+
+    send(TCPView::ACK, peerNxt, ourNxt);
+    ASSERT_TRUE(reaches(std::nullopt));
+    EXPECT_TRUE(eventually([&] {
+        return inTimeWait() == 1;
+    }));
+}
+
+// A connection without an application closes as soon as the peer did, and
+// the side closing second skips TIME-WAIT.
+TEST_F(CloseTest, PassiveCloseGoesThroughLastAck) {
+    establish(1000);
+    send(TCPView::FIN | TCPView::ACK, peerNxt, ourNxt);
+    peerNxt++;
+
+    std::optional<Segment> fin;
+    ASSERT_TRUE(eventually([&] {
+        auto seg = receive();
+        if (seg && (seg->flags & TCPView::FIN)) {
+            fin = seg;
+        }
+        return fin.has_value();
+    }));
+    EXPECT_EQ(fin->seq, ourNxt);
+    EXPECT_EQ(fin->ack, peerNxt);
+    ourNxt++;
+    ASSERT_TRUE(reaches(State::Value::LastAck));
+
+    send(TCPView::ACK, peerNxt, ourNxt);
+    ASSERT_TRUE(reaches(std::nullopt));
+    EXPECT_EQ(inTimeWait(), 0u);
+}
+
+// An old duplicate SYN is acked like any segment in TIME-WAIT, a SYN past
+// the old connection reopens the flow (RFC 1122 4.2.2.13) with an ISN past
+// anything the old one sent.
+TEST_F(CloseTest, NewSynReopensTimeWait) {
+    establish(1000);
+    closeActively();
+
+    send(TCPView::SYN, 1000);
+    auto ack = receive();
+    ASSERT_TRUE(ack);
+    EXPECT_EQ(ack->flags, TCPView::ACK);
+    EXPECT_EQ(ack->ack, peerNxt);
+    EXPECT_EQ(inTimeWait(), 1u);
+
+    send(TCPView::SYN, peerNxt + 100000);
+    auto synAck = receive();
+    ASSERT_TRUE(synAck);
+    EXPECT_EQ(synAck->flags, TCPView::SYN | TCPView::ACK);
+    EXPECT_EQ(synAck->ack, peerNxt + 100001);
+    EXPECT_TRUE(seqGT(synAck->seq, ourNxt));
+    EXPECT_TRUE(reaches(State::Value::SynRcvd));
+    EXPECT_EQ(inTimeWait(), 0u);
+}
+
+// ISNs of a flow follow a 4us clock, slower than a connection can send: the
+// ISN still has to clear what the one before sent.
+TEST_F(CloseTest, ReopenedIsnClearsAFastConnection) {
+    establish(1000);
+    transfer(std::string(2 << 20, 'x'));
+    closeActively();
+
+    send(TCPView::SYN, peerNxt + 100000);
+    auto synAck = receive();
+    ASSERT_TRUE(synAck);
+    ASSERT_EQ(synAck->flags, TCPView::SYN | TCPView::ACK);
+    EXPECT_TRUE(seqGT(synAck->seq, ourNxt));
+}
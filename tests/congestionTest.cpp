@@ -0,0 +1,144 @@
+#include "congestion.hpp"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string>
+
+using namespace tcp;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint32_t Mss = 1000;
+
+const auto Start = CongestionControl::Clock::time_point{} + 1h;
+
+} // namespace
+
+// RFC 5681 3.1.
+TEST(CongestionControl, InitialWindowDependsOnTheMss) {
+    EXPECT_EQ(NewRenoCongestionControl(536).cwnd(), 4 * 536u);
+    EXPECT_EQ(NewRenoCongestionControl(1460).cwnd(), 3 * 1460u);
+    EXPECT_EQ(NewRenoCongestionControl(4000).cwnd(), 2 * 4000u);
+
+    NewRenoCongestionControl cc(536);
+    cc.setMSS(1460);
+    EXPECT_EQ(cc.cwnd(), 3 * 1460u);
+}
+
+TEST(CongestionControl, SlowStartThenCongestionAvoidance) {
+    NewRenoCongestionControl cc(Mss);
+    auto cwnd = cc.cwnd();
+    // At most one segment per ACK, however much it acks.
+    cc.onAck(Mss, Start);
+    EXPECT_EQ(cc.cwnd(), cwnd + Mss);
+    cc.onAck(5 * Mss, Start);
+    EXPECT_EQ(cc.cwnd(), cwnd + 2 * Mss);
+
+    // A timeout leaves one segment and a threshold of half what was in
+    // flight.
+    cc.onRTO(20 * Mss);
+    EXPECT_EQ(cc.cwnd(), Mss);
+    EXPECT_EQ(cc.ssthresh(), 10 * Mss);
+
+    for (int i = 0; i < 9; i++) {
+        cc.onAck(Mss, Start);
+    }
+    EXPECT_EQ(cc.cwnd(), 10 * Mss);
+    // Above ssthresh, one segment per window acked.
+    for (int i = 0; i < 9; i++) {
+        cc.onAck(Mss, Start);
+    }
+    EXPECT_EQ(cc.cwnd(), 10 * Mss);
+    cc.onAck(Mss, Start);
+    EXPECT_EQ(cc.cwnd(), 11 * Mss);
+}
+
+// RFC 5681 3.2 and RFC 6582 3.2.
+TEST(CongestionControl, FastRecovery) {
+    NewRenoCongestionControl cc(Mss);
+    cc.onEnterRecovery(20 * Mss);
+    EXPECT_EQ(cc.ssthresh(), 10 * Mss);
+    // Inflated by the three segments that left the network.
+    EXPECT_EQ(cc.cwnd(), 13 * Mss);
+
+    cc.onDupAck();
+    EXPECT_EQ(cc.cwnd(), 14 * Mss);
+    // Deflated by what was acked, plus one segment back.
+    cc.onPartialAck(3 * Mss);
+    EXPECT_EQ(cc.cwnd(), 12 * Mss);
+    // Less than a segment acked, nothing back.
+    cc.onPartialAck(Mss / 2);
+    EXPECT_EQ(cc.cwnd(), 12 * Mss - Mss / 2);
+
+    cc.onExitRecovery();
+    EXPECT_EQ(cc.cwnd(), 10 * Mss);
+
+    // Never below two segments.
+    cc.onEnterRecovery(Mss);
+    EXPECT_EQ(cc.ssthresh(), 2 * Mss);
+}
+
+TEST(CongestionControl, RenoEndsRecoveryOnAPartialAck) {
+    EXPECT_FALSE(RenoCongestionControl(Mss).partialAckRecovery());
+    EXPECT_TRUE(NewRenoCongestionControl(Mss).partialAckRecovery());
+}
+
+TEST(CongestionControl, MakeBuildsTheAlgorithm) {
+    using Algorithm = CongestionControl::Algorithm;
+    EXPECT_EQ(std::string(makeCongestionControl(Algorithm::Reno, Mss)->name()),
+              "reno");
+    EXPECT_EQ(
+        std::string(makeCongestionControl(Algorithm::NewReno, Mss)->name()),
+        "newreno");
+    EXPECT_EQ(
+        std::string(makeCongestionControl(Algorithm::Cubic, Mss)->name()),
+        "cubic");
+}
+
+// RFC 9438 4.6 and 4.7: back off to Beta of the window.
+TEST(CubicCongestionControl, BacksOffToBeta) {
+    CubicCongestionControl cc(Mss);
+    while (cc.cwnd() < 100 * Mss) {
+        cc.onAck(Mss, Start);
+    }
+
+    cc.onEnterRecovery(cc.cwnd());
+    EXPECT_NEAR(cc.ssthresh(), 70 * Mss, 1);
+    EXPECT_EQ(cc.cwnd(), cc.ssthresh() + 3 * Mss);
+    cc.onExitRecovery();
+    EXPECT_EQ(cc.cwnd(), cc.ssthresh());
+
+    cc.onRTO(cc.cwnd());
+    EXPECT_NEAR(cc.ssthresh(), 49 * Mss, 1);
+    EXPECT_EQ(cc.cwnd(), Mss);
+}
+
+// After a loss the window climbs back towards where the loss happened,
+// reaching it about K seconds later, and keeps growing past it.
+TEST(CubicCongestionControl, ClimbsBackToTheLossWindow) {
+    CubicCongestionControl cc(Mss);
+    while (cc.cwnd() < 100 * Mss) {
+        cc.onAck(Mss, Start);
+    }
+    cc.onEnterRecovery(cc.cwnd());
+    cc.onExitRecovery();
+
+    // A window of data acked every 100ms.
+    auto now      = Start;
+    auto last     = cc.cwnd();
+    auto windowAt = [&](std::chrono::milliseconds until) {
+        for (; now < Start + until; now += 100ms) {
+            for (uint32_t acked = 0; acked < cc.cwnd(); acked += Mss) {
+                cc.onAck(Mss, now);
+            }
+            EXPECT_GE(cc.cwnd(), last);
+            last = cc.cwnd();
+        }
+        return static_cast<double>(cc.cwnd()) / Mss;
+    };
+    // K = cbrt(100 * (1 - 0.7) / 0.4), about 4.2 seconds.
+    EXPECT_LT(windowAt(2s), 100);
+    EXPECT_NEAR(windowAt(4200ms), 100, 5);
+    EXPECT_GT(windowAt(8s), 110);
+}
@@ -0,0 +1,118 @@
+#include "flowTable.hpp"
+#include "socket.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+using namespace tcp;
+
+namespace {
+
+FlowKey keyOf(uint32_t i) {
+    return {
+        .srcAddr = 0x0a000001,
+        .dstAddr = 0x0a000002 + (i >> 16),
+        .ports   = 80u << 16 | (i & 0xffff),
+    };
+}
+
+// Throws from its constructor when asked to.
+struct Fussy {
+    explicit Fussy(bool fail) {
+        if (fail) {
+            throw std::runtime_error("fussy");
+        }
+    }
+};
+
+} // namespace
+
+TEST(FlowTable, InsertFindErase) {
+    FlowTable<uint32_t> table;
+    for (uint32_t i = 0; i < 1000; i++) {
+        auto [value, inserted] = table.tryEmplace(keyOf(i), i);
+        ASSERT_TRUE(inserted);
+        EXPECT_EQ(*value, i);
+    }
+    EXPECT_EQ(table.size(), 1000u);
+
+    // Emplacing a key that's there returns its value.
+    auto [value, inserted] = table.tryEmplace(keyOf(7), 1234u);
+    EXPECT_FALSE(inserted);
+    EXPECT_EQ(*value, 7u);
+
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        EXPECT_TRUE(table.erase(keyOf(i)));
+    }
+    EXPECT_FALSE(table.erase(keyOf(0)));
+    EXPECT_EQ(table.size(), 500u);
+    for (uint32_t i = 0; i < 1000; i++) {
+        auto* found = table.find(keyOf(i));
+        if (i % 2 == 0) {
+            EXPECT_EQ(found, nullptr) << i;
+        } else {
+            ASSERT_NE(found, nullptr) << i;
+            EXPECT_EQ(*found, i);
+        }
+    }
+    EXPECT_EQ(table.find(keyOf(5000)), nullptr);
+}
+
+// Erasing from full groups leaves tombstones that lookups have to probe
+// past, and inserts reuse.
+TEST(FlowTable, ChurnThroughTombstones) {
+    FlowTable<uint32_t> table;
+    std::vector<bool> present(4096, false);
+    std::mt19937 rng(3);
+    size_t count = 0;
+    for (int round = 0; round < 50000; round++) {
+        uint32_t i = rng() % present.size();
+        if (present[i]) {
+            ASSERT_TRUE(table.erase(keyOf(i)));
+            count--;
+        } else {
+            ASSERT_TRUE(table.tryEmplace(keyOf(i), i).second);
+            count++;
+        }
+        present[i] = !present[i];
+    }
+    EXPECT_EQ(table.size(), count);
+    for (uint32_t i = 0; i < present.size(); i++) {
+        auto* found = table.find(keyOf(i));
+        if (present[i]) {
+            ASSERT_NE(found, nullptr) << i;
+            EXPECT_EQ(*found, i);
+        } else {
+            EXPECT_EQ(found, nullptr) << i;
+        }
+    }
+    size_t visited = 0;
+    table.forEach([&](const FlowKey& key, uint32_t value) {
+        EXPECT_EQ(key, keyOf(value));
+        visited++;
+    });
+    EXPECT_EQ(visited, count);
+}
+
+TEST(FlowTable, ValuesDontMoveWhenGrowing) {
+    FlowTable<uint32_t> table;
+    auto* first = table.tryEmplace(keyOf(0), 0u).first;
+    for (uint32_t i = 1; i < 10000; i++) {
+        table.tryEmplace(keyOf(i), i);
+    }
+    EXPECT_EQ(table.find(keyOf(0)), first);
+    EXPECT_EQ(*first, 0u);
+}
+
+TEST(FlowTable, ThrowingConstructorLeavesTableAsItWas) {
+    FlowTable<Fussy> table;
+    EXPECT_THROW(table.tryEmplace(keyOf(1), true), std::runtime_error);
+    EXPECT_EQ(table.size(), 0u);
+    EXPECT_EQ(table.find(keyOf(1)), nullptr);
+
+    EXPECT_TRUE(table.tryEmplace(keyOf(1), false).second);
+    EXPECT_NE(table.find(keyOf(1)), nullptr);
+    EXPECT_EQ(table.size(), 1u);
+}
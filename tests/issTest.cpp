@@ -0,0 +1,40 @@
+#include "iss.hpp"
+#include "socket.hpp"
+#include "tcp.hpp"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+using namespace tcp;
+
+namespace {
+
+constexpr FlowKey Flow = {
+    .srcAddr = 0x0a000001,
+    .dstAddr = 0x0a000002,
+    .ports   = 40000u << 16 | 80,
+};
+
+const auto Start = IssGenerator::Clock::time_point{} + std::chrono::hours(1);
+
+} // namespace
+
+TEST(IssGenerator, GoesUpWithTheClock) {
+    IssGenerator gen;
+    auto first = gen.make(Flow, Start);
+    EXPECT_EQ(gen.make(Flow, Start), first);
+    EXPECT_EQ(gen.make(Flow, Start + IssGenerator::Tick), first + 1);
+    EXPECT_EQ(gen.make(Flow, Start + std::chrono::seconds(1)), first + 250000);
+    EXPECT_TRUE(seqGT(gen.make(Flow, Start + std::chrono::minutes(1)), first));
+}
+
+TEST(IssGenerator, DependsOnTheFlowAndSecret) {
+    IssGenerator gen;
+    auto other  = Flow;
+    other.ports = 40001u << 16 | 80;
+    EXPECT_NE(gen.make(other, Start), gen.make(Flow, Start));
+
+    // Another secret gives other ISNs.
+    IssGenerator others;
+    EXPECT_NE(others.make(Flow, Start), gen.make(Flow, Start));
+}
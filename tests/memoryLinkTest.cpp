@@ -0,0 +1,134 @@
+#include "endpoint.hpp"
+#include "linkDevice.hpp"
+#include "socket.hpp"
+#include "socketApi.hpp"
+#include "stack.hpp"
+#include "tins/ip_address.h"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace tcp;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Two stacks joined by a MemoryLink pair, each running on its own thread.
+class MemoryLinkTest : public ::testing::Test {
+  protected:
+    MemoryLinkTest()
+        : client(linkOf(ends.first), ClientIP),
+          server(linkOf(ends.second), ServerIP), clientApi(client, ClientIP),
+          serverApi(server, ServerIP) {
+    }
+
+    void SetUp() override {
+        clientThread = std::thread(&Stack::run, &client);
+        serverThread = std::thread(&Stack::run, &server);
+    }
+
+    void TearDown() override {
+        client.stop();
+        server.stop();
+        clientThread.join();
+        serverThread.join();
+    }
+
+    // Polls `fn` until it returns true, for at most `timeout`.
+    template <typename F>
+    static bool eventually(F&& fn, std::chrono::milliseconds timeout = 5s) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!fn()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+        return true;
+    }
+
+    static std::vector<std::unique_ptr<LinkDevice>>
+    linkOf(std::unique_ptr<MemoryLink>& end) {
+        std::vector<std::unique_ptr<LinkDevice>> links;
+        links.push_back(std::move(end));
+        return links;
+    }
+
+    inline static const Tins::IPv4Address ClientIP{"10.0.0.1"};
+    inline static const Tins::IPv4Address ServerIP{"10.0.0.2"};
+
+    std::pair<std::unique_ptr<MemoryLink>, std::unique_ptr<MemoryLink>> ends =
+        MemoryLink::pair(2048);
+    Stack client;
+    Stack server;
+    SocketApi clientApi;
+    SocketApi serverApi;
+    std::thread clientThread;
+    std::thread serverThread;
+};
+
+} // namespace
+
+TEST_F(MemoryLinkTest, HandshakeTransferAndClose) {
+    auto listener = serverApi.listen(80);
+    ASSERT_TRUE(listener);
+    auto conn = clientApi.connect({ServerIP, 80}, 40000);
+    ASSERT_TRUE(conn);
+
+    SocketHandle accepted = -1;
+    ASSERT_TRUE(eventually([&] {
+        auto handle = serverApi.accept(*listener);
+        if (!handle) {
+            return false;
+        }
+        accepted = *handle;
+        return true;
+    }));
+
+    // More than the send buffer holds, so sends have to wait for ACKs.
+    std::string data(Endpoint::SndBufSize + 300000, '\0');
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    std::string received;
+    size_t sent = 0;
+    uint8_t buf[16384];
+    ASSERT_TRUE(eventually([&] {
+        if (sent < data.size()) {
+            std::span<const uint8_t> rest(
+                reinterpret_cast<const uint8_t*>(data.data()) + sent,
+                data.size() - sent);
+            if (auto n = clientApi.send(*conn, rest)) {
+                sent += *n;
+            } else {
+                EXPECT_EQ(n.error(), SocketError::WouldBlock);
+            }
+        }
+        while (auto n = serverApi.recv(accepted, buf)) {
+            received.append(reinterpret_cast<const char*>(buf), *n);
+        }
+        return received.size() == data.size();
+    }));
+    EXPECT_EQ(received, data);
+
+    // The client closes first, the server reads the end of the stream and
+    // closes too.
+    ASSERT_TRUE(clientApi.close(*conn));
+    ASSERT_TRUE(eventually([&] {
+        auto n = serverApi.recv(accepted, buf);
+        return !n && n.error() == SocketError::Closed;
+    }));
+    ASSERT_TRUE(serverApi.close(accepted));
+
+    // The server's connection is gone once its FIN is acked, the client's
+    // went to TIME-WAIT, which keeps no Connection.
+    EXPECT_TRUE(eventually([&] {
+        return client.connections(100ms).empty() &&
+               server.connections(100ms).empty();
+    }));
+}
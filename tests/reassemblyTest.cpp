@@ -0,0 +1,121 @@
+#include "reassembly.hpp"
+#include <gtest/gtest.h>
+#include <optional>
+#include <span>
+#include <stdint.h>
+#include <string>
+
+using namespace tcp;
+
+namespace {
+
+std::span<const uint8_t> bytesOf(const std::string& s) {
+    return {reinterpret_cast<const uint8_t*>(s.data()), s.size()};
+}
+
+// The contiguous bytes at `nxt`, both pieces joined.
+std::string frontOf(const ReassemblyQueue& queue, uint32_t nxt) {
+    auto [first, second] = queue.front(nxt);
+    std::string s(first.begin(), first.end());
+    s.append(second.begin(), second.end());
+    return s;
+}
+
+} // namespace
+
+TEST(ReassemblyQueue, FillsTheGap) {
+    ReassemblyQueue queue(65536);
+    EXPECT_TRUE(queue.insert(1000, 1005, bytesOf("fghij")));
+    EXPECT_TRUE(queue.insert(1000, 1012, bytesOf("mn")));
+    EXPECT_EQ(queue.size(), 7u);
+    EXPECT_EQ(queue.ranges().size(), 2u);
+    // Still a gap at rcv.nxt.
+    EXPECT_EQ(frontOf(queue, 1000), "");
+
+    EXPECT_TRUE(queue.insert(1000, 1000, bytesOf("abcde")));
+    EXPECT_EQ(frontOf(queue, 1000), "abcdefghij");
+    EXPECT_EQ(queue.ranges().size(), 2u);
+
+    queue.advance(1010);
+    EXPECT_EQ(frontOf(queue, 1010), "");
+    EXPECT_TRUE(queue.insert(1010, 1010, bytesOf("kl")));
+    EXPECT_EQ(frontOf(queue, 1010), "klmn");
+    queue.advance(1014);
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(ReassemblyQueue, OverlapsOverwriteAndMerge) {
+    ReassemblyQueue queue(65536);
+    EXPECT_TRUE(queue.insert(0, 10, bytesOf("xxxx")));
+    EXPECT_TRUE(queue.insert(0, 20, bytesOf("yyyy")));
+    // Covers both blocks and the hole between them.
+    EXPECT_TRUE(queue.insert(0, 8, bytesOf("abcdefghijklmnopqr")));
+    ASSERT_EQ(queue.ranges().size(), 1u);
+    EXPECT_EQ(queue.ranges()[0].start, 8u);
+    EXPECT_EQ(queue.ranges()[0].end, 26u);
+    EXPECT_EQ(queue.size(), 18u);
+    queue.advance(8);
+    EXPECT_EQ(frontOf(queue, 8), "abcdefghijklmnopqr");
+}
+
+TEST(ReassemblyQueue, KeepsOnlyTheWindow) {
+    ReassemblyQueue queue(1024);
+    // Already received: taken and forgotten.
+    EXPECT_TRUE(queue.insert(100, 50, bytesOf("old")));
+    EXPECT_TRUE(queue.empty());
+    // Starting before rcv.nxt, only the new part is kept.
+    EXPECT_TRUE(queue.insert(100, 98, bytesOf("xxabc")));
+    EXPECT_EQ(frontOf(queue, 100), "abc");
+    queue.advance(103);
+
+    // Past the window, dropped.
+    EXPECT_FALSE(queue.insert(103, 103 + 1024, bytesOf("z")));
+    // Running past the end of the window, cut there.
+    EXPECT_TRUE(queue.insert(103, 103 + 1020, bytesOf("123456789")));
+    EXPECT_EQ(queue.size(), 4u);
+}
+
+TEST(ReassemblyQueue, DropsSegmentsOpeningTooManyHoles) {
+    ReassemblyQueue queue(65536);
+    for (uint32_t i = 0; i < ReassemblyQueue::MaxBlocks; i++) {
+        EXPECT_TRUE(queue.insert(0, 10 + i * 10, bytesOf("ab")));
+    }
+    EXPECT_FALSE(queue.insert(0, 1000, bytesOf("ab")));
+    // Growing a block is fine.
+    EXPECT_TRUE(queue.insert(0, 12, bytesOf("cd")));
+    EXPECT_EQ(queue.ranges().size(), ReassemblyQueue::MaxBlocks);
+    EXPECT_EQ(queue.size(), ReassemblyQueue::MaxBlocks * 2 + 2);
+}
+
+TEST(ReassemblyQueue, LatestIsTheLastInsertedBlock) {
+    ReassemblyQueue queue(65536);
+    EXPECT_EQ(queue.latest(), std::nullopt);
+    EXPECT_TRUE(queue.insert(0, 100, bytesOf("aaaa")));
+    EXPECT_TRUE(queue.insert(0, 10, bytesOf("bbbb")));
+    ASSERT_TRUE(queue.latest());
+    EXPECT_EQ(queue.latest()->start, 10u);
+    EXPECT_TRUE(queue.insert(0, 14, bytesOf("cccc")));
+    ASSERT_TRUE(queue.latest());
+    EXPECT_EQ(queue.latest()->start, 10u);
+    EXPECT_EQ(queue.latest()->end, 18u);
+}
+
+// The ring grows as segments land further out, and wraps in memory and in
+// sequence space, without losing what it held.
+TEST(ReassemblyQueue, GrowsAndWraps) {
+    ReassemblyQueue queue(1 << 20);
+    uint32_t nxt = 0xffffff00;
+    for (int round = 0; round < 40; round++) {
+        std::string chunk(1000 + round * 500, static_cast<char>('a' + round));
+        uint32_t gap = 100;
+        // The second half first, then the gap before it.
+        EXPECT_TRUE(queue.insert(nxt, nxt + gap, bytesOf(chunk)));
+        EXPECT_EQ(frontOf(queue, nxt), "");
+        std::string head(gap, '-');
+        EXPECT_TRUE(queue.insert(nxt, nxt, bytesOf(head)));
+        EXPECT_EQ(frontOf(queue, nxt), head + chunk) << "round " << round;
+        nxt += static_cast<uint32_t>(gap + chunk.size());
+        queue.advance(nxt);
+        EXPECT_TRUE(queue.empty());
+    }
+}
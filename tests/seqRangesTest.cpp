@@ -0,0 +1,103 @@
+#include "seqRanges.hpp"
+#include <gtest/gtest.h>
+#include <optional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+using namespace tcp;
+
+namespace {
+
+using Pairs = std::vector<std::pair<uint32_t, uint32_t>>;
+
+Pairs pairsOf(const SeqRangeList& list) {
+    Pairs pairs;
+    for (const auto& r : list.ranges()) {
+        pairs.emplace_back(r.start, r.end);
+    }
+    return pairs;
+}
+
+} // namespace
+
+TEST(SeqRangeList, AddKeepsRangesSortedAndMerged) {
+    SeqRangeList list(8);
+    EXPECT_TRUE(list.add(30, 40));
+    EXPECT_TRUE(list.add(10, 20));
+    EXPECT_TRUE(list.add(50, 60));
+    EXPECT_EQ(pairsOf(list), (Pairs{{10, 20}, {30, 40}, {50, 60}}));
+
+    // Touching merges as overlapping does.
+    EXPECT_TRUE(list.add(20, 25));
+    EXPECT_EQ(pairsOf(list), (Pairs{{10, 25}, {30, 40}, {50, 60}}));
+    // Spanning several ranges swallows them.
+    EXPECT_TRUE(list.add(28, 55));
+    EXPECT_EQ(pairsOf(list), (Pairs{{10, 25}, {28, 60}}));
+    // Inside a range, nothing changes.
+    EXPECT_TRUE(list.add(30, 31));
+    EXPECT_EQ(pairsOf(list), (Pairs{{10, 25}, {28, 60}}));
+    // Empty ranges are ignored.
+    EXPECT_TRUE(list.add(100, 100));
+    EXPECT_EQ(list.bytes(), 15u + 32u);
+}
+
+TEST(SeqRangeList, AddRefusesARangeTooMany) {
+    SeqRangeList list(2);
+    EXPECT_TRUE(list.add(10, 20));
+    EXPECT_TRUE(list.add(30, 40));
+    EXPECT_FALSE(list.add(50, 60));
+    EXPECT_EQ(pairsOf(list), (Pairs{{10, 20}, {30, 40}}));
+    // Merging needs no new range.
+    EXPECT_TRUE(list.add(15, 35));
+    EXPECT_EQ(pairsOf(list), (Pairs{{10, 40}}));
+}
+
+TEST(SeqRangeList, TrimForgetsWhatsBefore) {
+    SeqRangeList list(8);
+    list.add(10, 20);
+    list.add(30, 40);
+    list.trim(15);
+    EXPECT_EQ(pairsOf(list), (Pairs{{15, 20}, {30, 40}}));
+    list.trim(30);
+    EXPECT_EQ(pairsOf(list), (Pairs{{30, 40}}));
+    list.trim(40);
+    EXPECT_TRUE(list.empty());
+}
+
+TEST(SeqRangeList, FindAndFirstGap) {
+    SeqRangeList list(8);
+    list.add(10, 20);
+    list.add(30, 40);
+
+    EXPECT_EQ(list.find(10).value().start, 10u);
+    EXPECT_EQ(list.find(19).value().start, 10u);
+    EXPECT_EQ(list.find(20), std::nullopt);
+    EXPECT_EQ(list.find(35).value().end, 40u);
+
+    auto gap = list.firstGap(0, 100);
+    ASSERT_TRUE(gap);
+    EXPECT_EQ(std::pair(gap->start, gap->end), std::pair(0u, 10u));
+    gap = list.firstGap(12, 100);
+    ASSERT_TRUE(gap);
+    EXPECT_EQ(std::pair(gap->start, gap->end), std::pair(20u, 30u));
+    gap = list.firstGap(35, 100);
+    ASSERT_TRUE(gap);
+    EXPECT_EQ(std::pair(gap->start, gap->end), std::pair(40u, 100u));
+    EXPECT_EQ(list.firstGap(12, 18), std::nullopt);
+    EXPECT_EQ(list.firstGap(30, 40), std::nullopt);
+}
+
+// Sequence numbers wrap at 2^32, ranges across it still sort and merge.
+TEST(SeqRangeList, WrapsAround) {
+    SeqRangeList list(8);
+    EXPECT_TRUE(list.add(10, 20));
+    EXPECT_TRUE(list.add(0xfffffff0, 0xfffffff8));
+    EXPECT_EQ(pairsOf(list), (Pairs{{0xfffffff0, 0xfffffff8}, {10, 20}}));
+    EXPECT_TRUE(list.add(0xfffffff8, 10));
+    EXPECT_EQ(pairsOf(list), (Pairs{{0xfffffff0, 20}}));
+    EXPECT_EQ(list.bytes(), 36u);
+
+    list.trim(2);
+    EXPECT_EQ(pairsOf(list), (Pairs{{2, 20}}));
+}
@@ -0,0 +1,64 @@
+#include "socket.hpp"
+#include "synCookies.hpp"
+#include <gtest/gtest.h>
+#include <optional>
+#include <stdint.h>
+
+using namespace tcp;
+
+namespace {
+
+constexpr FlowKey Flow = {
+    .srcAddr = 0x0a000002,
+    .dstAddr = 0x0a000001,
+    .ports   = 80u << 16 | 40000,
+};
+
+// The start of a period, so adding less than one stays in it.
+const auto Start = SynCookies::Clock::time_point{} + SynCookies::Period * 1000;
+
+} // namespace
+
+TEST(SynCookies, CheckReturnsTheMss) {
+    SynCookies cookies;
+    for (auto mss : SynCookies::MssTable) {
+        auto cookie = cookies.make(Flow, 1234, mss, Start);
+        EXPECT_EQ(cookies.check(Flow, 1234, cookie, Start), mss);
+    }
+}
+
+TEST(SynCookies, MssRoundsDownToTheTable) {
+    SynCookies cookies;
+    auto cookie = cookies.make(Flow, 1, 1450, Start);
+    EXPECT_EQ(cookies.check(Flow, 1, cookie, Start), 1440);
+    // Below the table, the minimum every host takes.
+    cookie = cookies.make(Flow, 1, 100, Start);
+    EXPECT_EQ(cookies.check(Flow, 1, cookie, Start), 536);
+}
+
+TEST(SynCookies, OnlyValidForItsFlowAndIss) {
+    SynCookies cookies;
+    auto cookie = cookies.make(Flow, 1234, 1460, Start);
+
+    auto other  = Flow;
+    other.ports = 80u << 16 | 40001;
+    EXPECT_EQ(cookies.check(other, 1234, cookie, Start), std::nullopt);
+    EXPECT_EQ(cookies.check(Flow, 1235, cookie, Start), std::nullopt);
+    EXPECT_EQ(cookies.check(Flow, 1234, cookie ^ 1, Start), std::nullopt);
+
+    // Another secret makes other cookies.
+    SynCookies others;
+    EXPECT_EQ(others.check(Flow, 1234, cookie, Start), std::nullopt);
+}
+
+TEST(SynCookies, ExpireAfterTwoPeriods) {
+    SynCookies cookies;
+    auto cookie = cookies.make(Flow, 1234, 1460, Start);
+    auto late   = Start + SynCookies::Period * 2 - std::chrono::seconds(1);
+    EXPECT_EQ(cookies.check(Flow, 1234, cookie, late), 1460);
+    EXPECT_EQ(cookies.check(Flow, 1234, cookie, Start + SynCookies::Period * 2),
+              std::nullopt);
+    // Nor are they valid before they were made.
+    EXPECT_EQ(cookies.check(Flow, 1234, cookie, Start - SynCookies::Period),
+              std::nullopt);
+}
@@ -0,0 +1,161 @@
+#include "timerWheel.hpp"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <optional>
+#include <stdint.h>
+#include <vector>
+
+using namespace tcp;
+using namespace std::chrono_literals;
+
+namespace {
+
+// A wheel that starts an hour from now: arm() reads the real clock, which
+// is then tick 0, so only advance() moves time.
+struct Wheel {
+    TimerWheel::Clock::time_point start =
+        TimerWheel::Clock::now() + std::chrono::hours(1);
+    TimerWheel wheel{start};
+
+    // Advances tick by tick to `tick`.
+    void runTo(uint64_t tick) {
+        for (uint64_t t = now + 1; t <= tick; t++) {
+            now = t;
+            wheel.advance(start + TimerWheel::Tick * t);
+        }
+    }
+
+    uint64_t now = 0;
+};
+
+} // namespace
+
+// Timers far enough out to start on the upper levels have to be cascaded
+// down, on time, before they fire.
+TEST(TimerWheel, FiresOnItsTickOnEveryLevel) {
+    Wheel w;
+    const std::vector<uint64_t> after = {
+        1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 262143, 262144, 300001};
+    std::vector<std::unique_ptr<Timer>> timers;
+    std::vector<uint64_t> firedAt(after.size(), 0);
+    for (size_t i = 0; i < after.size(); i++) {
+        timers.push_back(std::make_unique<Timer>([&w, &firedAt, i] {
+            firedAt[i] = w.now;
+        }));
+        w.wheel.arm(*timers.back(), TimerWheel::Tick * after[i]);
+    }
+    EXPECT_EQ(w.wheel.size(), after.size());
+
+    w.runTo(after.back());
+    for (size_t i = 0; i < after.size(); i++) {
+        EXPECT_EQ(firedAt[i], after[i]) << "armed " << after[i];
+        EXPECT_FALSE(timers[i]->armed());
+    }
+    EXPECT_EQ(w.wheel.size(), 0u);
+}
+
+TEST(TimerWheel, RoundsUpToATick) {
+    Wheel w;
+    uint64_t firedAt = 0;
+    Timer timer([&] {
+        firedAt = w.now;
+    });
+    w.wheel.arm(timer, 1500us);
+    w.runTo(10);
+    EXPECT_EQ(firedAt, 2u);
+
+    // Even a timer of no time waits for the next tick.
+    w.wheel.arm(timer, 0ms);
+    w.runTo(11);
+    EXPECT_EQ(firedAt, 11u);
+}
+
+TEST(TimerWheel, CancelledTimersDontFire) {
+    Wheel w;
+    int fired = 0;
+    Timer near([&] {
+        fired++;
+    });
+    Timer far([&] {
+        fired++;
+    });
+    Timer kept([&] {
+        fired++;
+    });
+    w.wheel.arm(near, 10ms);
+    w.wheel.arm(far, 5000ms);
+    w.wheel.arm(kept, 5000ms);
+
+    w.wheel.cancel(near);
+    EXPECT_FALSE(near.armed());
+    // Cancelled after it was cascaded down a level.
+    w.runTo(4900);
+    w.wheel.cancel(far);
+    // Cancelling twice does nothing.
+    w.wheel.cancel(far);
+    EXPECT_EQ(w.wheel.size(), 1u);
+
+    w.runTo(6000);
+    EXPECT_EQ(fired, 1);
+    EXPECT_EQ(w.wheel.size(), 0u);
+}
+
+TEST(TimerWheel, DestroyingAnArmedTimerCancelsIt) {
+    Wheel w;
+    bool fired = false;
+    {
+        Timer timer([&] {
+            fired = true;
+        });
+        w.wheel.arm(timer, 100ms);
+        EXPECT_EQ(w.wheel.size(), 1u);
+    }
+    EXPECT_EQ(w.wheel.size(), 0u);
+    w.runTo(200);
+    EXPECT_FALSE(fired);
+}
+
+TEST(TimerWheel, RearmingMovesTheTimer) {
+    Wheel w;
+    std::vector<uint64_t> firedAt;
+    Timer timer([&] {
+        firedAt.push_back(w.now);
+    });
+    w.wheel.arm(timer, 100ms);
+    w.runTo(50);
+    w.wheel.arm(timer, 100ms);
+    EXPECT_EQ(w.wheel.size(), 1u);
+    w.runTo(300);
+    EXPECT_EQ(firedAt, std::vector<uint64_t>{150});
+}
+
+TEST(TimerWheel, CallbacksCanRearm) {
+    Wheel w;
+    std::vector<uint64_t> firedAt;
+    Timer timer;
+    timer.setCallback([&] {
+        firedAt.push_back(w.now);
+        if (firedAt.size() < 3) {
+            w.wheel.arm(timer, 70ms);
+        }
+    });
+    w.wheel.arm(timer, 70ms);
+    w.runTo(1000);
+    EXPECT_EQ(firedAt, (std::vector<uint64_t>{70, 140, 210}));
+}
+
+TEST(TimerWheel, NextTimeoutNeverOversleeps) {
+    Wheel w;
+    EXPECT_EQ(w.wheel.nextTimeout(w.start), std::nullopt);
+
+    Timer timer;
+    w.wheel.arm(timer, 10ms);
+    EXPECT_EQ(w.wheel.nextTimeout(w.start), 10ms);
+
+    // On an upper level it may wake the loop early, never late.
+    w.wheel.arm(timer, 1000ms);
+    auto wait = w.wheel.nextTimeout(w.start);
+    ASSERT_TRUE(wait);
+    EXPECT_LE(*wait, 1000ms);
+}